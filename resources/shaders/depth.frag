@@ -0,0 +1,7 @@
+#version 330 core
+
+// Fragment stage of the depth pre-pass: nothing is shaded and color writes are masked off, so all a draw leaves
+// behind is its depth (see RenderQueue)
+void main()
+{
+}
@@ -0,0 +1,10 @@
+#version 410 core
+
+// Hands each instance matrix (drawn as a point) to instancecull.geom
+layout(location = 0) in mat4 instance_matrix;
+
+out mat4 matrix;
+
+void main() {
+    matrix = instance_matrix;
+}
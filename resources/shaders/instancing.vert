@@ -20,18 +20,30 @@ out vec3 Normal;
 out vec3 color;
 // Outputs the texture coordinates to the Fragment Shader
 out vec2 texCoord;
+// The depth pre-pass draws with this same stage (and depth.frag), and the shaded pass only keeps fragments at the depth
+// it left, so both have to come out with exactly the same position
+invariant gl_Position;
 
 // NOTE: No model matrices are passed as uniforms (they're passed in as part of the VBO)
 
-// Imports the camera matrices
-uniform mat4 view_matrix;
-uniform mat4 proj_matrix;
+// Camera data, shared by every shader and written once a frame (FrameBlock in realtime.h)
+layout(std140) uniform FrameData {
+    mat4 view_matrix;
+    mat4 proj_matrix;
+    mat4 inverse_view_matrix;
+    vec4 camera_pos;
+    float time;
+};
+// Undoes position quantization (1 and 0 unless the mesh uses the quantized vertex format)
+uniform vec3 position_scale;
+uniform vec3 position_offset;
 
 
 void main()
 {
+        vec3 position = aPos * position_scale + position_offset;
         // calculates current position
-        crntPos = vec3(instanceMatrix * vec4(aPos, 1.0f));
+        crntPos = vec3(instanceMatrix * vec4(position, 1.0f));
         // Assigns the normal from the Vertex Data to "Normal"
         Normal = aNormal;
         // Assigns the colors from the Vertex Data to "color"
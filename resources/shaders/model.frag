@@ -17,97 +17,102 @@ in vec2 texCoord;
 // Gets the Texture Units from the main function
 uniform sampler2D diffuse0;
 uniform sampler2D specular0;
-// Gets the color of the light from the main function
-uniform vec4 light_color;
-// Gets the position of the light from the main function
-uniform vec3 light_pos;
-// Gets the position of the camera from the main function
-uniform vec3 camera_pos;
-
-
-vec4 pointLight()
+// Gets the material's base color (multiplies the diffuse texture)
+uniform vec4 base_color;
+
+// Number of lights to support (Realtime defines it from its max_lights)
+#ifndef MAX_LIGHTS
+#define MAX_LIGHTS 8
+#endif
+
+// Struct definition of lights (Light in realtime.h, laid out by std140)
+struct Light {
+    vec4 color;
+    vec4 pos;
+    vec4 dir;
+    vec3 attenuation_func;
+    float penumbra;
+    float angle;
+    // Type indicates what kind of light this is
+    // 0 -> Directional
+    // 1 -> Point
+    // 2 -> Spot
+    int type;
+};
+
+// The scene's lights, shared by every shader that lights things (LightBlock in realtime.h)
+// Only the first light_count lights are the scene's (the rest of the array is never written)
+layout(std140) uniform LightData {
+    int light_count;
+    Light lights[MAX_LIGHTS];
+};
+
+// Camera data, shared by every shader and written once a frame (FrameBlock in realtime.h)
+layout(std140) uniform FrameData {
+    mat4 view_matrix;
+    mat4 proj_matrix;
+    mat4 inverse_view_matrix;
+    vec4 camera_pos;
+    float time;
+};
+
+// Light that reaches everything, whatever the scene's lights are
+const float ambient = 0.50f;
+// How much of the specular texture is reflected
+const float specularLight = 0.50f;
+
+
+// How much of a light reaches crntPos (attenuation and spot falloff), and the direction it comes from
+float lightIntensity(Light light, out vec3 lightDirection)
 {
-        // used in two variables so I calculate it here to not have to do it twice
-        vec3 lightVec = light_pos - crntPos;
-
-        // intensity of light with respect to distance
+        // Directional lights come from the same direction everywhere, and don't fall off
+        if (light.type == 0)
+        {
+                lightDirection = normalize(-vec3(light.dir));
+                return 1.0f;
+        }
+
+        vec3 lightVec = vec3(light.pos) - crntPos;
         float dist = length(lightVec);
-        float a = 3.0;
-        float b = 0.7;
-        float inten = 1.0f / (a * dist * dist + b * dist + 1.0f);
-
-        // ambient lighting
-        float ambient = 0.20f;
-
-        // diffuse lighting
-        vec3 normal = normalize(Normal);
-        vec3 lightDirection = normalize(lightVec);
-        float diffuse = max(dot(normal, lightDirection), 0.0f);
-
-        // specular lighting
-        float specularLight = 0.50f;
-        vec3 viewDirection = normalize(camera_pos - crntPos);
-        vec3 reflectionDirection = reflect(-lightDirection, normal);
-        float specAmount = pow(max(dot(viewDirection, reflectionDirection), 0.0f), 16);
-        float specular = specAmount * specularLight;
+        lightDirection = lightVec / dist;
 
-        return (texture(diffuse0, texCoord) * (diffuse * inten + ambient) + texture(specular0, texCoord).r * specular * inten) * light_color;
+        // intensity of light with respect to distance
+        vec3 att = light.attenuation_func;
+        float inten = clamp(1.0f / (att.x + att.y * dist + att.z * dist * dist), 0.0f, 1.0f);
+
+        // Spot lights fade out (smoothly) over the penumbra at the edge of their cone
+        if (light.type == 2)
+        {
+                float theta = acos(dot(normalize(vec3(light.dir)), -lightDirection));
+                float innerCone = light.angle - light.penumbra;
+                inten *= 1.0f - smoothstep(innerCone, light.angle, theta);
+        }
+        return inten;
 }
 
-vec4 direcLight()
-{
-        // ambient lighting
-        float ambient = 0.50f;
-
-        // diffuse lighting
-        vec3 normal = normalize(Normal);
-        vec3 lightDirection = normalize(vec3(1.0f, 1.0f, -2.0f));
-        float diffuse = max(dot(normal, lightDirection), 0.0f);
 
-        // specular lighting
-        float specularLight = 0.50f;
-        vec3 viewDirection = normalize(camera_pos - crntPos);
-        vec3 reflectionDirection = reflect(-lightDirection, normal);
-        float specAmount = pow(max(dot(viewDirection, reflectionDirection), 0.0f), 16);
-        float specular = specAmount * specularLight;
-
-        return (texture(diffuse0, texCoord) * (diffuse + ambient) + texture(specular0, texCoord).r * specular) * light_color;
-}
-
-vec4 spotLight()
+void main()
 {
-        // controls how big the area that is lit up is
-        float outerCone = 0.90f;
-        float innerCone = 0.95f;
-
-        // ambient lighting
-        float ambient = 0.20f;
-
-        // diffuse lighting
         vec3 normal = normalize(Normal);
-        vec3 lightDirection = normalize(light_pos - crntPos);
-        float diffuse = max(dot(normal, lightDirection), 0.0f);
+        vec3 viewDirection = normalize(vec3(camera_pos) - crntPos);
 
-        // specular lighting
-        float specularLight = 0.50f;
-        vec3 viewDirection = normalize(camera_pos - crntPos);
-        vec3 reflectionDirection = reflect(-lightDirection, normal);
-        float specAmount = pow(max(dot(viewDirection, reflectionDirection), 0.0f), 16);
-        float specular = specAmount * specularLight;
+        // Sums diffuse and specular lighting over the scene's lights
+        vec3 diffuse = vec3(0.0f);
+        vec3 specular = vec3(0.0f);
+        for (int i = 0; i < light_count; i++)
+        {
+                vec3 lightDirection;
+                float inten = lightIntensity(lights[i], lightDirection);
+                vec3 lightColor = vec3(lights[i].color) * inten;
 
-        // calculates the intensity of the crntPos based on its angle to the center of the light cone
-        float angle = dot(vec3(0.0f, -1.0f, 0.0f), -lightDirection);
-        float inten = clamp((angle - outerCone) / (innerCone - outerCone), 0.0f, 1.0f);
-
-        return (texture(diffuse0, texCoord) * (diffuse * inten + ambient) + texture(specular0, texCoord).r * specular * inten) * light_color;
-}
+                diffuse += max(dot(normal, lightDirection), 0.0f) * lightColor;
 
+                vec3 reflectionDirection = reflect(-lightDirection, normal);
+                float specAmount = pow(max(dot(viewDirection, reflectionDirection), 0.0f), 16);
+                specular += specAmount * specularLight * lightColor;
+        }
 
-void main()
-{
         // outputs final color
-        FragColor = direcLight();
-
-    // PLACEHOLDER:
-    //FragColor = vec4(1.0);
+        vec4 baseColor = texture(diffuse0, texCoord) * base_color;
+        FragColor = vec4(baseColor.rgb * (diffuse + ambient) + texture(specular0, texCoord).r * specular, baseColor.a);
 }
@@ -0,0 +1,79 @@
+#version 330 core
+
+// model.vert for meshes drawn through a ModelBatch: every mesh of the model is in the same buffers, so the mesh's
+// own matrix and position quantization come from the batch's draw data (indexed by aDraw) instead of uniforms
+// With SPACESHIP defined it's spaceship.vert instead (which places the ship relative to the camera)
+
+// Positions/Coordinates
+layout (location = 0) in vec3 aPos;
+// Normals (not necessarily normalized)
+layout (location = 1) in vec3 aNormal;
+// Colors
+layout (location = 2) in vec3 aColor;
+// Texture Coordinates
+layout (location = 3) in vec2 aTex;
+// Which of the batch's meshes the vertex belongs to
+layout (location = 8) in uint aDraw;
+
+
+// Outputs the current position for the Fragment Shader
+out vec3 crntPos;
+// Outputs the normal for the Fragment Shader
+out vec3 Normal;
+// Outputs the color for the Fragment Shader
+out vec3 color;
+// Outputs the texture coordinates to the Fragment Shader
+out vec2 texCoord;
+// The depth pre-pass draws with this same stage (and depth.frag), and the shaded pass only keeps fragments at the depth
+// it left, so both have to come out with exactly the same position
+invariant gl_Position;
+
+
+
+// Camera data, shared by every shader and written once a frame (FrameBlock in realtime.h)
+layout(std140) uniform FrameData {
+    mat4 view_matrix;
+    mat4 proj_matrix;
+    mat4 inverse_view_matrix;
+    vec4 camera_pos;
+    float time;
+};
+// Per mesh: its matrix (4 texels, one per column), position_scale and position_offset (ModelBatch::drawDataTexels)
+uniform samplerBuffer draw_data;
+// Placement of the whole model
+uniform mat4 translation;
+uniform mat4 rotation;
+uniform mat4 scale;
+
+
+void main()
+{
+        int base = int(aDraw) * 6;
+        mat4 model = mat4(texelFetch(draw_data, base), texelFetch(draw_data, base + 1),
+                          texelFetch(draw_data, base + 2), texelFetch(draw_data, base + 3));
+        vec3 position = aPos * texelFetch(draw_data, base + 4).xyz + texelFetch(draw_data, base + 5).xyz;
+
+#ifdef SPACESHIP
+        // calculates translation of current position relative to camera
+        mat4 model_mat = inverse_view_matrix * inverse(translation);
+#else
+        // calculates current position
+        mat4 model_mat = model * translation * rotation * scale;
+#endif
+        crntPos = vec3(model_mat * vec4(position, 1.0));
+        // Assigns the normal from the Vertex Data to "Normal"
+        mat3 inverse_model_matrix = inverse(mat3(model_mat));
+        Normal = normalize(inverse_model_matrix * aNormal);
+        // Assigns the colors from the Vertex Data to "color"
+        color = aColor;
+        // Assigns the texture coordinates from the Vertex Data to "texCoord"
+        texCoord = mat2(0.0, -1.0, 1.0, 0.0) * aTex;
+
+        // Outputs the positions/coordinates of all vertices
+#ifdef SPACESHIP
+        // Fix the object's position in camera space
+        gl_Position = proj_matrix * translation * scale * rotation * vec4(position, 1.0);
+#else
+        gl_Position = (proj_matrix * view_matrix) * vec4(crntPos, 1.0);
+#endif
+}
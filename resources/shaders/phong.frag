@@ -1,6 +1,8 @@
 #version 330 core
-// Number of lights to support
-const int num_lights = 8;
+// Number of lights to support (Realtime defines it from its max_lights)
+#ifndef MAX_LIGHTS
+#define MAX_LIGHTS 8
+#endif
 
 // Inputs: Position and normal for model's point in world space
 in vec3 world_position;
@@ -9,38 +11,47 @@ in vec3 world_normal;
 // Outputs: The color for this fragment (pixel-esque thingy)
 out vec4 frag_color;
 
-// Struct definition of lights as uniform
+// Struct definition of lights (Light in realtime.h, laid out by std140)
 struct Light {
     vec4 color;
-    vec3 pos;
-    vec3 attenuation_func;
+    vec4 pos;
     vec4 dir;
+    vec3 attenuation_func;
     float penumbra;
     float angle;
     // Type indicates what kind of light this is
     // 0 -> Directional
     // 1 -> Point
     // 2 -> Spot
-    // -1 -> Light doesn't exist
     int type;
 };
 
-// Uniform for lights
-uniform Light lights[num_lights];
+// The scene's lights, shared by every shader that lights things (LightBlock in realtime.h)
+// Only the first light_count lights are the scene's (the rest of the array is never written)
+layout(std140) uniform LightData {
+    int light_count;
+    Light lights[MAX_LIGHTS];
+};
 
 // Uniform for lighting computation (global coeffs)
 uniform float ka;
 uniform float kd;
 uniform float ks;
 
-// Uniform material properties of primitive
-uniform vec4 ambient;
-uniform vec4 diffuse;
-uniform vec4 specular;
-uniform float shininess;
-
-// Uniform positions required
-uniform vec3 camera_pos;
+// Material properties of primitive (per instance, from phong.vert)
+flat in vec4 ambient;
+flat in vec4 diffuse;
+flat in vec4 specular;
+flat in float shininess;
+
+// Camera data, shared by every shader and written once a frame (FrameBlock in realtime.h)
+layout(std140) uniform FrameData {
+    mat4 view_matrix;
+    mat4 proj_matrix;
+    mat4 inverse_view_matrix;
+    vec4 camera_pos;
+    float time;
+};
 
 // Helper to compute Phong lighting for directional lights
 vec3 compute_directional_light(Light light, vec3 normal) {
@@ -75,13 +86,13 @@ vec3 compute_directional_light(Light light, vec3 normal) {
 vec3 compute_point_light(Light light, vec3 normal) {
     // Helpful precomputation to apply Phong lighting equation (as in directional lights)
     vec3 light_color = vec3(light.color);
-    vec3 light_direction = normalize(world_position - light.pos);
+    vec3 light_direction = normalize(world_position - vec3(light.pos));
     vec3 accumulated_color = vec3(0.0);
     vec3 reflected_light = normalize(reflect(light_direction, normal));
     vec3 normal_camera_pos = normalize(vec3(camera_pos) - world_position);
 
     // Compute attenuation coefficient
-    float distance = length(world_position - light.pos);
+    float distance = length(world_position - vec3(light.pos));
     float attenuation = 1.0 / (light.attenuation_func[0] + (distance * light.attenuation_func[1]) + (distance * distance * light.attenuation_func[2]));
     attenuation = clamp(attenuation, 0.0, 1.0);
 
@@ -110,7 +121,7 @@ vec3 compute_point_light(Light light, vec3 normal) {
 vec3 compute_spot_light(Light light, vec3 normal) {
     // Helpful precomputation to apply Phong lighting equation (as in spot lights)
     vec3 light_color = vec3(light.color);
-    vec3 light_to_position = normalize(world_position - light.pos);
+    vec3 light_to_position = normalize(world_position - vec3(light.pos));
     vec3 light_dir = vec3(light.dir);
     vec3 accumulated_color = vec3(0.0);
     vec3 reflected_light = normalize(reflect(light_to_position, normal));
@@ -136,7 +147,7 @@ vec3 compute_spot_light(Light light, vec3 normal) {
     }
 
     // Compute attenuation coefficient
-    float distance = length(world_position - light.pos);
+    float distance = length(world_position - vec3(light.pos));
     float attenuation = 1.0 / (light.attenuation_func[0] + (distance * light.attenuation_func[1]) + (distance * distance * light.attenuation_func[2]));
     // Incorporate falloff
     attenuation = attenuation * falloff;
@@ -174,8 +185,8 @@ void main() {
     vec3 accumulated_color = vec3(0.0);
     accumulated_color += ka * vec3(ambient);
 
-    // Accumulate color for all lights
-    for (int i = 0; i < num_lights; i++) {
+    // Accumulate color for the scene's lights
+    for (int i = 0; i < light_count; i++) {
         // Switch case based on light type
         // Directional
         if (lights[i].type == 0) {
@@ -7,14 +7,34 @@ layout(location = 1) in vec3 object_normal;
 // Output position and normal in world space (this just converts things to world space)
 out vec3 world_position;
 out vec3 world_normal;
+// The depth pre-pass draws with this same stage (and depth.frag), and the shaded pass only keeps fragments at the depth
+// it left, so both have to come out with exactly the same position
+invariant gl_Position;
 
-// Uniforms for computing transformations related to model (position and normal)
-uniform mat4 model_matrix;
-uniform mat3 inverse_model_normal_matrix;
+// Per-primitive data, one of each per instance (PrimitiveInstance in primitive.h)
+// Transformations related to model (position and normal)
+layout(location = 2) in mat4 model_matrix;
+layout(location = 6) in mat3 inverse_model_normal_matrix;
+// Material properties of primitive
+layout(location = 9) in vec4 instance_ambient;
+layout(location = 10) in vec4 instance_diffuse;
+layout(location = 11) in vec4 instance_specular;
+layout(location = 12) in float instance_shininess;
 
-// Uniforms for computing the gl_Position var (determines where object appears on screen)
-uniform mat4 view_matrix;
-uniform mat4 proj_matrix;
+// The material is the same across the whole primitive, so it's passed on without interpolation
+flat out vec4 ambient;
+flat out vec4 diffuse;
+flat out vec4 specular;
+flat out float shininess;
+
+// Camera data, shared by every shader and written once a frame (FrameBlock in realtime.h)
+layout(std140) uniform FrameData {
+    mat4 view_matrix;
+    mat4 proj_matrix;
+    mat4 inverse_view_matrix;
+    vec4 camera_pos;
+    float time;
+};
 
 void main() {
     // Convert object to homogeneous coordinates so we can apply transform
@@ -24,6 +44,12 @@ void main() {
     // Compute the normal using the inverse_model_normal_matrix
     world_normal = normalize(inverse_model_normal_matrix * object_normal);
 
+    // Pass on the material
+    ambient = instance_ambient;
+    diffuse = instance_diffuse;
+    specular = instance_specular;
+    shininess = instance_shininess;
+
     // Compute gl_Position
     gl_Position = (proj_matrix * view_matrix * model_matrix) * homo_object_pos;
 }
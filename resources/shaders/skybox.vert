@@ -3,12 +3,20 @@ layout (location = 0) in vec3 iPos;
 
 out vec3 texture_coords;
 
-uniform mat4 proj_matrix;
-uniform mat4 view_matrix;
+// Camera data, shared by every shader and written once a frame (FrameBlock in realtime.h)
+layout(std140) uniform FrameData {
+    mat4 view_matrix;
+    mat4 proj_matrix;
+    mat4 inverse_view_matrix;
+    vec4 camera_pos;
+    float time;
+};
 
 void main()
 {
-    vec4 pos = proj_matrix * view_matrix * vec4(iPos, 1.0f);
+    // Drop the view matrix's translation (the skybox doesn't move with the camera)
+    mat4 view_no_translate = mat4(mat3(view_matrix));
+    vec4 pos = proj_matrix * view_no_translate * vec4(iPos, 1.0f);
     // Having z equal w will always result in a depth of 1.0f
     gl_Position = vec4(pos.x, pos.y, pos.w, pos.w);
     // We want to flip the z axis due to the different coordinate systems (left hand vs right hand)
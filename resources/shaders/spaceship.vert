@@ -18,25 +18,36 @@ out vec3 Normal;
 out vec3 color;
 // Outputs the texture coordinates to the Fragment Shader
 out vec2 texCoord;
+// The depth pre-pass draws with this same stage (and depth.frag), and the shaded pass only keeps fragments at the depth
+// it left, so both have to come out with exactly the same position
+invariant gl_Position;
 
 
 
-// Imports the camera matrix
-uniform mat4 proj_matrix;
-uniform mat4 inverse_view_matrix;
-uniform vec3 camera_pos;
+// Camera data, shared by every shader and written once a frame (FrameBlock in realtime.h)
+layout(std140) uniform FrameData {
+    mat4 view_matrix;
+    mat4 proj_matrix;
+    mat4 inverse_view_matrix;
+    vec4 camera_pos;
+    float time;
+};
 // Imports the transformation matrices
 uniform mat4 model;
 uniform mat4 translation;
 uniform mat4 rotation;
 uniform mat4 scale;
+// Undoes position quantization (1 and 0 unless the mesh uses the quantized vertex format)
+uniform vec3 position_scale;
+uniform vec3 position_offset;
 
 
 void main()
 {
+        vec3 position = aPos * position_scale + position_offset;
         // calculates translation of current position relative to camera
         mat4 model_mat = inverse_view_matrix * inverse(translation);
-        crntPos = vec3(model_mat * vec4(aPos, 1.0));
+        crntPos = vec3(model_mat * vec4(position, 1.0));
         // Assigns the normal from the Vertex Data to "Normal"
         mat3 inverse_model_matrix = inverse(mat3(model_mat));
         Normal = normalize(inverse_model_matrix * aNormal);
@@ -47,5 +58,5 @@ void main()
 
         // Outputs the positions/coordinates of all vertices
         // Fix the object's position in camera space
-        gl_Position = proj_matrix * translation * scale * rotation * vec4(aPos, 1.0);
+        gl_Position = proj_matrix * translation * scale * rotation * vec4(position, 1.0);
 }
@@ -0,0 +1,63 @@
+#define STB_IMAGE_IMPLEMENTATION
+#include "meshes/modeldata.h"
+#include "meshes/textureimage.h"
+
+#include <cstring>
+#include <iostream>
+
+// Offline tool that bakes .gltf/.glb models into .ymesh caches next to them, and conditions the textures they use
+// into .ytex containers (full mip chain, BC compressed with --compress)
+// Usage: yesmansky_bake [--compress] resources/models/planet/scene.gltf [more models...]
+// Model::loadModel picks the caches up automatically and falls back to the source files once they're out of date
+int main(int argc, char *argv[]) {
+    bool compress = false;
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--compress") == 0) {
+            compress = true;
+        } else {
+            paths.push_back(argv[i]);
+        }
+    }
+    if (paths.empty()) {
+        std::cerr << "Usage: " << argv[0] << " [--compress] <model.gltf|model.glb>...\n";
+        return 1;
+    }
+
+    int failures = 0;
+    for (const std::string& path : paths) {
+        std::string bakedPath = ModelData::bakedPath(path);
+        try {
+            ModelData data;
+            std::vector<MeshOptimizer::Report> reports = data.loadGltf(path);
+
+            // Images embedded in a .glb have no file to put a container next to, so they're decoded at load time
+            // They're conditioned before the .ymesh is written, so a model whose textures fail leaves no fresh bake
+            for (const TextureData& texture : data.textures) {
+                if (texture.path.empty()) {
+                    continue;
+                }
+                std::string conditionedPath = TextureImage::conditionedPath(texture.path);
+                TextureImage::condition(texture.path, conditionedPath, compress);
+                std::cout << "Conditioned " << texture.path << " -> " << conditionedPath << "\n";
+            }
+
+            data.writeBaked(bakedPath);
+            std::cout << "Baked " << path << " -> " << bakedPath << " (" << data.meshes.size() << " meshes, "
+                      << data.vertices.size() << " vertices, " << data.indices.size() << " indices)\n";
+            for (unsigned int m = 0; m < reports.size(); m++) {
+                const MeshOptimizer::Report& report = reports[m];
+                std::cout << "  mesh " << m << ": " << report.verticesBefore << " -> " << report.verticesAfter
+                          << " vertices, ACMR " << report.acmrBefore << " -> " << report.acmrAfter << "\n";
+                const std::vector<MeshLod>& lods = data.meshes[m].lods;
+                for (unsigned int l = 0; l < lods.size(); l++) {
+                    std::cout << "    LOD " << l << ": " << lods[l].indexCount / 3 << " triangles, error " << lods[l].error << "\n";
+                }
+            }
+        } catch (const std::exception& e) {
+            std::cerr << "Failed to bake " << path << ": " << e.what() << "\n";
+            failures++;
+        }
+    }
+    return failures == 0 ? 0 : 1;
+}
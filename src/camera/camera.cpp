@@ -121,6 +121,11 @@ glm::mat4 Camera::get_projection_matrix() {
     return m_proj;
 }
 
+// Extracts the frustum planes from the view and projection matrices
+Culling::Frustum Camera::get_frustum() {
+    return Culling::Frustum(m_proj * m_view);
+}
+
 // Getter for camera position
 glm::vec4 Camera::get_camera_pos() {
     return m_pos;
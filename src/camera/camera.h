@@ -2,6 +2,7 @@
 
 #include <glm/glm.hpp>
 #include "../utils/scenedata.h"
+#include "../utils/culling.h"
 #include <tuple>
 
 // A class representing a virtual camera.
@@ -27,6 +28,9 @@ public:
     // Returns the projection matrix
     glm::mat4 get_projection_matrix();
 
+    // Returns the planes around what the camera sees (in world space), for frustum culling
+    Culling::Frustum get_frustum();
+
     // Updates submatrices for viewing
     void update_translation_matrix(glm::vec4 new_position);
     void update_rotation_matrix(glm::vec4 new_look, glm::vec4 new_up);
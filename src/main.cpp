@@ -15,6 +15,8 @@ int main(int argc, char *argv[]) {
     QSurfaceFormat fmt;
     fmt.setVersion(4, 1);
     fmt.setProfile(QSurfaceFormat::CoreProfile);
+    // Realtime draws frames back to back, so swapping on vsync is what paces it (0 would draw as fast as it can)
+    fmt.setSwapInterval(1);
     QSurfaceFormat::setDefaultFormat(fmt);
 
     MainWindow w;
@@ -312,7 +312,7 @@ void MainWindow::onSaveImage() {
                                                         .append(QDir::separator())
                                                         .append(sceneName), tr("Image Files (*.png)"));
     std::cout << "Saving image to: \"" << filePath.toStdString() << "\"." << std::endl;
-    realtime->saveViewportImage(filePath.toStdString());
+    realtime->save_image(filePath.toStdString());
 }
 
 void MainWindow::onValChangeP1(int newValue) {
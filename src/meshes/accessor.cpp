@@ -0,0 +1,274 @@
+#include "accessor.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define ACCESSOR_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define ACCESSOR_NEON
+#endif
+
+namespace
+{
+// Widens a tightly packed run of 16-bit indices to 32 bits, 8 at a time when SIMD is available
+void widenU16(const unsigned char* src, GLuint* out, size_t count)
+{
+    size_t i = 0;
+#if defined(ACCESSOR_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128i packed = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 2));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_unpacklo_epi16(packed, zero));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i + 4), _mm_unpackhi_epi16(packed, zero));
+    }
+#elif defined(ACCESSOR_NEON)
+    for (; i + 8 <= count; i += 8)
+    {
+        uint16x8_t packed = vld1q_u16(reinterpret_cast<const uint16_t*>(src + i * 2));
+        vst1q_u32(out + i, vmovl_u16(vget_low_u16(packed)));
+        vst1q_u32(out + i + 4, vmovl_u16(vget_high_u16(packed)));
+    }
+#endif
+    for (; i < count; i++)
+    {
+        uint16_t value;
+        std::memcpy(&value, src + i * 2, sizeof(uint16_t));
+        out[i] = value;
+    }
+}
+
+// Widens a tightly packed run of 8-bit indices to 32 bits, 16 at a time when SIMD is available
+void widenU8(const unsigned char* src, GLuint* out, size_t count)
+{
+    size_t i = 0;
+#if defined(ACCESSOR_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= count; i += 16)
+    {
+        __m128i packed = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        __m128i low = _mm_unpacklo_epi8(packed, zero);
+        __m128i high = _mm_unpackhi_epi8(packed, zero);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_unpacklo_epi16(low, zero));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i + 4), _mm_unpackhi_epi16(low, zero));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i + 8), _mm_unpacklo_epi16(high, zero));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i + 12), _mm_unpackhi_epi16(high, zero));
+    }
+#elif defined(ACCESSOR_NEON)
+    for (; i + 16 <= count; i += 16)
+    {
+        uint8x16_t packed = vld1q_u8(src + i);
+        uint16x8_t low = vmovl_u8(vget_low_u8(packed));
+        uint16x8_t high = vmovl_u8(vget_high_u8(packed));
+        vst1q_u32(out + i, vmovl_u16(vget_low_u16(low)));
+        vst1q_u32(out + i + 4, vmovl_u16(vget_high_u16(low)));
+        vst1q_u32(out + i + 8, vmovl_u16(vget_low_u16(high)));
+        vst1q_u32(out + i + 12, vmovl_u16(vget_high_u16(high)));
+    }
+#endif
+    for (; i < count; i++)
+    {
+        out[i] = src[i];
+    }
+}
+
+// Converts a single (possibly normalized) integer component to float using the glTF conversion rules
+template<typename T>
+float toFloat(const unsigned char* src, bool normalized)
+{
+    T value;
+    std::memcpy(&value, src, sizeof(T));
+    if (!normalized)
+    {
+        return static_cast<float>(value);
+    }
+    if constexpr (std::is_signed_v<T>)
+    {
+        return std::max(static_cast<float>(value) / static_cast<float>(std::numeric_limits<T>::max()), -1.0f);
+    }
+    return static_cast<float>(value) / static_cast<float>(std::numeric_limits<T>::max());
+}
+
+// Strided decode for integer component types (one pass, no intermediate buffers)
+template<typename T>
+void readIntegers(const AccessorView& view, unsigned char* out, size_t outStride, unsigned int copied, unsigned int outComponents)
+{
+    for (size_t i = 0; i < view.count; i++)
+    {
+        const unsigned char* src = view.data + i * view.stride;
+        float* dst = reinterpret_cast<float*>(out + i * outStride);
+        for (unsigned int c = 0; c < copied; c++)
+        {
+            dst[c] = toFloat<T>(src + c * sizeof(T), view.normalized);
+        }
+        for (unsigned int c = copied; c < outComponents; c++)
+        {
+            dst[c] = 0.0f;
+        }
+    }
+}
+
+// Strided float copy with the element size known at compile time, so each memcpy turns into a couple of moves
+template<size_t Bytes>
+void copyStrided(const AccessorView& view, unsigned char* out, size_t outStride)
+{
+    for (size_t i = 0; i < view.count; i++)
+    {
+        std::memcpy(out + i * outStride, view.data + i * view.stride, Bytes);
+    }
+}
+}
+
+namespace Accessor
+{
+// Size in bytes of a single component of the given type
+unsigned int componentSize(GLenum componentType)
+{
+    switch (componentType)
+    {
+    case GL_BYTE:
+    case GL_UNSIGNED_BYTE:
+        return 1;
+    case GL_SHORT:
+    case GL_UNSIGNED_SHORT:
+        return 2;
+    case GL_UNSIGNED_INT:
+    case GL_FLOAT:
+        return 4;
+    default:
+        throw std::invalid_argument("Component type is invalid (not a glTF accessor component type)");
+    }
+}
+
+// Number of components for a glTF accessor type string
+unsigned int componentCount(const std::string& type)
+{
+    if (type == "SCALAR") return 1;
+    else if (type == "VEC2") return 2;
+    else if (type == "VEC3") return 3;
+    else if (type == "VEC4") return 4;
+    else if (type == "MAT2") return 4;
+    else if (type == "MAT3") return 9;
+    else if (type == "MAT4") return 16;
+    else throw std::invalid_argument("Type is invalid (not SCALAR, VEC2, VEC3, VEC4, MAT2, MAT3, or MAT4)");
+}
+
+// Decodes an index accessor into 32-bit indices
+void readIndices(const AccessorView& view, GLuint* out)
+{
+    // An accessor without a bufferView is all zeros
+    if (view.data == nullptr)
+    {
+        std::fill(out, out + view.count, 0u);
+        return;
+    }
+
+    unsigned int size = componentSize(view.componentType);
+    bool tight = view.stride == size;
+
+    switch (view.componentType)
+    {
+    case GL_UNSIGNED_INT:
+        // Already the format we want, so it's one copy
+        if (tight)
+        {
+            std::memcpy(out, view.data, view.count * sizeof(GLuint));
+            return;
+        }
+        for (size_t i = 0; i < view.count; i++)
+        {
+            std::memcpy(&out[i], view.data + i * view.stride, sizeof(GLuint));
+        }
+        return;
+    // Signed shorts aren't legal index types, but the old loader accepted them so we keep reading them as unsigned
+    case GL_SHORT:
+    case GL_UNSIGNED_SHORT:
+        if (tight)
+        {
+            widenU16(view.data, out, view.count);
+            return;
+        }
+        for (size_t i = 0; i < view.count; i++)
+        {
+            uint16_t value;
+            std::memcpy(&value, view.data + i * view.stride, sizeof(uint16_t));
+            out[i] = value;
+        }
+        return;
+    case GL_UNSIGNED_BYTE:
+        if (tight)
+        {
+            widenU8(view.data, out, view.count);
+            return;
+        }
+        for (size_t i = 0; i < view.count; i++)
+        {
+            out[i] = view.data[i * view.stride];
+        }
+        return;
+    default:
+        throw std::invalid_argument("Index component type is invalid (not unsigned byte, short, or int)");
+    }
+}
+
+// Decodes a float or integer accessor into outComponents floats per element
+void readFloats(const AccessorView& view, float* out, size_t outStride, unsigned int outComponents)
+{
+    unsigned char* dst = reinterpret_cast<unsigned char*>(out);
+    unsigned int copied = std::min(view.numComponents, outComponents);
+
+    // An accessor without a bufferView is all zeros
+    if (view.data == nullptr)
+    {
+        for (size_t i = 0; i < view.count; i++)
+        {
+            std::memset(dst + i * outStride, 0, outComponents * sizeof(float));
+        }
+        return;
+    }
+
+    switch (view.componentType)
+    {
+    case GL_FLOAT:
+        // Both sides tightly packed with the same layout: a single copy for the whole accessor
+        if (copied == outComponents && view.stride == copied * sizeof(float) && outStride == view.stride)
+        {
+            std::memcpy(dst, view.data, view.count * view.stride);
+            return;
+        }
+        // Otherwise it's a strided gather (e.g. into the interleaved Vertex array)
+        if (copied == outComponents)
+        {
+            switch (copied)
+            {
+            case 1: copyStrided<4>(view, dst, outStride); return;
+            case 2: copyStrided<8>(view, dst, outStride); return;
+            case 3: copyStrided<12>(view, dst, outStride); return;
+            case 4: copyStrided<16>(view, dst, outStride); return;
+            default: break;
+            }
+        }
+        for (size_t i = 0; i < view.count; i++)
+        {
+            float* element = reinterpret_cast<float*>(dst + i * outStride);
+            std::memcpy(element, view.data + i * view.stride, copied * sizeof(float));
+            std::fill(element + copied, element + outComponents, 0.0f);
+        }
+        return;
+    case GL_BYTE: readIntegers<int8_t>(view, dst, outStride, copied, outComponents); return;
+    case GL_UNSIGNED_BYTE: readIntegers<uint8_t>(view, dst, outStride, copied, outComponents); return;
+    case GL_SHORT: readIntegers<int16_t>(view, dst, outStride, copied, outComponents); return;
+    case GL_UNSIGNED_SHORT: readIntegers<uint16_t>(view, dst, outStride, copied, outComponents); return;
+    case GL_UNSIGNED_INT: readIntegers<uint32_t>(view, dst, outStride, copied, outComponents); return;
+    default:
+        throw std::invalid_argument("Component type is invalid (not a glTF accessor component type)");
+    }
+}
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "utils/debug.h"
+#include <cstddef>
+#include <string>
+
+// Describes where the elements of a glTF accessor live in memory and how they're encoded
+// Built once per accessor from the JSON, after which decoding never touches the JSON again
+struct AccessorView
+{
+    // First byte of the first element (nullptr if the accessor has no bufferView, which means "all zeros")
+    const unsigned char* data = nullptr;
+    // Number of elements and the number of bytes between the starts of consecutive elements
+    size_t count = 0;
+    size_t stride = 0;
+    // GL_FLOAT, GL_UNSIGNED_SHORT, etc. (glTF uses the GL enum values) and 1 for SCALAR up to 16 for MAT4
+    GLenum componentType = GL_FLOAT;
+    unsigned int numComponents = 1;
+    // Whether integer components map to [0, 1] / [-1, 1]
+    bool normalized = false;
+};
+
+namespace Accessor
+{
+// Size in bytes of a single component of the given type
+unsigned int componentSize(GLenum componentType);
+// Number of components for a glTF accessor type string ("SCALAR", "VEC3", ...)
+unsigned int componentCount(const std::string& type);
+
+// Decodes an index accessor (unsigned byte, short or int) into 32-bit indices, writing view.count values to out
+void readIndices(const AccessorView& view, GLuint* out);
+
+// Decodes a float or (normalized) integer accessor into outComponents floats per element
+// Element i is written to the bytes starting at out + i * outStride, so this can fill one field of an interleaved struct
+// Components the accessor doesn't have are set to 0
+void readFloats(const AccessorView& view, float* out, size_t outStride, unsigned int outComponents);
+}
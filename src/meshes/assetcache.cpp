@@ -0,0 +1,112 @@
+#include "assetcache.h"
+
+#include "utils/gldeletequeue.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <numeric>
+
+bool ModelAsset::quantizePositions = false;
+
+std::mutex AssetCache::s_mutex;
+std::unordered_map<std::string, std::weak_ptr<ModelAsset>> AssetCache::s_models;
+
+// Queues the textures and the batch to be deleted on the GL thread, since the last reference to an asset can be
+// dropped on any thread (the geometry goes by itself when the last Mesh using it is cleaned up)
+ModelAsset::~ModelAsset() {
+    GLDeleteQueue::defer([textures = std::move(loadedTex), batch = std::move(batch)]() mutable {
+        for (unsigned int i = 0; i < textures.size(); i++) {
+            textures[i].Delete();
+        }
+        batch.Delete();
+    });
+}
+
+// Uploads one texture of decoded data (its kind decides the texture unit)
+void ModelAsset::uploadTexture(const TextureData& texture) {
+    GLuint slot = std::strcmp(texture.type, "specular") == 0 ? Material::specularUnit : Material::diffuseUnit;
+    addTexture(texture.path.empty()
+        ? Texture(texture.encoded, texture.type, slot)
+        : Texture(texture.path.c_str(), texture.type, slot), texture);
+}
+
+// Keeps a texture made elsewhere, applying the file's sampler settings to it
+void ModelAsset::addTexture(Texture texture, const TextureData& data) {
+    texture.setSampler(data.minFilter, data.magFilter, data.wrapS, data.wrapT);
+    loadedTex.push_back(texture);
+}
+
+// Makes a material out of textures that are already uploaded
+void ModelAsset::uploadMaterial(const MaterialData& material) {
+    if (material.diffuse < 0 && whiteTex < 0) {
+        whiteTex = loadedTex.size();
+        loadedTex.push_back(Texture("diffuse", Material::diffuseUnit));
+    }
+    const Texture& diffuse = loadedTex[material.diffuse >= 0 ? material.diffuse : whiteTex];
+    const Texture& specular = material.specular >= 0 ? loadedTex[material.specular] : diffuse;
+    materials.push_back(Material(diffuse, specular, material.baseColor, material.doubleSided));
+}
+
+// Uploads one mesh of decoded data straight from the decoded (or mapped) arrays
+void ModelAsset::uploadMesh(const ModelData& data, const MeshData& mesh) {
+    std::shared_ptr<MeshGeometry> meshGeometry = std::make_shared<MeshGeometry>
+        (
+            data.vertices.subspan(mesh.firstVertex, mesh.vertexCount),
+            data.indices.subspan(mesh.firstIndex, mesh.indexCount),
+            quantizePositions ? VertexFormat::quantized() : VertexFormat::compact(),
+            mesh.lods
+            );
+    meshGeometry->center = mesh.center;
+    meshGeometry->extent = mesh.extent;
+    meshGeometry->radius = mesh.radius;
+    geometry.push_back(meshGeometry);
+    meshMaterials.push_back(mesh.material);
+    translationsMeshes.push_back(mesh.translation);
+    rotationsMeshes.push_back(mesh.rotation);
+    scalesMeshes.push_back(mesh.scale);
+    matricesMeshes.push_back(mesh.matrix);
+}
+
+// Works out the draw order, packs the meshes into the batch and marks the asset ready
+void ModelAsset::finish() {
+    // Meshes with the same material end up next to each other (keeping file order within a material)
+    drawOrder.resize(geometry.size());
+    std::iota(drawOrder.begin(), drawOrder.end(), 0u);
+    std::stable_sort(drawOrder.begin(), drawOrder.end(), [&](unsigned int a, unsigned int b) {
+        return meshMaterials[a] < meshMaterials[b];
+    });
+    batch.build(*this);
+    ready = true;
+}
+
+// Returns the asset loaded from the file, or nullptr if no live Model is using it
+std::shared_ptr<ModelAsset> AssetCache::findModel(const std::string& key) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    auto it = s_models.find(key);
+    if (it == s_models.end()) {
+        return nullptr;
+    }
+
+    std::shared_ptr<ModelAsset> asset = it->second.lock();
+    if (asset == nullptr) {
+        // Everyone using it has been cleaned up, so drop the stale entry
+        s_models.erase(it);
+    }
+    return asset;
+}
+
+// Registers a freshly loaded asset so later loads of the same file share it
+void AssetCache::storeModel(const std::string& key, const std::shared_ptr<ModelAsset>& asset) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    s_models[key] = asset;
+}
+
+// Canonical form of a path, so different spellings of the same file share an entry
+std::string AssetCache::canonicalPath(const std::string& path) {
+    std::error_code error;
+    std::filesystem::path canonical = std::filesystem::weakly_canonical(path, error);
+    if (error) {
+        return path;
+    }
+    return canonical.string();
+}
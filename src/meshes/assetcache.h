@@ -0,0 +1,82 @@
+#pragma once
+
+#include"Mesh.h"
+#include"meshes/material.h"
+#include"meshes/modelbatch.h"
+#include"meshes/modeldata.h"
+#include<memory>
+#include<mutex>
+#include<string>
+#include<unordered_map>
+#include<vector>
+
+// Everything a Model loads from one file, shared by every Model that loads the same file
+// Each Model still builds its own Meshes (VAO + instance buffer) on top of the shared geometry
+struct ModelAsset
+{
+    // One entry per primitive, in the order the nodes were traversed
+    std::vector<std::shared_ptr<MeshGeometry>> geometry;
+    std::vector<unsigned int> meshMaterials;
+    std::vector<glm::vec3> translationsMeshes;
+    std::vector<glm::quat> rotationsMeshes;
+    std::vector<glm::vec3> scalesMeshes;
+    std::vector<glm::mat4> matricesMeshes;
+
+    // Every texture loaded from the file, and the materials made from them
+    std::vector<Texture> loadedTex;
+    std::vector<Material> materials;
+
+    // Mesh indices sorted by material, so drawing binds each material once
+    std::vector<unsigned int> drawOrder;
+    // Every mesh in shared buffers, so models can draw each material's meshes in one call (see Model::setBatchShader)
+    ModelBatch batch;
+
+    // Meshes are uploaded in the compact vertex format, or the quantized one if this is set before loading
+    // (quantized positions are 16 bits across each mesh's bounds, so very large meshes can show the steps)
+    static bool quantizePositions;
+
+    // False until every texture and mesh is on the GPU (models loading in the background don't draw until then)
+    bool ready = false;
+    // Set if the file couldn't be loaded, so the next request tries again
+    bool failed = false;
+
+    // Uploads one texture, material or mesh of decoded data (GL thread only)
+    // Textures go first, then the materials that use them, then the meshes that use those
+    void uploadTexture(const TextureData& texture);
+    void uploadMaterial(const MaterialData& material);
+    void uploadMesh(const ModelData& data, const MeshData& mesh);
+    // Keeps a texture made elsewhere (e.g. still streaming in), applying the file's sampler settings to it
+    void addTexture(Texture texture, const TextureData& data);
+    // Works out the draw order, packs the meshes into the batch and marks the asset ready
+    void finish();
+
+    ModelAsset() = default;
+    // Queues the textures and the batch for deletion on the GL thread (see GLDeleteQueue), since the last Model
+    // using the asset can let go of it on any thread (the geometry goes by itself when the last Mesh using it does)
+    ~ModelAsset();
+
+    ModelAsset(const ModelAsset&) = delete;
+    ModelAsset& operator=(const ModelAsset&) = delete;
+
+private:
+    // Index in loadedTex of the white texture materials without a diffuse texture use (-1 until one needs it)
+    int whiteTex = -1;
+};
+
+// Process-wide cache of loaded model files, keyed by canonical path
+// The cache only holds weak references, so an asset is freed as soon as the last Model using it is cleaned up
+class AssetCache
+{
+public:
+    // Returns the asset loaded from the file, or nullptr if no live Model is using it
+    static std::shared_ptr<ModelAsset> findModel(const std::string& key);
+    // Registers a freshly loaded asset so later loads of the same file share it
+    static void storeModel(const std::string& key, const std::shared_ptr<ModelAsset>& asset);
+
+    // Canonical form of a path, so different spellings of the same file share an entry
+    static std::string canonicalPath(const std::string& path);
+
+private:
+    static std::mutex s_mutex;
+    static std::unordered_map<std::string, std::weak_ptr<ModelAsset>> s_models;
+};
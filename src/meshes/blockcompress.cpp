@@ -0,0 +1,223 @@
+#include "blockcompress.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+
+namespace
+{
+// Gathers a 4x4 block starting at (bx, by), repeating the edge pixels when the block hangs off the image
+void fetchBlock(const unsigned char* pixels, int width, int height, int channels, int bx, int by, unsigned char block[16][4])
+{
+    for (int y = 0; y < 4; y++)
+    {
+        int sy = std::min(by + y, height - 1);
+        for (int x = 0; x < 4; x++)
+        {
+            int sx = std::min(bx + x, width - 1);
+            const unsigned char* src = pixels + (size_t(sy) * width + sx) * channels;
+            unsigned char* dst = block[y * 4 + x];
+            dst[0] = src[0];
+            dst[1] = channels > 1 ? src[1] : src[0];
+            dst[2] = channels > 2 ? src[2] : src[0];
+            dst[3] = channels > 3 ? src[3] : 255;
+        }
+    }
+}
+
+uint16_t toRGB565(const int color[3])
+{
+    return uint16_t(((color[0] >> 3) << 11) | ((color[1] >> 2) << 5) | (color[2] >> 3));
+}
+
+// Expands a 565 color back to 8 bits per channel (the way the decoder will)
+void fromRGB565(uint16_t packed, int color[3])
+{
+    int r = (packed >> 11) & 31;
+    int g = (packed >> 5) & 63;
+    int b = packed & 31;
+    color[0] = (r << 3) | (r >> 2);
+    color[1] = (g << 2) | (g >> 4);
+    color[2] = (b << 3) | (b >> 2);
+}
+
+// Writes the 8 byte color half of a BC1/BC3 block
+void encodeColorBlock(const unsigned char block[16][4], unsigned char* out)
+{
+    // Bounding box of the block, pulled in a little so the endpoints aren't dominated by outliers
+    int minColor[3] = {255, 255, 255};
+    int maxColor[3] = {0, 0, 0};
+    for (int i = 0; i < 16; i++)
+    {
+        for (int c = 0; c < 3; c++)
+        {
+            minColor[c] = std::min(minColor[c], int(block[i][c]));
+            maxColor[c] = std::max(maxColor[c], int(block[i][c]));
+        }
+    }
+    for (int c = 0; c < 3; c++)
+    {
+        int inset = (maxColor[c] - minColor[c]) >> 4;
+        minColor[c] = std::min(minColor[c] + inset, 255);
+        maxColor[c] = std::max(maxColor[c] - inset, 0);
+    }
+
+    // Four color mode needs the first endpoint to be the larger one
+    uint16_t color0 = toRGB565(maxColor);
+    uint16_t color1 = toRGB565(minColor);
+    if (color0 < color1)
+    {
+        std::swap(color0, color1);
+    }
+
+    uint32_t indices = 0;
+    if (color0 != color1)
+    {
+        int palette[4][3];
+        fromRGB565(color0, palette[0]);
+        fromRGB565(color1, palette[1]);
+        for (int c = 0; c < 3; c++)
+        {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+
+        for (int i = 0; i < 16; i++)
+        {
+            int best = 0;
+            int bestDistance = INT32_MAX;
+            for (int p = 0; p < 4; p++)
+            {
+                int distance = 0;
+                for (int c = 0; c < 3; c++)
+                {
+                    int d = int(block[i][c]) - palette[p][c];
+                    distance += d * d;
+                }
+                if (distance < bestDistance)
+                {
+                    bestDistance = distance;
+                    best = p;
+                }
+            }
+            indices |= uint32_t(best) << (2 * i);
+        }
+    }
+
+    out[0] = color0 & 0xFF;
+    out[1] = color0 >> 8;
+    out[2] = color1 & 0xFF;
+    out[3] = color1 >> 8;
+    for (int b = 0; b < 4; b++)
+    {
+        out[4 + b] = uint8_t(indices >> (8 * b));
+    }
+}
+
+// Writes an 8 byte single channel block (the alpha half of BC3, and each half of BC4/BC5)
+void encodeChannelBlock(const unsigned char block[16][4], int channel, unsigned char* out)
+{
+    int minValue = 255;
+    int maxValue = 0;
+    for (int i = 0; i < 16; i++)
+    {
+        minValue = std::min(minValue, int(block[i][channel]));
+        maxValue = std::max(maxValue, int(block[i][channel]));
+    }
+
+    // Eight value mode (first endpoint larger): the endpoints plus six evenly spaced values in between
+    uint64_t indices = 0;
+    if (maxValue != minValue)
+    {
+        int palette[8];
+        palette[0] = maxValue;
+        palette[1] = minValue;
+        for (int p = 1; p < 7; p++)
+        {
+            palette[p + 1] = ((7 - p) * maxValue + p * minValue) / 7;
+        }
+
+        for (int i = 0; i < 16; i++)
+        {
+            int best = 0;
+            int bestDistance = INT32_MAX;
+            for (int p = 0; p < 8; p++)
+            {
+                int distance = std::abs(int(block[i][channel]) - palette[p]);
+                if (distance < bestDistance)
+                {
+                    bestDistance = distance;
+                    best = p;
+                }
+            }
+            indices |= uint64_t(best) << (3 * i);
+        }
+    }
+
+    out[0] = uint8_t(maxValue);
+    out[1] = uint8_t(minValue);
+    for (int b = 0; b < 6; b++)
+    {
+        out[2 + b] = uint8_t(indices >> (8 * b));
+    }
+}
+
+// Runs encodeBlock over every 4x4 block of the image
+template<typename EncodeBlock>
+void encodeImage(const unsigned char* pixels, int width, int height, int channels, int blockBytes, unsigned char* out, EncodeBlock encodeBlock)
+{
+    unsigned char block[16][4];
+    for (int by = 0; by < height; by += 4)
+    {
+        for (int bx = 0; bx < width; bx += 4)
+        {
+            fetchBlock(pixels, width, height, channels, bx, by, block);
+            encodeBlock(block, out);
+            out += blockBytes;
+        }
+    }
+}
+}
+
+namespace BlockCompress
+{
+// Bytes of output for an image of the given size
+size_t encodedSize(int width, int height, int blockBytes)
+{
+    return size_t(std::max(1, (width + 3) / 4)) * std::max(1, (height + 3) / 4) * blockBytes;
+}
+
+// RGB(A) -> BC1
+void encodeBC1(const unsigned char* pixels, int width, int height, int channels, unsigned char* out)
+{
+    encodeImage(pixels, width, height, channels, 8, out, [](const unsigned char block[16][4], unsigned char* dst) {
+        encodeColorBlock(block, dst);
+    });
+}
+
+// RGBA -> BC3
+void encodeBC3(const unsigned char* pixels, int width, int height, unsigned char* out)
+{
+    encodeImage(pixels, width, height, 4, 16, out, [](const unsigned char block[16][4], unsigned char* dst) {
+        encodeChannelBlock(block, 3, dst);
+        encodeColorBlock(block, dst + 8);
+    });
+}
+
+// One channel -> BC4
+void encodeBC4(const unsigned char* pixels, int width, int height, unsigned char* out)
+{
+    encodeImage(pixels, width, height, 1, 8, out, [](const unsigned char block[16][4], unsigned char* dst) {
+        encodeChannelBlock(block, 0, dst);
+    });
+}
+
+// Two channels -> BC5
+void encodeBC5(const unsigned char* pixels, int width, int height, unsigned char* out)
+{
+    encodeImage(pixels, width, height, 2, 16, out, [](const unsigned char block[16][4], unsigned char* dst) {
+        encodeChannelBlock(block, 0, dst);
+        encodeChannelBlock(block, 1, dst + 8);
+    });
+}
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstddef>
+
+// CPU encoders for the S3TC/RGTC block formats (BC1, BC3, BC4 and BC5)
+// Each call encodes a whole image of the given size, 4x4 pixels per block, rows top to bottom
+// Images that aren't a multiple of 4 are padded by repeating the last row/column
+// Speed over quality: endpoints come from the (inset) bounding box of each block rather than a search
+namespace BlockCompress
+{
+// Bytes of output for an image of the given size (blockBytes is 8 for BC1/BC4 and 16 for BC3/BC5)
+size_t encodedSize(int width, int height, int blockBytes);
+
+// RGB(A) -> BC1 (GL_COMPRESSED_RGB_S3TC_DXT1_EXT). Alpha is ignored
+void encodeBC1(const unsigned char* pixels, int width, int height, int channels, unsigned char* out);
+// RGBA -> BC3 (GL_COMPRESSED_RGBA_S3TC_DXT5_EXT)
+void encodeBC3(const unsigned char* pixels, int width, int height, unsigned char* out);
+// One channel -> BC4 (GL_COMPRESSED_RED_RGTC1)
+void encodeBC4(const unsigned char* pixels, int width, int height, unsigned char* out);
+// Two channels -> BC5 (GL_COMPRESSED_RG_RGTC2)
+void encodeBC5(const unsigned char* pixels, int width, int height, unsigned char* out);
+}
@@ -0,0 +1,408 @@
+#include "instanceculler.h"
+
+#include "meshes/lod.h"
+#include "meshes/mesh.h"
+#include "utils/culling.h"
+#include <glm/gtc/type_ptr.hpp>
+#include <string>
+
+namespace
+{
+// Invocations per work group (local_size_x in instancecull.comp)
+const GLsizei groupSize = 64;
+
+// Shared by every culler, and compiled the first time one culls
+Shader computeShader;
+// Indexed by level count - 1, since the geometry shader has one output stream per level
+Shader feedbackShaders[MeshData::maxLods];
+}
+
+// Compute shaders (and the base instances the draws then rely on) came with GL 4.3, and the context only asks for 4.1
+bool InstanceCuller::onGpu()
+{
+    return GLEW_VERSION_4_3;
+}
+
+// Shader storage ranges have their own alignment; attributes only need whole floats
+size_t InstanceCuller::sourceAlignment()
+{
+    if (!onGpu())
+    {
+        return sizeof(GLfloat);
+    }
+    GLint alignment = 0;
+    glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    Debug::glErrorCheck();
+    return alignment;
+}
+
+// Sets up the buffers for the compacted instances and the draw commands, and whatever the culling path needs
+void InstanceCuller::create(const MeshGeometry& geometry, GLuint instanceVBO, GLsizei instances)
+{
+    instance_VBO = instanceVBO;
+    instanceOffset = 0;
+
+    // Every level draws its own part of the index buffer (the instance counts are filled in when culling)
+    commands.clear();
+    for (const MeshLod& level : geometry.lods)
+    {
+        commands.push_back(DrawElementsIndirectCommand{GLuint(level.indexCount), 0, GLuint(level.firstIndex), 0, 0});
+    }
+    visibleCounts.assign(commands.size(), 0);
+
+    glGenBuffers(1, &visible_VBO);
+    Debug::glErrorCheck();
+    glGenBuffers(1, &commands_buffer);
+    Debug::glErrorCheck();
+
+    if (!onGpu())
+    {
+        glGenVertexArrays(1, &cull_VAO);
+        Debug::glErrorCheck();
+        linkSource();
+
+        glGenTransformFeedbacks(1, &feedback);
+        Debug::glErrorCheck();
+        for (GLuint* slot : queries)
+        {
+            glGenQueries(commands.size(), slot);
+            Debug::glErrorCheck();
+        }
+    }
+
+    resize(instances);
+}
+
+// Switches to where the latest matrices are
+void InstanceCuller::setSource(GLuint instanceVBO, GLintptr offset)
+{
+    instance_VBO = instanceVBO;
+    instanceOffset = offset;
+    if (cull_VAO != 0)
+    {
+        linkSource();
+    }
+}
+
+// The cull pass reads each instance matrix as the attributes (0 to 3) of one point
+void InstanceCuller::linkSource()
+{
+    glBindVertexArray(cull_VAO);
+    Debug::glErrorCheck();
+    glBindBuffer(GL_ARRAY_BUFFER, instance_VBO);
+    Debug::glErrorCheck();
+    for (GLuint column = 0; column < 4; column++)
+    {
+        glEnableVertexAttribArray(column);
+        Debug::glErrorCheck();
+        size_t offset = instanceOffset + column * sizeof(glm::vec4);
+        glVertexAttribPointer(column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), reinterpret_cast<const void*>(offset));
+        Debug::glErrorCheck();
+    }
+    glBindVertexArray(0);
+    Debug::glErrorCheck();
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    Debug::glErrorCheck();
+}
+
+// Reallocates the compacted instances (room for every instance at every level) and resets the commands
+void InstanceCuller::resize(GLsizei instances)
+{
+    capacity = instances;
+
+    // Base instances can only be used from GL 4.2 on (before that the field has to be 0)
+    for (unsigned int l = 0; l < commands.size(); l++)
+    {
+        commands[l].baseInstance = onGpu() ? l * capacity : 0;
+    }
+    visibleCounts.assign(commands.size(), 0);
+
+    // Passes captured into the old buffer are gone with it
+    for (bool& slot : pending)
+    {
+        slot = false;
+    }
+    drawn = -1;
+
+    GLsizeiptr slotCount = feedback != 0 ? feedbackSlots : 1;
+    glBindBuffer(GL_ARRAY_BUFFER, visible_VBO);
+    Debug::glErrorCheck();
+    glBufferData(GL_ARRAY_BUFFER, slotCount * commands.size() * capacity * sizeof(glm::mat4), nullptr, GL_DYNAMIC_COPY);
+    Debug::glErrorCheck();
+    glBindBuffer(GL_ARRAY_BUFFER, commands_buffer);
+    Debug::glErrorCheck();
+    glBufferData(GL_ARRAY_BUFFER, commands.size() * sizeof(DrawElementsIndirectCommand), commands.data(), GL_DYNAMIC_DRAW);
+    Debug::glErrorCheck();
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    Debug::glErrorCheck();
+}
+
+// Level l's run starts at matrix l * capacity, after the runs of the slots before the one being drawn
+GLsizei InstanceCuller::firstVisible(unsigned int level) const
+{
+    GLsizei slot = drawn > 0 ? drawn : 0;
+    return (slot * GLsizei(commands.size()) + level) * capacity;
+}
+
+// Culls the instances against Culling::frustum and picks their levels from Lod::view
+void InstanceCuller::cull(const MeshGeometry& geometry)
+{
+    if (capacity == 0)
+    {
+        return;
+    }
+    if (onGpu())
+    {
+        cullCompute(geometry);
+    }
+    else
+    {
+        cullFeedback(geometry);
+    }
+}
+
+// One invocation per instance, each appending its matrix to its level's run and counting it in that level's command
+void InstanceCuller::cullCompute(const MeshGeometry& geometry)
+{
+    if (computeShader.ID == 0)
+    {
+        computeShader.loadCompute(":/resources/shaders/instancecull.comp");
+    }
+    computeShader.Activate();
+    setUniforms(computeShader, geometry);
+    computeShader.setInt("instance_count", capacity);
+    computeShader.setInt("capacity", capacity);
+    computeShader.setInt("lod_count", commands.size());
+
+    // Every level starts the frame with no instances
+    glBindBuffer(GL_ARRAY_BUFFER, commands_buffer);
+    Debug::glErrorCheck();
+    glBufferSubData(GL_ARRAY_BUFFER, 0, commands.size() * sizeof(DrawElementsIndirectCommand), commands.data());
+    Debug::glErrorCheck();
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    Debug::glErrorCheck();
+
+    glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 0, instance_VBO, instanceOffset, capacity * sizeof(glm::mat4));
+    Debug::glErrorCheck();
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, visible_VBO);
+    Debug::glErrorCheck();
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, commands_buffer);
+    Debug::glErrorCheck();
+    glDispatchCompute((capacity + groupSize - 1) / groupSize, 1, 1);
+    Debug::glErrorCheck();
+    // The draws read what was written as commands and as instance attributes
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+    Debug::glErrorCheck();
+
+    computeShader.Deactivate();
+}
+
+// Every instance goes through the geometry shader as a point, which emits the visible ones on their level's stream
+// Nothing is rasterized: the streams are only captured into the compacted instances
+void InstanceCuller::cullFeedback(const MeshGeometry& geometry)
+{
+    // Captures into the next slot that isn't being drawn (one whose counts never came back is simply overwritten)
+    capturing = (capturing + 1) % feedbackSlots;
+    if (int(capturing) == drawn)
+    {
+        capturing = (capturing + 1) % feedbackSlots;
+    }
+
+    Shader& shader = feedbackProgram(commands.size());
+    shader.Activate();
+    setUniforms(shader, geometry);
+
+    glEnable(GL_RASTERIZER_DISCARD);
+    Debug::glErrorCheck();
+    glBindVertexArray(cull_VAO);
+    Debug::glErrorCheck();
+    glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, feedback);
+    Debug::glErrorCheck();
+    // Each level's stream is captured into its own run of the slot's compacted instances
+    GLsizeiptr size = capacity * sizeof(glm::mat4);
+    for (unsigned int l = 0; l < commands.size(); l++)
+    {
+        glBindBufferRange(GL_TRANSFORM_FEEDBACK_BUFFER, l, visible_VBO, (capturing * commands.size() + l) * size, size);
+        Debug::glErrorCheck();
+        glBeginQueryIndexed(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN, l, queries[capturing][l]);
+        Debug::glErrorCheck();
+    }
+    glBeginTransformFeedback(GL_POINTS);
+    Debug::glErrorCheck();
+    glDrawArrays(GL_POINTS, 0, capacity);
+    Debug::glErrorCheck();
+    glEndTransformFeedback();
+    Debug::glErrorCheck();
+    for (unsigned int l = 0; l < commands.size(); l++)
+    {
+        glEndQueryIndexed(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN, l);
+        Debug::glErrorCheck();
+    }
+    glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, 0);
+    Debug::glErrorCheck();
+    glBindVertexArray(0);
+    Debug::glErrorCheck();
+    glDisable(GL_RASTERIZER_DISCARD);
+    Debug::glErrorCheck();
+    shader.Deactivate();
+
+    pending[capturing] = true;
+    captured[capturing] = ++passes;
+    collectFeedback();
+
+    // The counts are on the CPU anyway, so they go into the culling stats (the compute path never reads them back)
+    GLuint kept = 0;
+    for (GLuint count : visibleCounts)
+    {
+        kept += count;
+    }
+    Culling::stats.tested += capacity;
+    Culling::stats.culled += capacity - kept;
+}
+
+// GL 4.1 can't write query results into a buffer, so the counts come back through the CPU
+// Asking for them before the GPU is done would stall until it catches up, so only finished passes are read, and the
+// draws keep using the last one until a newer pass finishes (instances crossing the frustum edge show up a frame or
+// two late)
+// Drawing the streams with glDrawTransformFeedbackStreamInstanced would skip the CPU, but that takes the count as
+// vertices of the captured points, not as instances of the mesh's indexed triangles
+void InstanceCuller::collectFeedback()
+{
+    int newest = -1;
+    for (unsigned int s = 0; s < feedbackSlots; s++)
+    {
+        if (!pending[s] || (newest >= 0 && captured[s] < captured[newest]))
+        {
+            continue;
+        }
+        bool available = true;
+        for (unsigned int l = 0; l < commands.size() && available; l++)
+        {
+            GLuint done = GL_FALSE;
+            glGetQueryObjectuiv(queries[s][l], GL_QUERY_RESULT_AVAILABLE, &done);
+            Debug::glErrorCheck();
+            available = done == GL_TRUE;
+        }
+        if (available)
+        {
+            newest = s;
+        }
+    }
+    // Nothing to draw at all yet (the first frame, or the first after a resize) is the one time it's worth waiting
+    if (newest < 0 && drawn < 0)
+    {
+        newest = capturing;
+    }
+    if (newest < 0)
+    {
+        return;
+    }
+
+    // Older passes won't be drawn anymore, so their counts aren't needed either
+    for (unsigned int s = 0; s < feedbackSlots; s++)
+    {
+        if (captured[s] <= captured[newest])
+        {
+            pending[s] = false;
+        }
+    }
+    drawn = newest;
+
+    std::vector<DrawElementsIndirectCommand> filled = commands;
+    for (unsigned int l = 0; l < commands.size(); l++)
+    {
+        glGetQueryObjectuiv(queries[drawn][l], GL_QUERY_RESULT, &visibleCounts[l]);
+        Debug::glErrorCheck();
+        filled[l].instanceCount = visibleCounts[l];
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, commands_buffer);
+    Debug::glErrorCheck();
+    glBufferSubData(GL_ARRAY_BUFFER, 0, filled.size() * sizeof(DrawElementsIndirectCommand), filled.data());
+    Debug::glErrorCheck();
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    Debug::glErrorCheck();
+}
+
+// Frustum planes, the mesh's bounding sphere and what's needed to pick a level (the GPU picks without hysteresis,
+// since it doesn't remember last frame's levels)
+void InstanceCuller::setUniforms(Shader& shader, const MeshGeometry& geometry)
+{
+    shader.setInt("cull", Culling::frustum.enabled);
+    glUniform4fv(shader.uniformLocation("planes"), 6, glm::value_ptr(Culling::frustum.planes[0]));
+    Debug::glErrorCheck();
+    shader.setVec4("bounds", glm::vec4(geometry.center, geometry.radius));
+    shader.setVec3("view_position", Lod::view.cameraPosition);
+    shader.setFloat("projection_scale", Lod::view.projectionScale);
+    shader.setFloat("max_screen_error", Lod::maxScreenError);
+
+    glm::vec4 errors(0.0f);
+    for (unsigned int l = 0; l < geometry.lods.size(); l++)
+    {
+        errors[l] = geometry.lods[l].error;
+    }
+    shader.setVec4("lod_errors", errors);
+}
+
+// The output streams (and so the varyings) depend on how many levels there are, so there's a program per count
+Shader& InstanceCuller::feedbackProgram(unsigned int lodCount)
+{
+    Shader& shader = feedbackShaders[lodCount - 1];
+    if (shader.ID == 0)
+    {
+        // Interleaved capture, with each level's matrix going to the next buffer binding
+        static const char* outputs[MeshData::maxLods] = {"lod0", "lod1", "lod2", "lod3"};
+        std::vector<const char*> varyings;
+        for (unsigned int l = 0; l < lodCount; l++)
+        {
+            if (l > 0)
+            {
+                varyings.push_back("gl_NextBuffer");
+            }
+            varyings.push_back(outputs[l]);
+        }
+        shader.loadFeedback(":/resources/shaders/instancecull.vert", ":/resources/shaders/instancecull.geom", varyings,
+                            "#define LOD_COUNT " + std::to_string(lodCount) + "\n");
+    }
+    return shader;
+}
+
+// Deletes all associated OpenGL memory with this object (the instance buffer belongs to the mesh)
+void InstanceCuller::Delete()
+{
+    glDeleteBuffers(1, &visible_VBO);
+    Debug::glErrorCheck();
+    glDeleteBuffers(1, &commands_buffer);
+    Debug::glErrorCheck();
+    if (feedback != 0)
+    {
+        glDeleteVertexArrays(1, &cull_VAO);
+        Debug::glErrorCheck();
+        glDeleteTransformFeedbacks(1, &feedback);
+        Debug::glErrorCheck();
+        for (GLuint* slot : queries)
+        {
+            glDeleteQueries(commands.size(), slot);
+            Debug::glErrorCheck();
+        }
+    }
+    visible_VBO = commands_buffer = cull_VAO = feedback = 0;
+    capacity = 0;
+}
+
+// Deletes the shared culling programs (they're compiled again if anything culls afterwards)
+void InstanceCuller::deletePrograms()
+{
+    if (computeShader.ID != 0)
+    {
+        computeShader.Delete();
+        computeShader.ID = 0;
+    }
+    for (Shader& shader : feedbackShaders)
+    {
+        if (shader.ID != 0)
+        {
+            shader.Delete();
+            shader.ID = 0;
+        }
+    }
+}
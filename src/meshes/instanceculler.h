@@ -0,0 +1,94 @@
+#pragma once
+
+#include "meshes/modeldata.h"
+#include "utils/debug.h"
+#include "utils/shader.h"
+#include <vector>
+
+struct MeshGeometry;
+
+// Frustum culls an instanced mesh's instances and picks their levels of detail on the GPU, so drawing a belt of
+// asteroids costs what's visible without the CPU looking at a single instance
+// Every frame the instance matrices are tested against Culling::frustum and Lod::view, and the visible ones are
+// compacted into visible_VBO (level l's instances starting at matrix l * capacity) with their counts in the draw
+// commands, ready for glDrawElementsIndirect
+// With GL 4.3 this is a compute shader (instancecull.comp) that counts straight into the command buffer; on GL 4.1
+// it's a transform feedback pass (instancecull.geom, one vertex stream per level) whose counts are read back once
+// the GPU has them, which is a frame or two later, so those frames draw the last pass that finished instead
+class InstanceCuller
+{
+public:
+    // What glDrawElementsIndirect reads from GL_DRAW_INDIRECT_BUFFER
+    struct DrawElementsIndirectCommand
+    {
+        GLuint count;
+        GLuint instanceCount;
+        GLuint firstIndex;
+        GLuint baseVertex;
+        GLuint baseInstance;
+    };
+
+    // Matrices of the visible instances, sorted by level of detail (0 until create()); the transform feedback path
+    // keeps feedbackSlots passes of them, so a pass can be drawn while the next ones are still being captured
+    GLuint visible_VBO = 0;
+    // One DrawElementsIndirectCommand per level of detail
+    GLuint commands_buffer = 0;
+    // How many instances there are (and so the most any level can have)
+    GLsizei capacity = 0;
+
+    // Sets up culling of the instance matrices from instanceVBO (which stays owned by the caller)
+    void create(const MeshGeometry& geometry, GLuint instanceVBO, GLsizei instances);
+    // Makes room for a new number of instances (the matrices in instanceVBO are re-read every frame anyway)
+    void resize(GLsizei instances);
+    // Reads the instance matrices from offset bytes into instanceVBO from now on (e.g. the region of a RingBuffer
+    // they were last written to), which has to be a multiple of sourceAlignment()
+    void setSource(GLuint instanceVBO, GLintptr offset);
+    static size_t sourceAlignment();
+
+    // Fills visible_VBO and the commands for this frame (leaves the bound program, VAO and buffers unset)
+    void cull(const MeshGeometry& geometry);
+
+    // True when the commands were filled on the GPU, which also means base instances work, so every level can be
+    // drawn at once with glMultiDrawElementsIndirect
+    static bool onGpu();
+    // How many instances of a level are visible (only known on the CPU when onGpu() is false)
+    GLuint visible(unsigned int level) const { return visibleCounts[level]; }
+    // Which matrix of visible_VBO a level's visible instances start at
+    GLsizei firstVisible(unsigned int level) const;
+
+    // Deletes all associated OpenGL memory with this object
+    void Delete();
+    // Deletes the culling programs every culler shares (they're compiled when first needed)
+    static void deletePrograms();
+
+private:
+    GLuint instance_VBO = 0;
+    GLintptr instanceOffset = 0;
+    // Reads the instance matrices as points (transform feedback path only)
+    GLuint cull_VAO = 0;
+    GLuint feedback = 0;
+    // Transform feedback passes in flight at once: one being drawn, and the rest waiting for their counts
+    static const unsigned int feedbackSlots = 3;
+    GLuint queries[feedbackSlots][MeshData::maxLods] = {};
+    // Which passes have counts the CPU hasn't read yet, and in what order they were captured
+    bool pending[feedbackSlots] = {};
+    unsigned int captured[feedbackSlots] = {};
+    unsigned int passes = 0;
+    // The slot last captured into, and the one whose counts are in the commands (-1 until a pass has finished)
+    unsigned int capturing = 0;
+    int drawn = -1;
+    // The commands with every instance count at 0, which the compute path starts each frame from
+    std::vector<DrawElementsIndirectCommand> commands;
+    std::vector<GLuint> visibleCounts;
+
+    void cullCompute(const MeshGeometry& geometry);
+    void cullFeedback(const MeshGeometry& geometry);
+    // Puts the counts of the newest finished pass into the commands (waits only if none has ever finished)
+    void collectFeedback();
+    // Points the cull pass's attributes at the instance matrices
+    void linkSource();
+    // Sets the culling and level of detail uniforms both programs share
+    static void setUniforms(Shader& shader, const MeshGeometry& geometry);
+    // The transform feedback program for meshes with lodCount levels (one vertex stream each)
+    static Shader& feedbackProgram(unsigned int lodCount);
+};
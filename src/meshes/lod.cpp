@@ -0,0 +1,58 @@
+#include "lod.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace Lod
+{
+View view;
+float maxScreenError = 1.0f;
+
+View::View(glm::vec3 cameraPosition, float heightAngle, float viewportHeight)
+    : cameraPosition(cameraPosition), projectionScale(viewportHeight / (2.0f * std::tan(heightAngle / 2.0f)))
+{
+}
+
+// Pixels on screen per model unit at the nearest point of a bounding sphere
+float pixelsPerUnit(const View& view, const glm::mat4& matrix, glm::vec3 center, float radius)
+{
+    if (view.projectionScale <= 0.0f)
+    {
+        return INFINITY;
+    }
+
+    // Non-uniform scales are rounded up to the largest axis, so the error is never underestimated
+    glm::mat3 linear(matrix);
+    float scale = std::max({glm::length(linear[0]), glm::length(linear[1]), glm::length(linear[2])});
+    glm::vec3 worldCenter = glm::vec3(matrix * glm::vec4(center, 1.0f));
+    float distance = glm::length(view.cameraPosition - worldCenter) - radius * scale;
+
+    // Inside the sphere, anything could be right in front of the camera
+    if (distance <= 0.0f)
+    {
+        return INFINITY;
+    }
+    return view.projectionScale * scale / distance;
+}
+
+// Moves to a finer level as soon as the current one's error is too visible, and to a coarser one only once its
+// error is well under the threshold
+unsigned int select(std::span<const MeshLod> lods, float pixelsPerUnit, unsigned int current)
+{
+    if (lods.size() < 2)
+    {
+        return 0;
+    }
+
+    unsigned int level = std::min<unsigned int>(current, lods.size() - 1);
+    while (level > 0 && lods[level].error * pixelsPerUnit > maxScreenError)
+    {
+        level--;
+    }
+    while (level + 1 < lods.size() && lods[level + 1].error * pixelsPerUnit <= maxScreenError * hysteresis)
+    {
+        level++;
+    }
+    return level;
+}
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "meshes/modeldata.h"
+#include <glm/glm.hpp>
+#include <span>
+
+// Picking a mesh's level of detail from how big it is on screen
+// A level is good enough while its error (how far its surface can be from the full mesh) covers at most maxScreenError
+// pixels, so the coarsest such level is drawn. Levels only get coarser once they're comfortably under the threshold,
+// which keeps objects sitting right at it from flickering between two levels
+namespace Lod
+{
+// Where the camera is, in the space the meshes are drawn in, and how much it magnifies
+struct View
+{
+    glm::vec3 cameraPosition = glm::vec3(0.0f);
+    // Viewport height in pixels over 2 tan(fovy / 2): something of size s at distance d covers s / d times this
+    // 0 turns level selection off (everything is drawn at full detail)
+    float projectionScale = 0.0f;
+
+    View() = default;
+    View(glm::vec3 cameraPosition, float heightAngle, float viewportHeight);
+};
+
+// What Mesh::Draw picks levels for (set before drawing; a View() draws everything at full detail)
+extern View view;
+
+// How many pixels a level's error may cover on screen
+extern float maxScreenError;
+// A coarser level's error has to be under this fraction of maxScreenError before it's switched to
+const float hysteresis = 0.5f;
+
+// Pixels on screen per model unit for a bounding sphere drawn with matrix, measured at the sphere's nearest point
+float pixelsPerUnit(const View& view, const glm::mat4& matrix, glm::vec3 center, float radius);
+
+// The level to draw now, given the one drawn last time
+unsigned int select(std::span<const MeshLod> lods, float pixelsPerUnit, unsigned int current);
+}
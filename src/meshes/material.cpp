@@ -0,0 +1,15 @@
+#include "material.h"
+
+Material::Material(const Texture& diffuse, const Texture& specular, glm::vec4 baseColor, bool doubleSided)
+    : diffuse(diffuse), specular(specular), baseColor(baseColor), doubleSided(doubleSided) {
+}
+
+// Binds the textures to their units and sets the shader's sampler and color uniforms
+void Material::Bind(Shader& shader) {
+    diffuse.texUnit(shader, "diffuse0", diffuse.unit);
+    diffuse.Bind();
+    specular.texUnit(shader, "specular0", specular.unit);
+    specular.Bind();
+
+    shader.setVec4("base_color", baseColor);
+}
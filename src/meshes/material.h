@@ -0,0 +1,26 @@
+#pragma once
+
+#include "Texture.h"
+#include <glm/glm.hpp>
+
+// The textures and color one or more primitives are drawn with
+// Models bind a material once and then draw every mesh that uses it
+struct Material
+{
+    // Texture units the model shader reads diffuse0 and specular0 from
+    static const GLuint diffuseUnit = 0;
+    static const GLuint specularUnit = 1;
+
+    // A material without a specular texture uses its diffuse texture for both (which is what the shader has always
+    // seen for single texture models), and one without a diffuse texture uses a white placeholder
+    Texture diffuse;
+    Texture specular;
+    glm::vec4 baseColor;
+    // Drawn without culling back faces (the render queue culls them for every other material)
+    bool doubleSided;
+
+    Material(const Texture& diffuse, const Texture& specular, glm::vec4 baseColor, bool doubleSided = false);
+
+    // Binds the textures to their units and sets the shader's sampler and color uniforms
+    void Bind(Shader& shader);
+};
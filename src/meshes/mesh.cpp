@@ -1,41 +1,128 @@
 #include "Mesh.h"
 
+#include "utils/gldeletequeue.h"
+#include <algorithm>
+
+namespace
+{
+// Byte offset of a level's first index in the index buffer
+const void* lodIndexOffset(const MeshGeometry& geometry, const MeshLod& level)
+{
+    size_t indexSize = geometry.indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+    return reinterpret_cast<const void*>(level.firstIndex * indexSize);
+}
+}
+
+MeshGeometry::MeshGeometry
+    (
+        std::span<const Vertex> vertices,
+        std::span<const GLuint> indices,
+        const VertexFormat& format,
+        std::span<const MeshLod> lods
+        )
+{
+    vertexCount = vertices.size();
+    indexCount = indices.size();
+    MeshGeometry::format = &format;
+    MeshGeometry::lods.assign(lods.begin(), lods.end());
+    if (MeshGeometry::lods.empty())
+    {
+        MeshGeometry::lods.push_back(MeshLod{0, indices.size(), 0.0f});
+    }
+
+    // Generates the vertex buffer (the standard format is uploaded straight from the decoded or mapped array)
+    glGenBuffers(1, &vertices_VBO);
+    Debug::glErrorCheck();
+    glBindBuffer(GL_ARRAY_BUFFER, vertices_VBO);
+    Debug::glErrorCheck();
+    if (&format == &VertexFormat::standard())
+    {
+        glBufferData(GL_ARRAY_BUFFER, vertices.size_bytes(), vertices.data(), GL_STATIC_DRAW);
+    }
+    else
+    {
+        std::vector<unsigned char> packed = format.pack(vertices, positionScale, positionOffset);
+        glBufferData(GL_ARRAY_BUFFER, packed.size(), packed.data(), GL_STATIC_DRAW);
+    }
+    Debug::glErrorCheck();
+
+    // Meshes with at most 65536 vertices only need 16-bit indices, which halves the index buffer
+    std::vector<GLushort> narrowed;
+    const void* indexData = indices.data();
+    size_t indexBytes = indices.size_bytes();
+    if (vertices.size() <= 65536)
+    {
+        indexType = GL_UNSIGNED_SHORT;
+        narrowed.assign(indices.begin(), indices.end());
+        indexData = narrowed.data();
+        indexBytes = narrowed.size() * sizeof(GLushort);
+    }
+    // Uploads the indices through GL_ARRAY_BUFFER, since the element array binding belongs to whichever VAO is bound
+    // (buffers aren't tied to a target, so each mesh's VAO can still use it as its EBO)
+    glGenBuffers(1, &indices_EBO);
+    Debug::glErrorCheck();
+    glBindBuffer(GL_ARRAY_BUFFER, indices_EBO);
+    Debug::glErrorCheck();
+    glBufferData(GL_ARRAY_BUFFER, indexBytes, indexData, GL_STATIC_DRAW);
+    Debug::glErrorCheck();
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    Debug::glErrorCheck();
+}
+
+// The last model sharing the geometry can let go of it on any thread, so the buffers are deleted on the GL thread
+MeshGeometry::~MeshGeometry()
+{
+    GLDeleteQueue::defer([vertices = vertices_VBO, indices = indices_EBO]() {
+        GLuint buffers[] = {vertices, indices};
+        glDeleteBuffers(2, buffers);
+        Debug::glErrorCheck();
+    });
+}
+
 Mesh::Mesh
     (
         std::vector <Vertex>& vertices,
         std::vector <GLuint>& indices,
-        std::vector <Texture>& textures,
+        unsigned int instances,
+        std::vector <glm::mat4> instanceMatrix
+        )
+    : Mesh(std::make_shared<MeshGeometry>(vertices, indices), instances, instanceMatrix)
+{
+}
+
+Mesh::Mesh
+    (
+        std::shared_ptr<MeshGeometry> geometry,
         unsigned int instances,
         std::vector <glm::mat4> instanceMatrix
         )
 {
-    Mesh::vertices = vertices;
-    Mesh::indices = indices;
-    Mesh::textures = textures;
+    Mesh::geometry = geometry;
     Mesh::instances = instances;
 
     VAO.Bind();
-    // Generates Vertex Buffer Object and links it to vertices
-    VBO instanceVBO(instanceMatrix);
-    instance_VBO = instanceVBO.ID;
-    VBO VBO(vertices);
-    vertices_VBO = VBO.ID;
-    // Generates Element Buffer Object and links it to indices
-    EBO EBO(indices);
-    indices_EBO = EBO.ID;
-    // Links VBO attributes such as coordinates and colors to VAO
-    VAO.LinkAttrib(VBO, 0, 3, GL_FLOAT, sizeof(Vertex), (void*)0);
-    VAO.LinkAttrib(VBO, 1, 3, GL_FLOAT, sizeof(Vertex), (void*)(3 * sizeof(float)));
-    VAO.LinkAttrib(VBO, 2, 3, GL_FLOAT, sizeof(Vertex), (void*)(6 * sizeof(float)));
-    VAO.LinkAttrib(VBO, 3, 2, GL_FLOAT, sizeof(Vertex), (void*)(9 * sizeof(float)));
+    // Attaches the shared vertex and index buffers to this mesh's VAO
+    VBO VBO(geometry->vertices_VBO);
+    EBO EBO(geometry->indices_EBO);
+    EBO.Bind();
+    // Links VBO attributes such as coordinates and colors to VAO (whichever ones the geometry's format has)
+    VAO.LinkAttribs(VBO, *geometry->format);
     if (instances != 1)
     {
-        instanceVBO.Bind();
+        // The instance matrices are only read by the culler: what's drawn are the visible instances it compacts
+        writeInstances(instanceMatrix);
+        culler.create(*geometry, instanceRing.ID, std::min<size_t>(instances, instanceMatrix.size()));
+        culler.setSource(instanceRing.ID, instanceRing.offset());
+        // Setting up the culler binds VAOs of its own
+        VAO.Bind();
+        // (VBO is also the name of the vertex buffer in this scope)
+        ::VBO visibleVBO(culler.visible_VBO);
+        visibleVBO.Bind();
         // Can't link to a mat4 so you need to link four vec4s
-        VAO.LinkAttrib(instanceVBO, 4, 4, GL_FLOAT, sizeof(glm::mat4), (void*)0);
-        VAO.LinkAttrib(instanceVBO, 5, 4, GL_FLOAT, sizeof(glm::mat4), (void*)(1 * sizeof(glm::vec4)));
-        VAO.LinkAttrib(instanceVBO, 6, 4, GL_FLOAT, sizeof(glm::mat4), (void*)(2 * sizeof(glm::vec4)));
-        VAO.LinkAttrib(instanceVBO, 7, 4, GL_FLOAT, sizeof(glm::mat4), (void*)(3 * sizeof(glm::vec4)));
+        VAO.LinkAttrib(visibleVBO, 4, 4, GL_FLOAT, sizeof(glm::mat4), (void*)0);
+        VAO.LinkAttrib(visibleVBO, 5, 4, GL_FLOAT, sizeof(glm::mat4), (void*)(1 * sizeof(glm::vec4)));
+        VAO.LinkAttrib(visibleVBO, 6, 4, GL_FLOAT, sizeof(glm::mat4), (void*)(2 * sizeof(glm::vec4)));
+        VAO.LinkAttrib(visibleVBO, 7, 4, GL_FLOAT, sizeof(glm::mat4), (void*)(3 * sizeof(glm::vec4)));
         // Makes it so the transform is only switched when drawing the next instance
         glVertexAttribDivisor(4, 1);
         glVertexAttribDivisor(5, 1);
@@ -45,11 +132,11 @@ Mesh::Mesh
     // Unbind all to prevent accidentally modifying them
     VAO.Unbind();
     VBO.Unbind();
-    instanceVBO.Unbind();
     EBO.Unbind();
 }
 
 // NOTE: Draw function should be called only after relevant camera uniforms (and lights) have been passed in
+// The shader has to be active and the VAO bound already (the render queue does both, only when they change)
 void Mesh::Draw
     (
         Shader& shader,
@@ -59,31 +146,11 @@ void Mesh::Draw
         glm::vec3 scale
         )
 {
-    // Bind shader to be able to access uniforms
-    shader.Activate();
-    VAO.Bind();
-
-    // Keep track of how many of each type of textures we have
-    unsigned int numDiffuse = 0;
-    unsigned int numSpecular = 0;
+    // Textures were bound with the mesh's material (meshes sharing a material are drawn together)
 
-    for (unsigned int i = 0; i < textures.size(); i++)
-    {
-        std::string num;
-        std::string type = textures[i].type;
-        if (type == "diffuse")
-        {
-            num = std::to_string(numDiffuse++);
-        }
-        else if (type == "specular")
-        {
-            num = std::to_string(numSpecular++);
-        }
-        // This function sends the texture to the shader using the format:
-        // diffuse0, diffuse1, (OR) specular0, specular1, etc.
-        textures[i].texUnit(shader, (type + num).c_str(), i);
-        textures[i].Bind();
-    }
+    // Undoes position quantization (scale 1 and offset 0 for formats with float positions)
+    shader.setVec3("position_scale", geometry->positionScale);
+    shader.setVec3("position_offset", geometry->positionOffset);
 
     // Check if instance drawing should be performed
     if (instances == 1)
@@ -99,38 +166,111 @@ void Mesh::Draw
         sca = glm::scale(sca, scale);
 
         // Push the matrices to the vertex shader
-        glUniformMatrix4fv(glGetUniformLocation(shader.ID, "translation"), 1, GL_FALSE, glm::value_ptr(trans));
-        glUniformMatrix4fv(glGetUniformLocation(shader.ID, "rotation"), 1, GL_FALSE, glm::value_ptr(rot));
-        glUniformMatrix4fv(glGetUniformLocation(shader.ID, "scale"), 1, GL_FALSE, glm::value_ptr(sca));
-        glUniformMatrix4fv(glGetUniformLocation(shader.ID, "model"), 1, GL_FALSE, glm::value_ptr(matrix));
+        shader.setMat4("translation", trans);
+        shader.setMat4("rotation", rot);
+        shader.setMat4("scale", sca);
+        shader.setMat4("model", matrix);
 
-        // Draw the actual mesh
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
+        // Draw the actual mesh (at the level selectLod picked)
+        const MeshLod& level = geometry->lods[lod];
+        glDrawElements(GL_TRIANGLES, level.indexCount, geometry->indexType, lodIndexOffset(*geometry, level));
     }
     else
     {
-        glDrawElementsInstanced(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0, instances);
+        // One indirect draw per level of detail, whose instance count the culler filled in
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, culler.commands_buffer);
+        Debug::glErrorCheck();
+        if (InstanceCuller::onGpu())
+        {
+            // Each command's base instance points it at its own level's run, so they can all go at once
+            glMultiDrawElementsIndirect(GL_TRIANGLES, geometry->indexType, nullptr, geometry->lods.size(), 0);
+            Debug::glErrorCheck();
+        }
+        else
+        {
+            for (unsigned int l = 0; l < geometry->lods.size(); l++)
+            {
+                if (culler.visible(l) == 0)
+                {
+                    continue;
+                }
+                bindInstancesFrom(culler.firstVisible(l));
+                const void* command = reinterpret_cast<const void*>(l * sizeof(InstanceCuller::DrawElementsIndirectCommand));
+                glDrawElementsIndirect(GL_TRIANGLES, geometry->indexType, command);
+                Debug::glErrorCheck();
+            }
+        }
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        Debug::glErrorCheck();
+    }
+}
+
+// Picks the level of detail from how big the mesh is on screen when drawn with matrix
+void Mesh::selectLod(const Lod::View& view, const glm::mat4& matrix)
+{
+    if (geometry->lods.size() > 1)
+    {
+        float pixelsPerUnit = Lod::pixelsPerUnit(view, matrix, geometry->center, geometry->radius);
+        lod = Lod::select(geometry->lods, pixelsPerUnit, lod);
     }
 }
 
+// Culls the instances, and sorts the visible ones by level of detail, into the buffers the draw reads
+void Mesh::cullInstances()
+{
+    // The cull pass reads the current region this frame
+    instanceRing.use();
+    culler.cull(*geometry);
+}
+
+// Points the instance attributes of the bound VAO at the given matrix of the visible instances
+// (there's no base instance in GL 4.1, so this is how a draw starts partway into the buffer)
+void Mesh::bindInstancesFrom(GLsizei first)
+{
+    glBindBuffer(GL_ARRAY_BUFFER, culler.visible_VBO);
+    Debug::glErrorCheck();
+    for (GLuint column = 0; column < 4; column++)
+    {
+        size_t offset = first * sizeof(glm::mat4) + column * sizeof(glm::vec4);
+        glVertexAttribPointer(4 + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), reinterpret_cast<const void*>(offset));
+        Debug::glErrorCheck();
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    Debug::glErrorCheck();
+}
+
 // Updates the instance matrices so you can have a new number of instances
 void Mesh::updateInstances(unsigned int new_instances, std::vector<glm::mat4> new_instance_matrix) {
     instances = new_instances;
 
-    // Overwrite old VBO data with new instance matrix data
-    glBindBuffer(GL_ARRAY_BUFFER, instance_VBO);
-    Debug::glErrorCheck();
-    glBufferData(GL_ARRAY_BUFFER, new_instance_matrix.size() * sizeof(glm::mat4), new_instance_matrix.data(), GL_STATIC_DRAW);
-    Debug::glErrorCheck();
+    // Only the culler reads the matrices (so there's nothing to write to if the mesh wasn't made instanced)
+    if (culler.visible_VBO != 0)
+    {
+        // The new matrices go to the next region instead of reallocating the buffer under the frames in flight
+        writeInstances(new_instance_matrix);
+        culler.setSource(instanceRing.ID, instanceRing.offset());
+        // It also needs room to compact all of them
+        culler.resize(std::min<size_t>(new_instances, new_instance_matrix.size()));
+    }
+}
+
+// Writes the matrices to the next region, only making a bigger ring when they don't fit in the current one
+void Mesh::writeInstances(const std::vector<glm::mat4>& matrices)
+{
+    size_t bytes = matrices.size() * sizeof(glm::mat4);
+    if (instanceRing.ID == 0 || bytes > instanceRing.regionSize())
+    {
+        instanceRing.create(bytes, InstanceCuller::sourceAlignment());
+    }
+    instanceRing.next();
+    instanceRing.write(matrices.data(), bytes);
 }
 
 // Deletes all associated OpenGL memory with this object
 void Mesh::cleanup() {
     VAO.Delete();
-    glDeleteBuffers(1, &instance_VBO);
-    Debug::glErrorCheck();
-    glDeleteBuffers(1, &vertices_VBO);
-    Debug::glErrorCheck();
-    glDeleteBuffers(1, &indices_EBO);
-    Debug::glErrorCheck();
+    instanceRing.Delete();
+    culler.Delete();
+    // The vertex and index buffers are deleted by MeshGeometry once the last mesh sharing them is gone
+    geometry.reset();
 }
@@ -7,35 +7,96 @@
 #include"Texture.h"
 #include"utils/VAO.h"
 #include"utils/EBO.h"
+#include"meshes/lod.h"
+#include"meshes/instanceculler.h"
+#include"utils/ringbuffer.h"
+#include<memory>
+#include<span>
+
+// Vertex and index buffers of one mesh on the GPU
+// Every Mesh made from the same file shares one of these, and the buffers are deleted when the last one lets go
+struct MeshGeometry
+{
+    GLuint vertices_VBO = 0;
+    GLuint indices_EBO = 0;
+    // Vertex and index data only lives on the GPU, so all we hold onto is how much there is (to draw, or copy)
+    GLsizei vertexCount = 0;
+    GLsizei indexCount = 0;
+    // Levels of detail, finest first, each a part of the index buffer (always at least one)
+    std::vector<MeshLod> lods;
+    // Bounding box (center plus or minus extent) and sphere of the vertices (before any transform), for frustum culling
+    // and working out how big the mesh is on screen
+    glm::vec3 center = glm::vec3(0.0f);
+    glm::vec3 extent = glm::vec3(0.0f);
+    float radius = 0.0f;
+    // GL_UNSIGNED_SHORT when every index fits in 16 bits, GL_UNSIGNED_INT otherwise
+    GLenum indexType = GL_UNSIGNED_INT;
+
+    // Layout of the vertex buffer, and what the shader applies to aPos to undo position quantization
+    const VertexFormat* format = nullptr;
+    glm::vec3 positionScale = glm::vec3(1.0f);
+    glm::vec3 positionOffset = glm::vec3(0.0f);
+
+    // Converts the vertices to format and uploads them along with the indices
+    // Without lods the whole index buffer is the only level
+    MeshGeometry
+        (
+            std::span<const Vertex> vertices,
+            std::span<const GLuint> indices,
+            const VertexFormat& format = VertexFormat::standard(),
+            std::span<const MeshLod> lods = {}
+            );
+    // Queues the buffers for deletion on the GL thread (see GLDeleteQueue)
+    ~MeshGeometry();
+
+    // Owns GL buffers, so it can't be copied (share it through a shared_ptr instead)
+    MeshGeometry(const MeshGeometry&) = delete;
+    MeshGeometry& operator=(const MeshGeometry&) = delete;
+};
 
 class Mesh
 {
 public:
-    std::vector <Vertex> vertices;
-    std::vector <GLuint> indices;
-    std::vector <Texture> textures;
+    // Shared vertex and index buffers
+    std::shared_ptr<MeshGeometry> geometry;
     // Store VAO in public so it can be used in the Draw function
     VAO VAO;
 
-    // Holders for VBOs so we can delete them
-    GLuint instance_VBO = 0;
-    GLuint vertices_VBO = 0;
-    GLuint indices_EBO = 0;
+    // Instance matrices (each mesh has its own, so instance counts can differ between users of the geometry)
+    // New matrices go to the next region, so they're written while the GPU may still be culling the last ones
+    RingBuffer instanceRing;
+    // Culls the instances and sorts them by level of detail on the GPU (only set up when the mesh is instanced)
+    InstanceCuller culler;
 
     // Holds number of instances (if 1 the mesh will be rendered normally)
     unsigned int instances;
 
+    // Level of detail the mesh is drawn at (when it isn't instanced), picked by selectLod
+    unsigned int lod = 0;
+
     // Initializes the mesh
     Mesh
         (
             std::vector <Vertex>& vertices,
             std::vector <GLuint>& indices,
-            std::vector <Texture>& textures,
+            unsigned int instances = 1,
+            std::vector <glm::mat4> instanceMatrix = {}
+            );
+    // Initializes the mesh on top of geometry that's already on the GPU (only the VAO and instance buffer are new)
+    Mesh
+        (
+            std::shared_ptr<MeshGeometry> geometry,
             unsigned int instances = 1,
             std::vector <glm::mat4> instanceMatrix = {}
             );
 
-    // Draws the mesh
+    // Picks the level of detail to draw at as seen from view, for the full matrix the mesh is drawn with
+    void selectLod(const Lod::View& view, const glm::mat4& matrix);
+    // Runs the instance culler for this frame (before drawing, since it runs programs of its own)
+    void cullInstances();
+
+    // Draws the mesh (with whatever material is bound, see Material::Bind)
+    // Expects the shader to be active and the VAO bound
     void Draw
         (
             Shader& shader,
@@ -48,6 +109,12 @@ public:
     // Updates the instance matrices so you can have a new number of instances
     void updateInstances(unsigned int new_instances, std::vector<glm::mat4> new_instance_matrix);
 
-    // Deletes all associated OpenGL memory with this object
+    // Deletes all associated OpenGL memory with this object (the geometry only goes once no other mesh uses it)
     void cleanup();
+
+private:
+    // Points the instance attributes at the given matrix of the culler's visible instances, so drawing starts from it
+    void bindInstancesFrom(GLsizei first);
+    // Writes instance matrices to the next region of instanceRing (remaking it if they don't fit)
+    void writeInstances(const std::vector<glm::mat4>& matrices);
 };
@@ -0,0 +1,319 @@
+#include "meshoptimizer.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <unordered_map>
+
+namespace
+{
+// Merges vertices whose every attribute is bit for bit the same, rewriting indices to point at the survivors
+void weldVertices(std::vector<Vertex>& vertices, std::vector<GLuint>& indices)
+{
+    std::unordered_map<std::string_view, GLuint> seen;
+    seen.reserve(vertices.size());
+    std::vector<GLuint> remap(vertices.size());
+    std::vector<Vertex> welded;
+    welded.reserve(vertices.size());
+
+    for (size_t i = 0; i < vertices.size(); i++)
+    {
+        // Keys view the original array, which isn't touched until the end
+        std::string_view key(reinterpret_cast<const char*>(&vertices[i]), sizeof(Vertex));
+        auto inserted = seen.emplace(key, GLuint(welded.size()));
+        if (inserted.second)
+        {
+            welded.push_back(vertices[i]);
+        }
+        remap[i] = inserted.first->second;
+    }
+
+    for (GLuint& index : indices)
+    {
+        index = remap[index];
+    }
+    vertices = std::move(welded);
+}
+
+// Tipsify: fans around one vertex at a time, and picks the next vertex to fan around from the ones just emitted,
+// preferring those still in the cache that have few triangles left. Runs in linear time
+std::vector<GLuint> tipsify(const std::vector<GLuint>& indices, size_t vertexCount, unsigned int cacheSize)
+{
+    size_t triangleCount = indices.size() / 3;
+
+    // Triangles using each vertex (offsets into one flat array) and how many of them are still to be emitted
+    std::vector<unsigned int> live(vertexCount, 0);
+    for (GLuint index : indices)
+    {
+        live[index]++;
+    }
+    std::vector<size_t> offsets(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; v++)
+    {
+        offsets[v + 1] = offsets[v] + live[v];
+    }
+    std::vector<unsigned int> adjacency(indices.size());
+    std::vector<size_t> filled(offsets.begin(), offsets.end() - 1);
+    for (size_t t = 0; t < triangleCount; t++)
+    {
+        for (int c = 0; c < 3; c++)
+        {
+            adjacency[filled[indices[t * 3 + c]]++] = t;
+        }
+    }
+
+    std::vector<unsigned int> cacheTime(vertexCount, 0);
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<GLuint> deadEnds;
+    std::vector<GLuint> candidates;
+    std::vector<GLuint> result;
+    result.reserve(indices.size());
+    unsigned int time = cacheSize + 1;
+    size_t cursor = 0;
+
+    // Next vertex to fan around once nothing good is near: the most recent emitted vertex with triangles left,
+    // and failing that the next such vertex in input order
+    auto skipDeadEnd = [&]() -> long {
+        while (!deadEnds.empty())
+        {
+            GLuint vertex = deadEnds.back();
+            deadEnds.pop_back();
+            if (live[vertex] > 0)
+            {
+                return vertex;
+            }
+        }
+        while (cursor < vertexCount)
+        {
+            if (live[cursor] > 0)
+            {
+                return cursor;
+            }
+            cursor++;
+        }
+        return -1;
+    };
+
+    long fan = skipDeadEnd();
+    while (fan >= 0)
+    {
+        candidates.clear();
+        for (size_t a = offsets[fan]; a < offsets[fan + 1]; a++)
+        {
+            unsigned int t = adjacency[a];
+            if (emitted[t])
+            {
+                continue;
+            }
+            emitted[t] = true;
+            for (int c = 0; c < 3; c++)
+            {
+                GLuint vertex = indices[t * 3 + c];
+                result.push_back(vertex);
+                deadEnds.push_back(vertex);
+                candidates.push_back(vertex);
+                live[vertex]--;
+                if (time - cacheTime[vertex] > cacheSize)
+                {
+                    cacheTime[vertex] = time++;
+                }
+            }
+        }
+
+        // Best candidate is the one that will still be in the cache after its remaining triangles are emitted,
+        // and of those, the one that entered the cache longest ago
+        long best = -1;
+        unsigned int bestPriority = 0;
+        for (GLuint vertex : candidates)
+        {
+            if (live[vertex] == 0)
+            {
+                continue;
+            }
+            unsigned int priority = 0;
+            if (time - cacheTime[vertex] + 2 * live[vertex] <= cacheSize)
+            {
+                priority = time - cacheTime[vertex];
+            }
+            if (best < 0 || priority > bestPriority)
+            {
+                best = vertex;
+                bestPriority = priority;
+            }
+        }
+        fan = best >= 0 ? best : skipDeadEnd();
+    }
+    return result;
+}
+
+// Splits a cache optimized triangle list into clusters where the cache starts over (a triangle with three misses),
+// then draws the clusters facing out from the mesh's center first, so they hide what's behind them
+// Cutting only where the cache was cold anyway means the ACMR stays almost the same
+void optimizeOverdraw(std::vector<GLuint>& indices, std::span<const Vertex> vertices, unsigned int cacheSize)
+{
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount < 2)
+    {
+        return;
+    }
+
+    std::vector<size_t> clusterStarts;
+    std::vector<unsigned int> cacheTime(vertices.size(), 0);
+    unsigned int time = cacheSize + 1;
+    for (size_t t = 0; t < triangleCount; t++)
+    {
+        int misses = 0;
+        for (int c = 0; c < 3; c++)
+        {
+            GLuint vertex = indices[t * 3 + c];
+            if (time - cacheTime[vertex] > cacheSize)
+            {
+                cacheTime[vertex] = time++;
+                misses++;
+            }
+        }
+        if (t == 0 || misses == 3)
+        {
+            clusterStarts.push_back(t);
+        }
+    }
+    clusterStarts.push_back(triangleCount);
+    size_t clusterCount = clusterStarts.size() - 1;
+    if (clusterCount < 2)
+    {
+        return;
+    }
+
+    // Area weighted center of the whole mesh and of each cluster, and each cluster's average facing
+    glm::vec3 meshCenter(0.0f);
+    float meshArea = 0.0f;
+    std::vector<glm::vec3> clusterCenters(clusterCount, glm::vec3(0.0f));
+    std::vector<glm::vec3> clusterNormals(clusterCount, glm::vec3(0.0f));
+    for (size_t cluster = 0; cluster < clusterCount; cluster++)
+    {
+        float clusterArea = 0.0f;
+        for (size_t t = clusterStarts[cluster]; t < clusterStarts[cluster + 1]; t++)
+        {
+            const glm::vec3& p0 = vertices[indices[t * 3]].position;
+            const glm::vec3& p1 = vertices[indices[t * 3 + 1]].position;
+            const glm::vec3& p2 = vertices[indices[t * 3 + 2]].position;
+            glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+            float area = glm::length(normal);
+            glm::vec3 center = (p0 + p1 + p2) / 3.0f;
+
+            clusterCenters[cluster] += center * area;
+            clusterNormals[cluster] += normal;
+            clusterArea += area;
+        }
+        meshCenter += clusterCenters[cluster];
+        meshArea += clusterArea;
+        clusterCenters[cluster] /= std::max(clusterArea, 1e-20f);
+    }
+    meshCenter /= std::max(meshArea, 1e-20f);
+
+    // How far out from the center the cluster is along the way it faces (bigger means more likely in front)
+    std::vector<float> keys(clusterCount);
+    for (size_t cluster = 0; cluster < clusterCount; cluster++)
+    {
+        float length = glm::length(clusterNormals[cluster]);
+        glm::vec3 facing = length > 0.0f ? clusterNormals[cluster] / length : glm::vec3(0.0f);
+        keys[cluster] = glm::dot(clusterCenters[cluster] - meshCenter, facing);
+    }
+
+    std::vector<size_t> order(clusterCount);
+    for (size_t cluster = 0; cluster < clusterCount; cluster++)
+    {
+        order[cluster] = cluster;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return keys[a] > keys[b];
+    });
+
+    std::vector<GLuint> sorted;
+    sorted.reserve(indices.size());
+    for (size_t cluster : order)
+    {
+        sorted.insert(sorted.end(), indices.begin() + clusterStarts[cluster] * 3, indices.begin() + clusterStarts[cluster + 1] * 3);
+    }
+    indices = std::move(sorted);
+}
+
+// Renumbers vertices in the order the index list first uses them, dropping any it never uses
+void optimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<GLuint>& indices)
+{
+    const GLuint unused = UINT32_MAX;
+    std::vector<GLuint> remap(vertices.size(), unused);
+    std::vector<Vertex> reordered;
+    reordered.reserve(vertices.size());
+
+    for (GLuint& index : indices)
+    {
+        if (remap[index] == unused)
+        {
+            remap[index] = reordered.size();
+            reordered.push_back(vertices[index]);
+        }
+        index = remap[index];
+    }
+    vertices = std::move(reordered);
+}
+}
+
+namespace MeshOptimizer
+{
+// ACMR of a triangle list drawn through a FIFO vertex cache of the given size
+float acmr(std::span<const GLuint> indices, size_t vertexCount, unsigned int cacheSize)
+{
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0)
+    {
+        return 0.0f;
+    }
+
+    // A vertex is in a FIFO cache if fewer than cacheSize misses have happened since it went in
+    std::vector<size_t> insertedAt(vertexCount, 0);
+    std::vector<bool> cached(vertexCount, false);
+    size_t misses = 0;
+    for (GLuint index : indices)
+    {
+        if (!cached[index] || misses - insertedAt[index] >= cacheSize)
+        {
+            insertedAt[index] = misses++;
+            cached[index] = true;
+        }
+    }
+    return float(misses) / float(triangleCount);
+}
+
+// Optimizes one mesh in place
+Report optimize(std::vector<Vertex>& vertices, std::vector<GLuint>& indices)
+{
+    Report report;
+    report.verticesBefore = vertices.size();
+    report.acmrBefore = acmr(indices, vertices.size());
+
+    // Only whole triangles can be reordered, so anything that isn't a triangle list is left alone
+    if (indices.size() % 3 == 0 && !indices.empty())
+    {
+        weldVertices(vertices, indices);
+        indices = tipsify(indices, vertices.size(), cacheSize);
+        optimizeOverdraw(indices, vertices, cacheSize);
+        optimizeVertexFetch(vertices, indices);
+    }
+
+    report.verticesAfter = vertices.size();
+    report.acmrAfter = acmr(indices, vertices.size());
+    return report;
+}
+
+// Reorders the triangles of an index list without touching the vertices
+void optimizeTriangles(std::vector<GLuint>& indices, std::span<const Vertex> vertices)
+{
+    if (indices.size() % 3 == 0 && !indices.empty())
+    {
+        indices = tipsify(indices, vertices.size(), cacheSize);
+        optimizeOverdraw(indices, vertices, cacheSize);
+    }
+}
+}
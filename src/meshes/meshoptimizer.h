@@ -0,0 +1,37 @@
+#pragma once
+
+#include "utils/vbo.h"
+#include <cstddef>
+#include <span>
+#include <vector>
+
+// Load/bake time clean up of decoded meshes, so every draw of them does less work:
+//   1. Welds vertices that are exact duplicates (exporters often split them per face)
+//   2. Reorders triangles for the post-transform vertex cache (Tipsify, Sander et al. 2007)
+//   3. Reorders the resulting clusters of triangles so outward facing ones are drawn first (less overdraw)
+//   4. Renumbers vertices in the order the triangles first use them (vertex fetch locality)
+// None of it changes what's drawn, only the order and how many vertices there are
+namespace MeshOptimizer
+{
+// How much an optimize() call helped. ACMR is the average number of vertex shader runs per triangle, between 0.5 and 3
+struct Report
+{
+    size_t verticesBefore = 0;
+    size_t verticesAfter = 0;
+    float acmrBefore = 0.0f;
+    float acmrAfter = 0.0f;
+};
+
+// Cache size the triangle order is tuned for and ACMR is measured with (a FIFO cache, like most GPUs had)
+const unsigned int cacheSize = 16;
+
+// ACMR of a triangle list drawn through a FIFO vertex cache of the given size
+float acmr(std::span<const GLuint> indices, size_t vertexCount, unsigned int cacheSize = MeshOptimizer::cacheSize);
+
+// Optimizes one mesh in place (indices are relative to vertices, and both are rewritten)
+Report optimize(std::vector<Vertex>& vertices, std::vector<GLuint>& indices);
+
+// Reorders only the triangles of an index list, for the cache and overdraw (steps 2 and 3), leaving the vertices alone
+// Used for extra index lists over an already optimized vertex array, like levels of detail
+void optimizeTriangles(std::vector<GLuint>& indices, std::span<const Vertex> vertices);
+}
@@ -0,0 +1,426 @@
+#include "meshsimplifier.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <string_view>
+#include <unordered_map>
+
+namespace
+{
+// Sum of squared distances to a set of planes, each weighted by the area of the triangle it came from
+// Stored as the upper half of the symmetric matrix sum(w * (a b c d)^T (a b c d))
+struct Quadric
+{
+    double a2 = 0.0, ab = 0.0, ac = 0.0, ad = 0.0;
+    double b2 = 0.0, bc = 0.0, bd = 0.0;
+    double c2 = 0.0, cd = 0.0;
+    double d2 = 0.0;
+    double weight = 0.0;
+
+    // Adds the plane through point with the given unit normal
+    void addPlane(const glm::dvec3& normal, const glm::dvec3& point, double w)
+    {
+        double d = -glm::dot(normal, point);
+        a2 += w * normal.x * normal.x;
+        ab += w * normal.x * normal.y;
+        ac += w * normal.x * normal.z;
+        ad += w * normal.x * d;
+        b2 += w * normal.y * normal.y;
+        bc += w * normal.y * normal.z;
+        bd += w * normal.y * d;
+        c2 += w * normal.z * normal.z;
+        cd += w * normal.z * d;
+        d2 += w * d * d;
+        weight += w;
+    }
+
+    void add(const Quadric& other)
+    {
+        a2 += other.a2;
+        ab += other.ab;
+        ac += other.ac;
+        ad += other.ad;
+        b2 += other.b2;
+        bc += other.bc;
+        bd += other.bd;
+        c2 += other.c2;
+        cd += other.cd;
+        d2 += other.d2;
+        weight += other.weight;
+    }
+
+    // Mean squared distance from p to the planes
+    double error(const glm::dvec3& p) const
+    {
+        if (weight <= 0.0)
+        {
+            return 0.0;
+        }
+        double sum = a2 * p.x * p.x + b2 * p.y * p.y + c2 * p.z * p.z
+                     + 2.0 * (ab * p.x * p.y + ac * p.x * p.z + bc * p.y * p.z + ad * p.x + bd * p.y + cd * p.z) + d2;
+        return std::max(sum, 0.0) / weight;
+    }
+};
+
+// Moving every vertex at one position onto the vertices at another (from and to are the first vertex at each position)
+struct Collapse
+{
+    GLuint from;
+    GLuint to;
+    double cost;
+};
+
+// The mesh being simplified: its triangle list, renumbered as collapses happen, and what's needed to pick and check them
+// Vertices at the same position (split by normal or UV) are grouped, and collapses work on whole groups
+class Simplifier
+{
+public:
+    Simplifier(std::span<const Vertex> vertices, std::span<const GLuint> indices);
+
+    // Number of indices the live triangles would take
+    size_t indexCount() const { return live * 3; }
+    // The live triangles
+    std::vector<GLuint> indices() const;
+    // A collapse for every edge still in the mesh (in whichever direction is cheaper), cheapest first
+    std::vector<Collapse> candidates() const;
+    // Makes a collapse, unless it would tear a split open or flip a triangle over (then it returns false)
+    bool collapse(const Collapse& collapse);
+
+private:
+    std::vector<glm::dvec3> positions;
+    // First vertex at each vertex's position, and the next vertex at it (a circular list through each group)
+    std::vector<GLuint> group;
+    std::vector<GLuint> nextSibling;
+
+    std::vector<GLuint> triangles;
+    std::vector<bool> alive;
+    size_t live = 0;
+    // Triangles each vertex has been in (entries go stale as triangles die or move off the vertex)
+    std::vector<std::vector<unsigned int>> adjacency;
+
+    // Per group, indexed by its first vertex
+    std::vector<Quadric> quadrics;
+    std::vector<bool> locked;
+
+    bool uses(unsigned int triangle, GLuint vertex) const;
+    // Whether a vertex is still part of a live triangle
+    bool inUse(GLuint vertex) const;
+    // The vertex of group to that shares an edge with vertex, or -1 if there's none
+    long partner(GLuint vertex, GLuint to) const;
+    // Whether moving vertex onto target would turn one of its triangles over
+    bool flips(GLuint vertex, GLuint to, const glm::dvec3& target) const;
+};
+
+Simplifier::Simplifier(std::span<const Vertex> vertices, std::span<const GLuint> indices)
+{
+    size_t vertexCount = vertices.size();
+    positions.resize(vertexCount);
+    group.resize(vertexCount);
+    nextSibling.resize(vertexCount);
+    std::unordered_map<std::string_view, GLuint> firstAt;
+    firstAt.reserve(vertexCount);
+    for (size_t i = 0; i < vertexCount; i++)
+    {
+        positions[i] = glm::dvec3(vertices[i].position);
+        std::string_view key(reinterpret_cast<const char*>(&vertices[i].position), sizeof(glm::vec3));
+        GLuint first = firstAt.emplace(key, GLuint(i)).first->second;
+        group[i] = first;
+        nextSibling[i] = nextSibling[first];
+        nextSibling[first] = i;
+    }
+
+    // Triangles that are already degenerate are dropped straight away
+    triangles.assign(indices.begin(), indices.end());
+    size_t triangleCount = triangles.size() / 3;
+    alive.assign(triangleCount, false);
+    adjacency.resize(vertexCount);
+    quadrics.resize(vertexCount);
+    locked.assign(vertexCount, false);
+    std::unordered_map<uint64_t, unsigned int> edgeUses;
+    for (size_t t = 0; t < triangleCount; t++)
+    {
+        const GLuint* corners = &triangles[t * 3];
+        GLuint groups[3] = {group[corners[0]], group[corners[1]], group[corners[2]]};
+        if (groups[0] == groups[1] || groups[1] == groups[2] || groups[0] == groups[2])
+        {
+            continue;
+        }
+        alive[t] = true;
+        live++;
+
+        // Each group starts with the planes of the triangles around it
+        glm::dvec3 normal = glm::cross(positions[corners[1]] - positions[corners[0]], positions[corners[2]] - positions[corners[0]]);
+        double length = glm::length(normal);
+        for (int c = 0; c < 3; c++)
+        {
+            adjacency[corners[c]].push_back(t);
+            if (length > 0.0)
+            {
+                quadrics[groups[c]].addPlane(normal / length, positions[corners[0]], length * 0.5);
+            }
+            GLuint a = std::min(groups[c], groups[(c + 1) % 3]);
+            GLuint b = std::max(groups[c], groups[(c + 1) % 3]);
+            edgeUses[(uint64_t(a) << 32) | b]++;
+        }
+    }
+
+    // An edge only one triangle uses is on an open border, and its ends stay put so the outline doesn't erode
+    for (const auto& [edge, count] : edgeUses)
+    {
+        if (count == 1)
+        {
+            locked[edge >> 32] = true;
+            locked[edge & 0xffffffffu] = true;
+        }
+    }
+}
+
+std::vector<GLuint> Simplifier::indices() const
+{
+    std::vector<GLuint> result;
+    result.reserve(live * 3);
+    for (size_t t = 0; t < alive.size(); t++)
+    {
+        if (alive[t])
+        {
+            result.insert(result.end(), triangles.begin() + t * 3, triangles.begin() + t * 3 + 3);
+        }
+    }
+    return result;
+}
+
+std::vector<Collapse> Simplifier::candidates() const
+{
+    std::vector<uint64_t> edges;
+    edges.reserve(live * 3);
+    for (size_t t = 0; t < alive.size(); t++)
+    {
+        if (!alive[t])
+        {
+            continue;
+        }
+        for (int c = 0; c < 3; c++)
+        {
+            GLuint a = group[triangles[t * 3 + c]];
+            GLuint b = group[triangles[t * 3 + (c + 1) % 3]];
+            edges.push_back((uint64_t(std::min(a, b)) << 32) | std::max(a, b));
+        }
+    }
+    std::sort(edges.begin(), edges.end());
+    edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+    // The cost of moving a onto b is how far b is from the planes a has gathered
+    std::vector<Collapse> result;
+    result.reserve(edges.size());
+    for (uint64_t edge : edges)
+    {
+        GLuint a = GLuint(edge >> 32);
+        GLuint b = GLuint(edge & 0xffffffffu);
+        double costAB = locked[a] ? HUGE_VAL : quadrics[a].error(positions[b]);
+        double costBA = locked[b] ? HUGE_VAL : quadrics[b].error(positions[a]);
+        if (costAB == HUGE_VAL && costBA == HUGE_VAL)
+        {
+            continue;
+        }
+        result.push_back(costAB <= costBA ? Collapse{a, b, costAB} : Collapse{b, a, costBA});
+    }
+    std::sort(result.begin(), result.end(), [](const Collapse& x, const Collapse& y) { return x.cost < y.cost; });
+    return result;
+}
+
+bool Simplifier::uses(unsigned int triangle, GLuint vertex) const
+{
+    return alive[triangle] && (triangles[triangle * 3] == vertex || triangles[triangle * 3 + 1] == vertex || triangles[triangle * 3 + 2] == vertex);
+}
+
+bool Simplifier::inUse(GLuint vertex) const
+{
+    return std::any_of(adjacency[vertex].begin(), adjacency[vertex].end(), [&](unsigned int t) { return uses(t, vertex); });
+}
+
+long Simplifier::partner(GLuint vertex, GLuint to) const
+{
+    for (unsigned int t : adjacency[vertex])
+    {
+        if (!uses(t, vertex))
+        {
+            continue;
+        }
+        for (int c = 0; c < 3; c++)
+        {
+            if (group[triangles[t * 3 + c]] == to)
+            {
+                return triangles[t * 3 + c];
+            }
+        }
+    }
+    return -1;
+}
+
+bool Simplifier::flips(GLuint vertex, GLuint to, const glm::dvec3& target) const
+{
+    for (unsigned int t : adjacency[vertex])
+    {
+        if (!uses(t, vertex))
+        {
+            continue;
+        }
+        const GLuint* corners = &triangles[t * 3];
+        glm::dvec3 before[3];
+        glm::dvec3 after[3];
+        bool collapses = false;
+        for (int c = 0; c < 3; c++)
+        {
+            collapses = collapses || group[corners[c]] == to;
+            before[c] = positions[corners[c]];
+            after[c] = corners[c] == vertex ? target : before[c];
+        }
+        // Triangles on the collapsing edge disappear, so it doesn't matter which way they'd face
+        if (collapses)
+        {
+            continue;
+        }
+        glm::dvec3 normalBefore = glm::cross(before[1] - before[0], before[2] - before[0]);
+        glm::dvec3 normalAfter = glm::cross(after[1] - after[0], after[2] - after[0]);
+        // Turning by more than about 75 degrees counts as flipping (it folds the surface over, or nearly does)
+        if (glm::dot(normalBefore, normalAfter) < 0.25 * glm::length(normalBefore) * glm::length(normalAfter))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Simplifier::collapse(const Collapse& collapse)
+{
+    // Every vertex at from's position that's still used needs a vertex at to's position along one of its edges to move onto
+    // (the matching side of the split), otherwise the collapse would pull the two sides of a seam apart
+    std::vector<std::pair<GLuint, GLuint>> moves;
+    GLuint vertex = collapse.from;
+    do
+    {
+        if (inUse(vertex))
+        {
+            long target = partner(vertex, collapse.to);
+            if (target < 0 || flips(vertex, collapse.to, positions[collapse.to]))
+            {
+                return false;
+            }
+            moves.emplace_back(vertex, GLuint(target));
+        }
+        vertex = nextSibling[vertex];
+    } while (vertex != collapse.from);
+
+    if (moves.empty())
+    {
+        return false;
+    }
+
+    for (const auto& [from, to] : moves)
+    {
+        for (unsigned int t : adjacency[from])
+        {
+            if (!uses(t, from))
+            {
+                continue;
+            }
+            GLuint* corners = &triangles[t * 3];
+            for (int c = 0; c < 3; c++)
+            {
+                if (corners[c] == from)
+                {
+                    corners[c] = to;
+                }
+            }
+            // Triangles that had both ends of the edge now have two corners at one position
+            if (group[corners[0]] == group[corners[1]] || group[corners[1]] == group[corners[2]] || group[corners[0]] == group[corners[2]])
+            {
+                alive[t] = false;
+                live--;
+            }
+            else
+            {
+                adjacency[to].push_back(t);
+            }
+        }
+        adjacency[from].clear();
+    }
+
+    // What's left of the surface near from now hangs off to, so its planes go along
+    quadrics[collapse.to].add(quadrics[collapse.from]);
+    return true;
+}
+}
+
+namespace MeshSimplifier
+{
+// Simplifies a mesh down to each target index count in turn
+std::vector<Level> simplify(std::span<const Vertex> vertices, std::span<const GLuint> indices,
+                            std::span<const size_t> targetIndexCounts, float maxError)
+{
+    std::vector<Level> levels;
+    if (indices.empty() || indices.size() % 3 != 0 || targetIndexCounts.empty())
+    {
+        return levels;
+    }
+
+    Simplifier mesh(vertices, indices);
+    double maxCost = double(maxError) * double(maxError);
+    double reached = 0.0;
+    size_t lastCount = indices.size();
+    size_t target = 0;
+
+    auto record = [&]() {
+        Level level;
+        level.indices = mesh.indices();
+        level.error = float(std::sqrt(reached));
+        lastCount = level.indices.size();
+        levels.push_back(std::move(level));
+    };
+
+    // Each pass gathers every edge and collapses them cheapest first, but touches each group only once, since a
+    // collapse changes the cost of the edges around it. A pass stops as soon as the mesh gets down to the next target
+    while (target < targetIndexCounts.size())
+    {
+        std::vector<Collapse> candidates = mesh.candidates();
+        std::vector<bool> touched(vertices.size(), false);
+        size_t collapsed = 0;
+        for (const Collapse& candidate : candidates)
+        {
+            if (candidate.cost > maxCost || mesh.indexCount() <= targetIndexCounts[target])
+            {
+                break;
+            }
+            if (touched[candidate.from] || touched[candidate.to] || !mesh.collapse(candidate))
+            {
+                continue;
+            }
+            touched[candidate.from] = true;
+            touched[candidate.to] = true;
+            reached = std::max(reached, candidate.cost);
+            collapsed++;
+        }
+
+        if (mesh.indexCount() <= targetIndexCounts[target])
+        {
+            record();
+            while (target < targetIndexCounts.size() && mesh.indexCount() <= targetIndexCounts[target])
+            {
+                target++;
+            }
+        }
+        else if (collapsed == 0)
+        {
+            break;
+        }
+    }
+
+    // Ran out of collapses under maxError before the last target: keep what it got to if it saves at least a fifth
+    if (target < targetIndexCounts.size() && mesh.indexCount() * 5 <= lastCount * 4)
+    {
+        record();
+    }
+    return levels;
+}
+}
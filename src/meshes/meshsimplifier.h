@@ -0,0 +1,27 @@
+#pragma once
+
+#include "utils/vbo.h"
+#include <cstddef>
+#include <span>
+#include <vector>
+
+// Quadric error mesh simplification (Garland and Heckbert 1997), used to build levels of detail at load/bake time
+// Every edge collapse moves one vertex onto another, so the simplified index lists still index the original vertices
+// and all of a mesh's levels can share its vertex buffer. Vertices split by attribute (UV seams, hard edges) only
+// collapse along the split, and open borders stay where they are, so the levels don't tear or shrink
+namespace MeshSimplifier
+{
+// One simplified triangle list, and how far (in model units) its surface can be from the original
+struct Level
+{
+    std::vector<GLuint> indices;
+    float error = 0.0f;
+};
+
+// Collapses edges cheapest first, recording a level each time the index count falls to the next of targetIndexCounts
+// (largest first). Collapses that would move the surface by more than maxError aren't made, so it can return fewer
+// levels than there are targets: if it runs out before reaching them all, the last level is whatever it got down to,
+// as long as that's noticeably smaller than the level before it
+std::vector<Level> simplify(std::span<const Vertex> vertices, std::span<const GLuint> indices,
+                            std::span<const size_t> targetIndexCounts, float maxError);
+}
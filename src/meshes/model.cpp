@@ -30,382 +30,252 @@ Model::Model(const char* file, unsigned int instances, std::vector<glm::mat4> in
 }
 
 void Model::loadModel(const char* file, unsigned int instances, std::vector<glm::mat4> instanceMatrix) {
-    // If the model has already been instantiated, clear the existing data
-    if (instantiated) {
+    // A file that failed to load gets another try
+    if (asset != nullptr && asset->failed) {
+        asset.reset();
+    }
+
+    // If the model has already been instantiated (or is loading), clear the existing data
+    if (instantiated || asset != nullptr) {
         // NOTE: Change this at some point
         // We can also use this call to change the instances and instance matrices used by this model
         updateInstances(instances, instanceMatrix);
         return;
     }
 
-    // Make a JSON object
-    std::string text = get_file_contents(file);
-    JSON = json::parse(text);
-
-    // Get the binary data
-    Model::file = file;
-    data = getData();
-
     Model::instances = instances;
     Model::instanceMatrix = instanceMatrix;
 
-    // Traverse all nodes
-    traverseNode(0);
+    // Reuse the geometry and textures if another model already loaded this file, otherwise load them ourselves
+    // The asset is only kept (and shared) once it's loaded, so a file that throws can be tried again
+    std::string key = AssetCache::canonicalPath(file);
+    std::shared_ptr<ModelAsset> loaded = AssetCache::findModel(key);
+    if (loaded == nullptr || loaded->failed)
+    {
+        loaded = std::make_shared<ModelAsset>();
+        loadAsset(*loaded, file);
+        AssetCache::storeModel(key, loaded);
+    }
+    asset = loaded;
 
-    // Mark this model as being instantiated
-    instantiated = true;
+    // The file might still be loading in the background for another model, in which case Draw finishes this later
+    isLoaded();
 }
 
-// Function to update the instance matrices (give a new set of instance matrices)
-void Model::updateInstances(unsigned int new_instances, std::vector<glm::mat4> newInstanceMatrix) {
-    if (!instantiated) {
-        return;
+void Model::loadModelAsync(ModelLoader& loader, const char* file, unsigned int instances, std::vector<glm::mat4> instanceMatrix) {
+    // A file that failed to load gets another try
+    if (asset != nullptr && asset->failed) {
+        asset.reset();
     }
 
-    // Update the fields of this Model, then update the fields of its associated meshes
-    Model::instances = new_instances;
-    Model::instanceMatrix = newInstanceMatrix;
-
-    // Update every mesh
-    for (int i = 0; i < meshes.size(); i++) {
-        meshes[i].updateInstances(new_instances, newInstanceMatrix);
+    // Same as loadModel: a model that's already loaded (or loading) just takes the new instances
+    if (instantiated || asset != nullptr) {
+        updateInstances(instances, instanceMatrix);
+        return;
     }
-}
 
-// Function to cleanup all associated OpenGL data
-void Model::cleanup() {
-    // Cleanup associated mesh data
-    for (int i = 0; i < meshes.size(); i++) {
-        meshes[i].cleanup();
-    }
-    meshes.clear();
+    Model::instances = instances;
+    Model::instanceMatrix = instanceMatrix;
 
-    // Cleanup associated texture data
-    for (int i = 0; i < loadedTex.size(); i++) {
-        loadedTex[i].Delete();
-    }
-    loadedTex.clear();
-    loadedTexName.clear();
+    // The loader hands back the shared asset straight away, and fills it in over the next few frames
+    asset = loader.request(file);
+    isLoaded();
 }
 
-// NOTE: Also requires camera and light data to be passed in first
-void Model::Draw(Shader& shader, glm::vec3 translation, glm::quat rotation, glm::vec3 scale)
-{
-    // Do not draw model if data hasn't been loaded yet
-    if (!instantiated) {
-        return;
+// Whether the model has been uploaded and can actually be drawn (builds the meshes the first time it can)
+bool Model::isLoaded() {
+    if (!instantiated && asset != nullptr && asset->ready) {
+        createMeshes();
     }
+    return instantiated;
+}
 
-    // Go over all meshes and draw each one
-    for (unsigned int i = 0; i < meshes.size(); i++)
+// Builds this model's meshes (its own VAOs and instance buffers) on top of the shared geometry
+void Model::createMeshes() {
+    for (unsigned int i = 0; i < asset->geometry.size(); i++)
     {
-        meshes[i].Mesh::Draw(shader, matricesMeshes[i], translation, rotation, scale);
+        meshes.push_back(Mesh(asset->geometry[i], instances, instanceMatrix));
     }
-}
 
-void Model::loadMesh(unsigned int indMesh)
-{
-    // Get all accessor indices
-    unsigned int posAccInd = JSON["meshes"][indMesh]["primitives"][0]["attributes"]["POSITION"];
-    unsigned int normalAccInd = JSON["meshes"][indMesh]["primitives"][0]["attributes"]["NORMAL"];
-    unsigned int texAccInd = JSON["meshes"][indMesh]["primitives"][0]["attributes"]["TEXCOORD_0"];
-    unsigned int indAccInd = JSON["meshes"][indMesh]["primitives"][0]["indices"];
-
-    // Use accessor indices to get all vertices components
-    std::vector<float> posVec = getFloats(JSON["accessors"][posAccInd]);
-    std::vector<glm::vec3> positions = groupFloatsVec3(posVec);
-    std::vector<float> normalVec = getFloats(JSON["accessors"][normalAccInd]);
-    std::vector<glm::vec3> normals = groupFloatsVec3(normalVec);
-    std::vector<float> texVec = getFloats(JSON["accessors"][texAccInd]);
-    std::vector<glm::vec2> texUVs = groupFloatsVec2(texVec);
-
-    // Combine all the vertex components and also get the indices and textures
-    std::vector<Vertex> vertices = assembleVertices(positions, normals, texUVs);
-    std::vector<GLuint> indices = getIndices(JSON["accessors"][indAccInd]);
-    std::vector<Texture> textures = getTextures();
-
-    // Combine the vertices, indices, and textures into a mesh
-    meshes.push_back(Mesh(vertices, indices, textures, instances, instanceMatrix));
+    // Mark this model as being instantiated
+    instantiated = true;
 }
 
-void Model::traverseNode(unsigned int nextNode, glm::mat4 matrix)
+// Decodes the file (from its .ymesh bake when that's up to date) and uploads its meshes and textures into target
+void Model::loadAsset(ModelAsset& target, const char* file)
 {
-    // Current node
-    json node = JSON["nodes"][nextNode];
+    ModelData data;
+    data.load(file);
 
-    // Get translation if it exists
-    glm::vec3 translation = glm::vec3(0.0f, 0.0f, 0.0f);
-    if (node.find("translation") != node.end())
+    // Upload the textures and the materials using them, then the vertices and indices
+    for (unsigned int i = 0; i < data.textures.size(); i++)
     {
-        float transValues[3];
-        for (unsigned int i = 0; i < node["translation"].size(); i++)
-            transValues[i] = (node["translation"][i]);
-        translation = glm::make_vec3(transValues);
+        target.uploadTexture(data.textures[i]);
     }
-    // Get quaternion if it exists
-    glm::quat rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
-    if (node.find("rotation") != node.end())
+    for (unsigned int i = 0; i < data.materials.size(); i++)
     {
-        float rotValues[4] =
-            {
-                node["rotation"][3],
-                node["rotation"][0],
-                node["rotation"][1],
-                node["rotation"][2]
-            };
-        rotation = glm::make_quat(rotValues);
+        target.uploadMaterial(data.materials[i]);
     }
-    // Get scale if it exists
-    glm::vec3 scale = glm::vec3(1.0f, 1.0f, 1.0f);
-    if (node.find("scale") != node.end())
+    for (unsigned int i = 0; i < data.meshes.size(); i++)
     {
-        float scaleValues[3];
-        for (unsigned int i = 0; i < node["scale"].size(); i++)
-            scaleValues[i] = (node["scale"][i]);
-        scale = glm::make_vec3(scaleValues);
+        target.uploadMesh(data, data.meshes[i]);
     }
-    // Get matrix if it exists
-    glm::mat4 matNode = glm::mat4(1.0f);
-    if (node.find("matrix") != node.end())
-    {
-        float matValues[16];
-        for (unsigned int i = 0; i < node["matrix"].size(); i++)
-            matValues[i] = (node["matrix"][i]);
-        matNode = glm::make_mat4(matValues);
-    }
-
-    // Initialize matrices
-    glm::mat4 trans = glm::mat4(1.0f);
-    glm::mat4 rot = glm::mat4(1.0f);
-    glm::mat4 sca = glm::mat4(1.0f);
-
-    // Use translation, rotation, and scale to change the initialized matrices
-    trans = glm::translate(trans, translation);
-    rot = glm::mat4_cast(rotation);
-    sca = glm::scale(sca, scale);
+    target.finish();
 
-    // Multiply all matrices together
-    glm::mat4 matNextNode = matrix * matNode * trans * rot * sca;
-
-    // Check if the node contains a mesh and if it does load it
-    if (node.find("mesh") != node.end())
-    {
-        translationsMeshes.push_back(translation);
-        rotationsMeshes.push_back(rotation);
-        scalesMeshes.push_back(scale);
-        matricesMeshes.push_back(matNextNode);
+    // data goes out of scope here, which unmaps the files
+}
 
-        loadMesh(node["mesh"]);
-    }
+// Function to update the instance matrices (give a new set of instance matrices)
+void Model::updateInstances(unsigned int new_instances, std::vector<glm::mat4> newInstanceMatrix) {
+    // Update the fields of this Model, then update the fields of its associated meshes
+    // (a model that's still loading has no meshes yet, and builds them from these fields once it's ready)
+    Model::instances = new_instances;
+    Model::instanceMatrix = newInstanceMatrix;
 
-    // Check if the node has children, and if it does, apply this function to them with the matNextNode
-    if (node.find("children") != node.end())
-    {
-        for (unsigned int i = 0; i < node["children"].size(); i++)
-            traverseNode(node["children"][i], matNextNode);
+    // Update every mesh
+    for (int i = 0; i < meshes.size(); i++) {
+        meshes[i].updateInstances(new_instances, newInstanceMatrix);
     }
 }
 
-std::vector<unsigned char> Model::getData()
-{
-    // Create a place to store the raw text, and get the uri of the .bin file
-    std::string bytesText;
-    std::string uri = JSON["buffers"][0]["uri"];
+// Function to cleanup all associated OpenGL data
+void Model::cleanup() {
+    // Cleanup associated mesh data
+    for (int i = 0; i < meshes.size(); i++) {
+        meshes[i].cleanup();
+    }
+    meshes.clear();
 
-    // Store raw text data into bytesText
-    std::string fileStr = std::string(file);
-    std::string fileDirectory = fileStr.substr(0, fileStr.find_last_of('/') + 1);
-    bytesText = get_file_contents((fileDirectory + uri).c_str());
+    // Let go of the shared geometry and textures (they're deleted once no other model is using them)
+    asset.reset();
+    instantiated = false;
+}
 
-    // Transform the raw text data into bytes and put them in a vector
-    std::vector<unsigned char> data(bytesText.begin(), bytesText.end());
-    return data;
+// Draws through the asset's batch with this shader from now on (when the model can be batched)
+void Model::setBatchShader(Shader* shader) {
+    batchShader = shader;
 }
 
-std::vector<float> Model::getFloats(json accessor)
+// NOTE: Also requires camera and light data to be passed in first
+void Model::Draw(RenderQueue& queue, Shader& shader, glm::vec3 translation, glm::quat rotation, glm::vec3 scale, bool viewSpace)
 {
-    std::vector<float> floatVec;
-
-    // Get properties from the accessor
-    unsigned int buffViewInd = accessor.value("bufferView", 1);
-    unsigned int count = accessor["count"];
-    unsigned int accByteOffset = accessor.value("byteOffset", 0);
-    std::string type = accessor["type"];
-
-    // Get properties from the bufferView
-    json bufferView = JSON["bufferViews"][buffViewInd];
-    unsigned int byteOffset = bufferView["byteOffset"];
-
-    // Interpret the type and store it into numPerVert
-    unsigned int numPerVert;
-    if (type == "SCALAR") numPerVert = 1;
-    else if (type == "VEC2") numPerVert = 2;
-    else if (type == "VEC3") numPerVert = 3;
-    else if (type == "VEC4") numPerVert = 4;
-    else throw std::invalid_argument("Type is invalid (not SCALAR, VEC2, VEC3, or VEC4)");
-
-    // Go over all the bytes in the data at the correct place using the properties from above
-    unsigned int beginningOfData = byteOffset + accByteOffset;
-    unsigned int lengthOfData = count * 4 * numPerVert;
-    for (unsigned int i = beginningOfData; i < beginningOfData + lengthOfData; i)
+    // Do not draw model if data hasn't been loaded yet
+    if (!isLoaded()) {
+        return;
+    }
+    drawTranslation = translation;
+    drawRotation = rotation;
+    drawScale = scale;
+
+    // Throw away the meshes outside the view, and pick the levels of the rest (the shader's model matrix is the
+    // mesh's matrix * T * R * S)
+    // Instanced models are all drawn, since it's their instances that are spread out rather than their meshes, and
+    // the instances are culled right away (on the GPU), before anything is submitted
+    // A model placed relative to the camera (viewSpace) is always in front of it, so it isn't culled, and its levels
+    // are picked as seen from the origin of view space
+    glm::mat4 transform = glm::translate(glm::mat4(1.0f), translation) * glm::mat4_cast(rotation) * glm::scale(glm::mat4(1.0f), scale);
+    Lod::View view = Lod::view;
+    if (viewSpace)
     {
-        unsigned char bytes[] = { data[i++], data[i++], data[i++], data[i++] };
-        float value;
-        std::memcpy(&value, bytes, sizeof(float));
-        floatVec.push_back(value);
+        view.cameraPosition = glm::vec3(0.0f);
     }
-
-    return floatVec;
-}
-
-std::vector<GLuint> Model::getIndices(json accessor)
-{
-    std::vector<GLuint> indices;
-
-    // Get properties from the accessor
-    unsigned int buffViewInd = accessor.value("bufferView", 0);
-    unsigned int count = accessor["count"];
-    unsigned int accByteOffset = accessor.value("byteOffset", 0);
-    unsigned int componentType = accessor["componentType"];
-
-    // Get properties from the bufferView
-    json bufferView = JSON["bufferViews"][buffViewInd];
-    unsigned int byteOffset = bufferView["byteOffset"];
-
-    // Get indices with regards to their type: unsigned int, unsigned short, or short
-    unsigned int beginningOfData = byteOffset + accByteOffset;
-    if (componentType == 5125)
+    if (instances == 1 && viewSpace)
     {
-        for (unsigned int i = beginningOfData; i < byteOffset + accByteOffset + count * 4; i)
+        meshVisible.assign(meshes.size(), 1);
+        for (unsigned int i = 0; i < meshes.size(); i++)
         {
-            unsigned char bytes[] = { data[i++], data[i++], data[i++], data[i++] };
-            unsigned int value;
-            std::memcpy(&value, bytes, sizeof(unsigned int));
-            indices.push_back((GLuint)value);
+            meshes[i].selectLod(view, asset->matricesMeshes[i] * transform);
         }
     }
-    else if (componentType == 5123)
+    else if (instances == 1)
     {
-        for (unsigned int i = beginningOfData; i < byteOffset + accByteOffset + count * 2; i)
+        meshBoxes.clear();
+        for (unsigned int i = 0; i < meshes.size(); i++)
         {
-            unsigned char bytes[] = { data[i++], data[i++] };
-            unsigned short value;
-            std::memcpy(&value, bytes, sizeof(unsigned short));
-            indices.push_back((GLuint)value);
+            const MeshGeometry& geometry = *meshes[i].geometry;
+            meshBoxes.add(asset->matricesMeshes[i] * transform, geometry.center, geometry.extent);
+        }
+        Culling::cull(Culling::frustum, meshBoxes, meshVisible);
+        for (unsigned int i = 0; i < meshes.size(); i++)
+        {
+            if (meshVisible[i])
+            {
+                meshes[i].selectLod(view, asset->matricesMeshes[i] * transform);
+            }
         }
     }
-    else if (componentType == 5122)
+    else
     {
-        for (unsigned int i = beginningOfData; i < byteOffset + accByteOffset + count * 2; i)
+        meshVisible.assign(meshes.size(), 1);
+        for (unsigned int i = 0; i < meshes.size(); i++)
         {
-            unsigned char bytes[] = { data[i++], data[i++] };
-            short value;
-            std::memcpy(&value, bytes, sizeof(short));
-            indices.push_back((GLuint)value);
+            meshes[i].cullInstances();
         }
     }
 
-    return indices;
-}
-
-std::vector<Texture> Model::getTextures()
-{
-    std::vector<Texture> textures;
-
-    std::string fileStr = std::string(file);
-    std::string fileDirectory = fileStr.substr(0, fileStr.find_last_of('/') + 1);
+    // Sorted front to back by how far the model is from the camera (the one the levels of detail were picked for)
+    float distance = instances == 1 ? glm::length(view.cameraPosition - translation) : 0.0f;
 
-    // Go over all images
-    for (unsigned int i = 0; i < JSON["images"].size(); i++)
+    // All meshes sharing a material go out in one draw, with the transform applied to every mesh as a uniform
+    if (instances == 1 && batchShader != nullptr && asset->batch.built())
     {
-        // uri of current texture
-        std::string texPath = JSON["images"][i]["uri"];
-
-        // Check if the texture has already been loaded
-        bool skip = false;
-        for (unsigned int j = 0; j < loadedTexName.size(); j++)
+        size_t runs = asset->batch.gather(*asset, meshVisible, meshes, batchRuns);
+        for (unsigned int r = 0; r < runs; r++)
         {
-            if (loadedTexName[j] == texPath)
-            {
-                textures.push_back(loadedTex[j]);
-                skip = true;
-                break;
-            }
+            RenderQueue::Packet packet;
+            packet.shader = batchShader;
+            packet.vao = asset->batch.vao();
+            packet.material = &asset->materials[batchRuns[r].material];
+            packet.doubleSided = batchRuns[r].mirrored;
+            packet.draw = &Model::drawBatchRun;
+            packet.object = this;
+            packet.index = r;
+            queue.push(RenderQueue::Pass::Opaque, packet, distance);
         }
+        return;
+    }
 
-        // If the texture has been loaded, skip this
-        if (!skip)
+    // Otherwise every mesh is its own draw (the queue groups them by material)
+    for (unsigned int i = 0; i < meshes.size(); i++)
+    {
+        if (!meshVisible[i])
         {
-            // Load diffuse texture
-            if (texPath.find("baseColor") != std::string::npos || texPath.find("diffuse") != std::string::npos)
-            {
-                Texture diffuse = Texture((fileDirectory + texPath).c_str(), "diffuse", loadedTex.size());
-                textures.push_back(diffuse);
-                loadedTex.push_back(diffuse);
-                loadedTexName.push_back(texPath);
-            }
-            // Load specular texture
-            else if (texPath.find("metallicRoughness") != std::string::npos || texPath.find("specular") != std::string::npos)
-            {
-                Texture specular = Texture((fileDirectory + texPath).c_str(), "specular", loadedTex.size());
-                textures.push_back(specular);
-                loadedTex.push_back(specular);
-                loadedTexName.push_back(texPath);
-            }
+            continue;
         }
+        RenderQueue::Packet packet;
+        packet.shader = &shader;
+        packet.vao = meshes[i].VAO.ID;
+        packet.material = &asset->materials[asset->meshMaterials[i]];
+        // A mirrored mesh has its faces turned around, so it's drawn with both sides rather than the wrong one culled
+        packet.doubleSided = glm::determinant(glm::mat3(asset->matricesMeshes[i])) < 0.0f;
+        packet.draw = &Model::drawMesh;
+        packet.object = this;
+        packet.index = i;
+        queue.push(RenderQueue::Pass::Opaque, packet, distance);
     }
-
-    return textures;
 }
 
-std::vector<Vertex> Model::assembleVertices
-    (
-        std::vector<glm::vec3> positions,
-        std::vector<glm::vec3> normals,
-        std::vector<glm::vec2> texUVs
-        )
+// Only the rotation changes, so what was culled and the levels picked stay as they were
+void Model::setDrawRotation(glm::quat rotation)
 {
-    std::vector<Vertex> vertices;
-    for (int i = 0; i < positions.size(); i++)
-    {
-        vertices.push_back
-            (
-                Vertex
-                {
-                    positions[i],
-                    normals[i],
-                    glm::vec3(1.0f, 1.0f, 1.0f),
-                    texUVs[i]
-                }
-                );
-    }
-    return vertices;
+    drawRotation = rotation;
 }
 
-std::vector<glm::vec2> Model::groupFloatsVec2(std::vector<float> floatVec)
-{
-    std::vector<glm::vec2> vectors;
-    for (int i = 0; i < floatVec.size(); i)
-    {
-        vectors.push_back(glm::vec2(floatVec[i++], floatVec[i++]));
-    }
-    return vectors;
-}
-std::vector<glm::vec3> Model::groupFloatsVec3(std::vector<float> floatVec)
+// Draws one mesh where the last Draw placed the model
+void Model::drawMesh(const RenderQueue::Packet& packet)
 {
-    std::vector<glm::vec3> vectors;
-    for (int i = 0; i < floatVec.size(); i)
-    {
-        vectors.push_back(glm::vec3(floatVec[i++], floatVec[i++], floatVec[i++]));
-    }
-    return vectors;
+    Model& model = *static_cast<Model*>(packet.object);
+    model.meshes[packet.index].Mesh::Draw(*packet.shader, model.asset->matricesMeshes[packet.index], model.drawTranslation, model.drawRotation, model.drawScale);
 }
-std::vector<glm::vec4> Model::groupFloatsVec4(std::vector<float> floatVec)
+
+// Draws one multi-draw of the batch where the last Draw placed the model
+void Model::drawBatchRun(const RenderQueue::Packet& packet)
 {
-    std::vector<glm::vec4> vectors;
-    for (int i = 0; i < floatVec.size(); i)
-    {
-        vectors.push_back(glm::vec4(floatVec[i++], floatVec[i++], floatVec[i++], floatVec[i++]));
-    }
-    return vectors;
+    Model& model = *static_cast<Model*>(packet.object);
+    Shader& shader = *packet.shader;
+    shader.setMat4("translation", glm::translate(glm::mat4(1.0f), model.drawTranslation));
+    shader.setMat4("rotation", glm::mat4_cast(model.drawRotation));
+    shader.setMat4("scale", glm::scale(glm::mat4(1.0f), model.drawScale));
+    model.asset->batch.bind(shader);
+    ModelBatch::draw(model.batchRuns[packet.index]);
 }
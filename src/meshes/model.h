@@ -2,7 +2,12 @@
 
 #include"utils/debug.h"
 #include"libraries/include/json/json.h"
+#include"meshes/modeldata.h"
 #include"Mesh.h"
+#include"meshes/assetcache.h"
+#include"meshes/modelloader.h"
+#include"utils/culling.h"
+#include"utils/renderqueue.h"
 
 using json = nlohmann::json;
 
@@ -16,71 +21,79 @@ public:
     // Constructor if we already have loaded data
     Model(const char* file, unsigned int instancing = 1, std::vector<glm::mat4> instanceMatrix = {});
 
-    // Loads in a model from a file and stores tha information in 'data', 'JSON', and 'file'
+    // Loads in a model from a .gltf or .glb file, uploads it to the GPU and then lets go of the file data
     void loadModel(const char* file, unsigned int instances = 1, std::vector<glm::mat4> instanceMatrix = {});
 
+    // Same as loadModel, but the file is decoded on the loader's worker threads and uploaded a bit each frame
+    // The model draws nothing until all of it is on the GPU
+    void loadModelAsync(ModelLoader& loader, const char* file, unsigned int instances = 1, std::vector<glm::mat4> instanceMatrix = {});
+
+    // Whether the model has been uploaded and can actually be drawn
+    bool isLoaded();
+
     // Function to update the instance matrices (say, if you want a new random allotment of stuff)
     void updateInstances(unsigned int new_instances, std::vector<glm::mat4> newInstanceMatrix);
 
+    // Uses the shader (whose vertex stage reads ModelBatch's draw data, like modelbatch.vert) to draw all meshes
+    // sharing a material in one call, rather than drawing every mesh with the shader Draw is given
+    // Only models that aren't instanced are batched, and only once their asset's batch is built (nullptr turns it off)
+    void setBatchShader(Shader* shader);
+
+    // Queues the model's visible meshes (culled, and at their levels of detail, as of now) to be drawn with shader
+    // The model has to stay put until the queue is submitted, since the draws read its meshes and placement then
+    // viewSpace is for models placed relative to the camera (like the spaceship): they aren't culled, and their
+    // levels are picked as seen from the camera at the origin
     void Draw
         (
+            RenderQueue& queue,
             Shader& shader,
             glm::vec3 translation = glm::vec3(0.0f, 0.0f, 0.0f),
             glm::quat rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f),
-            glm::vec3 scale = glm::vec3(1.0f, 1.0f, 1.0f)
+            glm::vec3 scale = glm::vec3(1.0f, 1.0f, 1.0f),
+            bool viewSpace = false
             );
+    // Turns the model after it's been queued (its draws read the rotation when the queue is submitted), without
+    // culling or queueing it again
+    void setDrawRotation(glm::quat rotation);
 
     // Frees all associated OpenGL memory with this model
-    // TODO: Implement
+    // Geometry and textures shared with other models are only freed once the last of them is cleaned up
     void cleanup();
 
 private:
-    // Variables for easy access
-    const char* file;
-    std::vector<unsigned char> data;
-    json JSON;
-
     // Determines if model has been instantiated or not (cannot be drawn otherwise)
+    // A model loading in the background already has its asset, but isn't instantiated until the asset is ready
     bool instantiated = false;
 
     // Holds number of instances (if 1 the mesh will be rendered normally)
     unsigned int instances;
 
-    // All the meshes and transformations
-    std::vector<Mesh> meshes;
-    std::vector<glm::vec3> translationsMeshes;
-    std::vector<glm::quat> rotationsMeshes;
-    std::vector<glm::vec3> scalesMeshes;
-    std::vector<glm::mat4> matricesMeshes;
-    std::vector<glm::mat4> instanceMatrix;
+    // World space bounding boxes of the meshes and which of them are in view, worked out again every Draw
+    // (kept between frames so culling doesn't allocate)
+    Culling::Boxes meshBoxes;
+    std::vector<unsigned char> meshVisible;
 
-    // Prevents textures from being loaded twice
-    std::vector<std::string> loadedTexName;
-    std::vector<Texture> loadedTex;
+    // What the meshes are drawn with when they're batched, and the multi-draws of the last Draw
+    Shader* batchShader = nullptr;
+    std::vector<ModelBatch::Run> batchRuns;
 
-    // Loads a single mesh by its index
-    void loadMesh(unsigned int indMesh);
+    // Where the last Draw placed the model (the queued draws set these as uniforms)
+    glm::vec3 drawTranslation = glm::vec3(0.0f);
+    glm::quat drawRotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+    glm::vec3 drawScale = glm::vec3(1.0f);
 
-    // Traverses a node recursively, so it essentially traverses all connected nodes
-    void traverseNode(unsigned int nextNode, glm::mat4 matrix = glm::mat4(1.0f));
+    // Geometry, textures and transformations loaded from the file (shared with every other Model using the same file)
+    std::shared_ptr<ModelAsset> asset;
 
-    // Gets the binary data from a file
-    std::vector<unsigned char> getData();
-    // Interprets the binary data into floats, indices, and textures
-    std::vector<float> getFloats(json accessor);
-    std::vector<GLuint> getIndices(json accessor);
-    std::vector<Texture> getTextures();
-
-    // Assembles all the floats into vertices
-    std::vector<Vertex> assembleVertices
-        (
-            std::vector<glm::vec3> positions,
-            std::vector<glm::vec3> normals,
-            std::vector<glm::vec2> texUVs
-            );
+    // This model's meshes, built on top of the shared geometry
+    std::vector<Mesh> meshes;
+    std::vector<glm::mat4> instanceMatrix;
 
-    // Helps with the assembly from above by grouping floats
-    std::vector<glm::vec2> groupFloatsVec2(std::vector<float> floatVec);
-    std::vector<glm::vec3> groupFloatsVec3(std::vector<float> floatVec);
-    std::vector<glm::vec4> groupFloatsVec4(std::vector<float> floatVec);
+    // Builds this model's meshes (its own VAOs and instance buffers) on top of the shared geometry once it's ready
+    void createMeshes();
+    // What the queued draws run: one mesh (index) or one multi-draw of the batch (index into batchRuns)
+    static void drawMesh(const RenderQueue::Packet& packet);
+    static void drawBatchRun(const RenderQueue::Packet& packet);
+    // Decodes the file (from its .ymesh bake when that's up to date) and uploads its meshes and textures into target
+    static void loadAsset(ModelAsset& target, const char* file);
 };
@@ -0,0 +1,231 @@
+#include "modelbatch.h"
+
+#include "meshes/assetcache.h"
+#include <algorithm>
+
+namespace
+{
+size_t indexSize(GLenum indexType)
+{
+    return indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+}
+
+// Location of aDraw (after the vertex attributes and the instance matrix)
+const GLuint drawLayout = 8;
+}
+
+// Lays the meshes out back to back, copies their buffers across on the GPU and writes the draw data
+void ModelBatch::build(const ModelAsset& asset)
+{
+    const std::vector<std::shared_ptr<MeshGeometry>>& geometry = asset.geometry;
+    if (geometry.empty())
+    {
+        return;
+    }
+
+    // Every mesh needs the same vertex layout to share a buffer, and its index has to fit in aDraw and the draw data
+    GLint maxTexels = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+    Debug::glErrorCheck();
+    const VertexFormat* format = geometry[0]->format;
+    bool sameFormat = std::all_of(geometry.begin(), geometry.end(), [&](const std::shared_ptr<MeshGeometry>& mesh) {
+        return mesh->format == format;
+    });
+    if (!sameFormat || geometry.size() > 65536 || geometry.size() * drawDataTexels > size_t(maxTexels))
+    {
+        return;
+    }
+
+    // Index runs start on 4 byte boundaries, so 32-bit indices after an odd number of 16-bit ones stay aligned
+    ranges.assign(geometry.size(), Range());
+    GLint vertexCount = 0;
+    size_t indexBytes = 0;
+    for (unsigned int i = 0; i < geometry.size(); i++)
+    {
+        ranges[i].baseVertex = vertexCount;
+        ranges[i].indexOffset = (indexBytes + 3) & ~size_t(3);
+        ranges[i].indexType = geometry[i]->indexType;
+        ranges[i].mirrored = glm::determinant(glm::mat3(asset.matricesMeshes[i])) < 0.0f;
+        vertexCount += geometry[i]->vertexCount;
+        indexBytes = ranges[i].indexOffset + geometry[i]->indexCount * indexSize(geometry[i]->indexType);
+    }
+    GLsizeiptr stride = format->stride();
+
+    // The meshes are already on the GPU, so they're copied across without coming back to the CPU
+    glGenBuffers(1, &vertices_VBO);
+    Debug::glErrorCheck();
+    glBindBuffer(GL_COPY_WRITE_BUFFER, vertices_VBO);
+    Debug::glErrorCheck();
+    glBufferData(GL_COPY_WRITE_BUFFER, vertexCount * stride, nullptr, GL_STATIC_DRAW);
+    Debug::glErrorCheck();
+    for (unsigned int i = 0; i < geometry.size(); i++)
+    {
+        glBindBuffer(GL_COPY_READ_BUFFER, geometry[i]->vertices_VBO);
+        Debug::glErrorCheck();
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, ranges[i].baseVertex * stride, geometry[i]->vertexCount * stride);
+        Debug::glErrorCheck();
+    }
+
+    glGenBuffers(1, &indices_EBO);
+    Debug::glErrorCheck();
+    glBindBuffer(GL_COPY_WRITE_BUFFER, indices_EBO);
+    Debug::glErrorCheck();
+    glBufferData(GL_COPY_WRITE_BUFFER, indexBytes, nullptr, GL_STATIC_DRAW);
+    Debug::glErrorCheck();
+    for (unsigned int i = 0; i < geometry.size(); i++)
+    {
+        glBindBuffer(GL_COPY_READ_BUFFER, geometry[i]->indices_EBO);
+        Debug::glErrorCheck();
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, ranges[i].indexOffset, geometry[i]->indexCount * indexSize(geometry[i]->indexType));
+        Debug::glErrorCheck();
+    }
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    Debug::glErrorCheck();
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    Debug::glErrorCheck();
+
+    // Every vertex is tagged with its mesh (indices stay relative to their mesh, since each draw has a base vertex)
+    std::vector<GLushort> draws(vertexCount);
+    std::vector<glm::vec4> drawData(geometry.size() * drawDataTexels);
+    for (unsigned int i = 0; i < geometry.size(); i++)
+    {
+        std::fill_n(draws.begin() + ranges[i].baseVertex, geometry[i]->vertexCount, GLushort(i));
+
+        glm::vec4* texels = &drawData[i * drawDataTexels];
+        for (int column = 0; column < 4; column++)
+        {
+            texels[column] = asset.matricesMeshes[i][column];
+        }
+        texels[4] = glm::vec4(geometry[i]->positionScale, 0.0f);
+        texels[5] = glm::vec4(geometry[i]->positionOffset, 0.0f);
+    }
+
+    glGenBuffers(1, &draws_VBO);
+    Debug::glErrorCheck();
+    glBindBuffer(GL_ARRAY_BUFFER, draws_VBO);
+    Debug::glErrorCheck();
+    glBufferData(GL_ARRAY_BUFFER, draws.size() * sizeof(GLushort), draws.data(), GL_STATIC_DRAW);
+    Debug::glErrorCheck();
+
+    glGenBuffers(1, &drawData_buffer);
+    Debug::glErrorCheck();
+    glBindBuffer(GL_TEXTURE_BUFFER, drawData_buffer);
+    Debug::glErrorCheck();
+    glBufferData(GL_TEXTURE_BUFFER, drawData.size() * sizeof(glm::vec4), drawData.data(), GL_STATIC_DRAW);
+    Debug::glErrorCheck();
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    Debug::glErrorCheck();
+    glGenTextures(1, &drawData_texture);
+    Debug::glErrorCheck();
+    glBindTexture(GL_TEXTURE_BUFFER, drawData_texture);
+    Debug::glErrorCheck();
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, drawData_buffer);
+    Debug::glErrorCheck();
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    Debug::glErrorCheck();
+
+    // Same attributes a Mesh's VAO has, plus the mesh index
+    glGenVertexArrays(1, &batch_VAO);
+    Debug::glErrorCheck();
+    glBindVertexArray(batch_VAO);
+    Debug::glErrorCheck();
+    glBindBuffer(GL_ARRAY_BUFFER, vertices_VBO);
+    Debug::glErrorCheck();
+    for (const VertexAttribute& attribute : format->attributes())
+    {
+        glVertexAttribPointer(attribute.layout, attribute.numComponents, attribute.type, attribute.normalized, stride, (void*)(uintptr_t)attribute.offset);
+        Debug::glErrorCheck();
+        glEnableVertexAttribArray(attribute.layout);
+        Debug::glErrorCheck();
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, draws_VBO);
+    Debug::glErrorCheck();
+    glVertexAttribIPointer(drawLayout, 1, GL_UNSIGNED_SHORT, sizeof(GLushort), (void*)0);
+    Debug::glErrorCheck();
+    glEnableVertexAttribArray(drawLayout);
+    Debug::glErrorCheck();
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indices_EBO);
+    Debug::glErrorCheck();
+    glBindVertexArray(0);
+    Debug::glErrorCheck();
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    Debug::glErrorCheck();
+
+    // The asset's draw order already groups meshes by material, and within a material the index types are split up
+    order = asset.drawOrder;
+    std::stable_sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b) {
+        if (asset.meshMaterials[a] != asset.meshMaterials[b])
+        {
+            return asset.meshMaterials[a] < asset.meshMaterials[b];
+        }
+        return ranges[a].indexType < ranges[b].indexType;
+    });
+}
+
+// One run per material and index type, in draw order
+size_t ModelBatch::gather(const ModelAsset& asset, const std::vector<unsigned char>& visible, const std::vector<Mesh>& meshes, std::vector<Run>& runs) const
+{
+    size_t used = 0;
+    for (unsigned int i : order)
+    {
+        if (!visible[i])
+        {
+            continue;
+        }
+        unsigned int material = asset.meshMaterials[i];
+        if (used == 0 || runs[used - 1].material != material || runs[used - 1].indexType != ranges[i].indexType)
+        {
+            if (used == runs.size())
+            {
+                runs.emplace_back();
+            }
+            Run& run = runs[used++];
+            run.material = material;
+            run.indexType = ranges[i].indexType;
+            run.mirrored = false;
+            run.counts.clear();
+            run.offsets.clear();
+            run.baseVertices.clear();
+        }
+
+        Run& run = runs[used - 1];
+        run.mirrored = run.mirrored || ranges[i].mirrored;
+        const MeshLod& level = asset.geometry[i]->lods[meshes[i].lod];
+        run.counts.push_back(level.indexCount);
+        run.offsets.push_back(reinterpret_cast<const void*>(ranges[i].indexOffset + level.firstIndex * indexSize(run.indexType)));
+        run.baseVertices.push_back(ranges[i].baseVertex);
+    }
+    return used;
+}
+
+// Binds the draw data to its unit
+void ModelBatch::bind(Shader& shader) const
+{
+    glActiveTexture(GL_TEXTURE0 + drawDataUnit);
+    Debug::glErrorCheck();
+    glBindTexture(GL_TEXTURE_BUFFER, drawData_texture);
+    Debug::glErrorCheck();
+    shader.setInt("draw_data", drawDataUnit);
+}
+
+// Every mesh of the run in one call
+void ModelBatch::draw(const Run& run)
+{
+    glMultiDrawElementsBaseVertex(GL_TRIANGLES, run.counts.data(), run.indexType, run.offsets.data(), run.counts.size(), run.baseVertices.data());
+    Debug::glErrorCheck();
+}
+
+// Deletes all associated OpenGL memory with this object
+void ModelBatch::Delete()
+{
+    glDeleteVertexArrays(1, &batch_VAO);
+    Debug::glErrorCheck();
+    GLuint buffers[] = {vertices_VBO, draws_VBO, indices_EBO, drawData_buffer};
+    glDeleteBuffers(4, buffers);
+    Debug::glErrorCheck();
+    glDeleteTextures(1, &drawData_texture);
+    Debug::glErrorCheck();
+    batch_VAO = vertices_VBO = draws_VBO = indices_EBO = drawData_buffer = drawData_texture = 0;
+    ranges.clear();
+    order.clear();
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "utils/debug.h"
+#include "utils/shader.h"
+#include <vector>
+
+struct ModelAsset;
+class Mesh;
+
+// Every mesh of a model packed into one vertex and one index buffer, so all meshes sharing a material go out in a
+// single glMultiDrawElementsBaseVertex instead of a VAO bind, uniform uploads and a draw call each
+// The meshes' own matrices and position quantization live in a buffer texture (draw data), and every vertex carries
+// the index of its mesh (aDraw) to look them up with, since GL 4.1 has neither gl_DrawID nor shader storage buffers
+// Built once per asset, so models sharing a file share the batch (their own placement stays a uniform)
+class ModelBatch
+{
+public:
+    // Texture unit the draw data is read from (after Material's units)
+    static const GLuint drawDataUnit = 2;
+    // Texels of draw data per mesh: its matrix (4 columns), then position_scale and position_offset
+    static const GLuint drawDataTexels = 6;
+
+    // Copies the meshes of a loaded asset into the shared buffers (GL thread only)
+    // Leaves the batch unbuilt if the meshes can't share buffers (different vertex formats, or more meshes than the
+    // draw data has room for)
+    void build(const ModelAsset& asset);
+    bool built() const { return batch_VAO != 0; }
+
+    // Meshes sharing a material and index type, gathered into one multi-draw
+    struct Run
+    {
+        unsigned int material = 0;
+        GLenum indexType = GL_UNSIGNED_INT;
+        // Whether any of its meshes is mirrored (which turns its faces around, so none of them are culled)
+        bool mirrored = false;
+        std::vector<GLsizei> counts;
+        std::vector<const void*> offsets;
+        std::vector<GLint> baseVertices;
+    };
+
+    // Gathers the meshes marked in visible (indexed like asset.geometry) at the level of detail each of meshes was
+    // picked at into runs, and returns how many of them it used (runs are reused from frame to frame, so they don't
+    // allocate once they've grown)
+    size_t gather(const ModelAsset& asset, const std::vector<unsigned char>& visible, const std::vector<Mesh>& meshes, std::vector<Run>& runs) const;
+    // Binds the draw data for the shader (which has to be active and read it, see modelbatch.vert)
+    void bind(Shader& shader) const;
+    // Draws a run (with the batch's vertex array and the run's material bound)
+    static void draw(const Run& run);
+
+    // Vertex array of the shared buffers
+    GLuint vao() const { return batch_VAO; }
+
+    // Deletes all associated OpenGL memory with this object
+    void Delete();
+
+private:
+    GLuint batch_VAO = 0;
+    GLuint vertices_VBO = 0;
+    GLuint draws_VBO = 0;
+    GLuint indices_EBO = 0;
+    GLuint drawData_buffer = 0;
+    GLuint drawData_texture = 0;
+
+    // Where a mesh ended up in the shared buffers
+    struct Range
+    {
+        GLint baseVertex = 0;
+        // In bytes, since meshes can have different index types
+        size_t indexOffset = 0;
+        GLenum indexType = GL_UNSIGNED_INT;
+        bool mirrored = false;
+    };
+    std::vector<Range> ranges;
+    // Mesh indices sorted by material and then index type, so every multi-draw covers a run of them
+    std::vector<unsigned int> order;
+};
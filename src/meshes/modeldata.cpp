@@ -0,0 +1,1042 @@
+#include "modeldata.h"
+#include "meshes/meshsimplifier.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <iostream>
+#include <numeric>
+#include <stdexcept>
+
+namespace
+{
+// Layout of a .ymesh file. Every section starts on a 16 byte boundary, and the mapping itself is page aligned,
+// so the vertex and index arrays can be used in place
+//   BakedHeader
+//   BakedSource[sourceCount]   files the bake was made from, to detect when it's stale
+//   BakedMesh[meshCount]
+//   BakedTexture[textureCount]
+//   BakedMaterial[materialCount]
+//   Vertex[vertexCount]
+//   GLuint[indexCount]
+//   names and embedded images (pointed at by the records above)
+// Numbers are stored in native byte order; a bake is a local cache, not an interchange format
+const char bakedMagic[4] = {'Y', 'M', 'S', 'H'};
+// Bump whenever the layout (or Vertex) changes so old caches are ignored
+const uint32_t bakedVersion = 6;
+
+struct BakedHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t vertexSize;
+    uint32_t sourceCount;
+    uint32_t meshCount;
+    uint32_t textureCount;
+    uint32_t materialCount;
+    uint64_t vertexCount;
+    uint64_t indexCount;
+    uint64_t sourcesOffset;
+    uint64_t meshesOffset;
+    uint64_t texturesOffset;
+    uint64_t materialsOffset;
+    uint64_t verticesOffset;
+    uint64_t indicesOffset;
+};
+
+struct BakedSource
+{
+    // File name relative to the .ymesh
+    uint64_t nameOffset;
+    uint64_t nameLength;
+    uint64_t size;
+    int64_t modified;
+};
+
+struct BakedLod
+{
+    uint64_t firstIndex;
+    uint64_t indexCount;
+    float error;
+    uint32_t padding;
+};
+
+struct BakedMesh
+{
+    uint64_t firstVertex;
+    uint64_t vertexCount;
+    uint64_t firstIndex;
+    uint64_t indexCount;
+    uint32_t material;
+    float translation[3];
+    float rotation[4];
+    float scale[3];
+    float matrix[16];
+    uint32_t lodCount;
+    float center[3];
+    float extent[3];
+    float radius;
+    BakedLod lods[MeshData::maxLods];
+};
+
+struct BakedTexture
+{
+    // 0 for diffuse, 1 for specular
+    uint32_t type;
+    // 1 if data is the encoded image, 0 if it's a file name relative to the .ymesh
+    uint32_t embedded;
+    uint64_t dataOffset;
+    uint64_t dataLength;
+    int32_t minFilter;
+    int32_t magFilter;
+    int32_t wrapS;
+    int32_t wrapT;
+};
+
+struct BakedMaterial
+{
+    // Indices into the textures, or -1
+    int32_t diffuse;
+    int32_t specular;
+    float baseColor[4];
+    // 1 if the material is double sided
+    uint32_t doubleSided;
+};
+
+uint64_t alignUp(uint64_t value)
+{
+    return (value + 15) & ~uint64_t(15);
+}
+
+// Directory part of a path, including the trailing '/'
+std::string directoryOf(const std::string& path)
+{
+    return path.substr(0, path.find_last_of('/') + 1);
+}
+}
+
+// Path of the baked cache that goes with a model file (scene.gltf -> scene.ymesh)
+std::string ModelData::bakedPath(const std::string& path)
+{
+    size_t slash = path.find_last_of('/');
+    size_t dot = path.find_last_of('.');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+    {
+        return path + ".ymesh";
+    }
+    return path.substr(0, dot) + ".ymesh";
+}
+
+void ModelData::load(const std::string& path)
+{
+    // The bake already holds the GPU-ready arrays, so JSON only gets parsed when it's missing or stale
+    if (!loadBaked(bakedPath(path)))
+    {
+        loadGltf(path);
+    }
+}
+
+std::vector<MeshOptimizer::Report> ModelData::loadGltf(const std::string& path)
+{
+    clear();
+    file = path;
+    fileDirectory = directoryOf(path);
+
+    // Map the file, which is either .gltf JSON text or a binary .glb container holding the JSON and the buffer
+    gltfFile = MappedFile(file);
+    sources.push_back(file);
+    std::string_view text = gltfFile.text();
+    if (isGlb(gltfFile.bytes()))
+    {
+        text = readGlbChunks(gltfFile.bytes());
+    }
+
+    // Make a JSON object straight from the mapped text
+    JSON = json::parse(text.begin(), text.end());
+
+    // Map the binary data
+    mapBuffers();
+
+    // Materials first, so primitives can refer to them as the nodes are traversed
+    loadMaterials();
+
+    // Traverse all nodes
+    traverseNode(0);
+
+    vertices = vertexStorage;
+    indices = indexStorage;
+    computeBounds();
+
+    std::vector<MeshOptimizer::Report> reports = optimize();
+    buildLods();
+
+    // Everything we need has been pulled out of the JSON (the mappings stay, embedded images live in them)
+    JSON = json();
+    return reports;
+}
+
+bool ModelData::loadBaked(const std::string& path)
+{
+    clear();
+
+    std::error_code error;
+    if (!std::filesystem::exists(path, error))
+    {
+        return false;
+    }
+
+    bakedFile = MappedFile(path);
+    std::span<const unsigned char> bytes = bakedFile.bytes();
+    std::string directory = directoryOf(path);
+
+    // Checks that [offset, offset + length) is inside the file
+    auto inFile = [&](uint64_t offset, uint64_t length) {
+        return offset <= bytes.size() && length <= bytes.size() - offset;
+    };
+    auto reject = [&](const char* reason) {
+        std::cerr << "Ignoring baked mesh " << path << ": " << reason << "\n";
+        clear();
+        return false;
+    };
+
+    if (!inFile(0, sizeof(BakedHeader)))
+    {
+        return reject("file is too small");
+    }
+    BakedHeader header;
+    std::memcpy(&header, bytes.data(), sizeof(BakedHeader));
+    if (std::memcmp(header.magic, bakedMagic, 4) != 0 || header.version != bakedVersion || header.vertexSize != sizeof(Vertex))
+    {
+        return reject("made by a different version");
+    }
+    if (!inFile(header.sourcesOffset, uint64_t(header.sourceCount) * sizeof(BakedSource))
+        || !inFile(header.meshesOffset, uint64_t(header.meshCount) * sizeof(BakedMesh))
+        || !inFile(header.texturesOffset, uint64_t(header.textureCount) * sizeof(BakedTexture))
+        || !inFile(header.materialsOffset, uint64_t(header.materialCount) * sizeof(BakedMaterial))
+        || !inFile(header.verticesOffset, header.vertexCount * sizeof(Vertex))
+        || !inFile(header.indicesOffset, header.indexCount * sizeof(GLuint))
+        || header.verticesOffset % alignof(Vertex) != 0
+        || header.indicesOffset % alignof(GLuint) != 0)
+    {
+        return reject("file is truncated or corrupt");
+    }
+
+    // Stale if any file it was baked from has changed since
+    for (uint32_t i = 0; i < header.sourceCount; i++)
+    {
+        BakedSource source;
+        std::memcpy(&source, bytes.data() + header.sourcesOffset + i * sizeof(BakedSource), sizeof(BakedSource));
+        if (!inFile(source.nameOffset, source.nameLength))
+        {
+            return reject("file is truncated or corrupt");
+        }
+        std::string sourcePath = directory + std::string(reinterpret_cast<const char*>(bytes.data() + source.nameOffset), source.nameLength);
+
+        uint64_t size;
+        int64_t modified;
+        if (!MappedFile::stamp(sourcePath, size, modified) || size != source.size || modified != source.modified)
+        {
+            clear();
+            return false;
+        }
+        sources.push_back(sourcePath);
+    }
+
+    for (uint32_t i = 0; i < header.meshCount; i++)
+    {
+        BakedMesh baked;
+        std::memcpy(&baked, bytes.data() + header.meshesOffset + i * sizeof(BakedMesh), sizeof(BakedMesh));
+        if (baked.firstVertex + baked.vertexCount > header.vertexCount || baked.firstIndex + baked.indexCount > header.indexCount
+            || baked.material >= header.materialCount || baked.lodCount > MeshData::maxLods)
+        {
+            return reject("mesh points outside the vertex or index data");
+        }
+
+        MeshData mesh;
+        mesh.firstVertex = baked.firstVertex;
+        mesh.vertexCount = baked.vertexCount;
+        mesh.firstIndex = baked.firstIndex;
+        mesh.indexCount = baked.indexCount;
+        mesh.material = baked.material;
+        mesh.translation = glm::make_vec3(baked.translation);
+        mesh.rotation = glm::make_quat(baked.rotation);
+        mesh.scale = glm::make_vec3(baked.scale);
+        mesh.matrix = glm::make_mat4(baked.matrix);
+        mesh.center = glm::make_vec3(baked.center);
+        mesh.extent = glm::make_vec3(baked.extent);
+        mesh.radius = baked.radius;
+        for (uint32_t l = 0; l < baked.lodCount; l++)
+        {
+            if (baked.lods[l].firstIndex + baked.lods[l].indexCount > baked.indexCount)
+            {
+                return reject("level of detail points outside its mesh");
+            }
+            MeshLod lod;
+            lod.firstIndex = baked.lods[l].firstIndex;
+            lod.indexCount = baked.lods[l].indexCount;
+            lod.error = baked.lods[l].error;
+            mesh.lods.push_back(lod);
+        }
+        meshes.push_back(mesh);
+    }
+
+    for (uint32_t i = 0; i < header.textureCount; i++)
+    {
+        BakedTexture baked;
+        std::memcpy(&baked, bytes.data() + header.texturesOffset + i * sizeof(BakedTexture), sizeof(BakedTexture));
+        if (!inFile(baked.dataOffset, baked.dataLength))
+        {
+            return reject("file is truncated or corrupt");
+        }
+
+        TextureData texture;
+        texture.type = baked.type == 0 ? "diffuse" : "specular";
+        texture.minFilter = baked.minFilter;
+        texture.magFilter = baked.magFilter;
+        texture.wrapS = baked.wrapS;
+        texture.wrapT = baked.wrapT;
+        std::span<const unsigned char> data = bytes.subspan(baked.dataOffset, baked.dataLength);
+        if (baked.embedded)
+        {
+            texture.encoded = data;
+        }
+        else
+        {
+            texture.path = directory + std::string(reinterpret_cast<const char*>(data.data()), data.size());
+        }
+        textures.push_back(texture);
+    }
+
+    for (uint32_t i = 0; i < header.materialCount; i++)
+    {
+        BakedMaterial baked;
+        std::memcpy(&baked, bytes.data() + header.materialsOffset + i * sizeof(BakedMaterial), sizeof(BakedMaterial));
+        if (baked.diffuse >= int32_t(header.textureCount) || baked.specular >= int32_t(header.textureCount))
+        {
+            return reject("material points outside the textures");
+        }
+
+        MaterialData material;
+        material.diffuse = baked.diffuse;
+        material.specular = baked.specular;
+        material.baseColor = glm::make_vec4(baked.baseColor);
+        material.doubleSided = baked.doubleSided != 0;
+        materials.push_back(material);
+    }
+
+    // The geometry is used straight out of the mapping
+    vertices = std::span<const Vertex>(reinterpret_cast<const Vertex*>(bytes.data() + header.verticesOffset), header.vertexCount);
+    indices = std::span<const GLuint>(reinterpret_cast<const GLuint*>(bytes.data() + header.indicesOffset), header.indexCount);
+    return true;
+}
+
+void ModelData::writeBaked(const std::string& path) const
+{
+    std::string directory = directoryOf(path);
+
+    // Names are stored relative to the .ymesh, so the whole model directory can be moved
+    auto relativeName = [&](const std::string& name) {
+        if (name.compare(0, directory.size(), directory) == 0)
+        {
+            return name.substr(directory.size());
+        }
+        return std::filesystem::relative(name, directory).generic_string();
+    };
+
+    // Fill in the records and collect the names and embedded images that go after the geometry
+    std::vector<BakedSource> bakedSources(sources.size());
+    std::vector<BakedMesh> bakedMeshes(meshes.size());
+    std::vector<BakedTexture> bakedTextures(textures.size());
+    std::vector<BakedMaterial> bakedMaterials(materials.size());
+    std::vector<std::span<const unsigned char>> blobs;
+    std::vector<std::string> names;
+    names.reserve(sources.size() + textures.size());
+
+    BakedHeader header = {};
+    std::memcpy(header.magic, bakedMagic, 4);
+    header.version = bakedVersion;
+    header.vertexSize = sizeof(Vertex);
+    header.sourceCount = sources.size();
+    header.meshCount = meshes.size();
+    header.textureCount = textures.size();
+    header.materialCount = materials.size();
+    header.vertexCount = vertices.size();
+    header.indexCount = indices.size();
+    header.sourcesOffset = alignUp(sizeof(BakedHeader));
+    header.meshesOffset = alignUp(header.sourcesOffset + bakedSources.size() * sizeof(BakedSource));
+    header.texturesOffset = alignUp(header.meshesOffset + bakedMeshes.size() * sizeof(BakedMesh));
+    header.materialsOffset = alignUp(header.texturesOffset + bakedTextures.size() * sizeof(BakedTexture));
+    header.verticesOffset = alignUp(header.materialsOffset + bakedMaterials.size() * sizeof(BakedMaterial));
+    header.indicesOffset = alignUp(header.verticesOffset + vertices.size_bytes());
+    uint64_t blobOffset = header.indicesOffset + indices.size_bytes();
+
+    auto addBlob = [&](std::span<const unsigned char> blob, uint64_t& offset, uint64_t& length) {
+        offset = blobOffset;
+        length = blob.size();
+        blobs.push_back(blob);
+        blobOffset += blob.size();
+    };
+    auto addName = [&](const std::string& name, uint64_t& offset, uint64_t& length) {
+        names.push_back(relativeName(name));
+        addBlob(std::span<const unsigned char>(reinterpret_cast<const unsigned char*>(names.back().data()), names.back().size()), offset, length);
+    };
+
+    for (unsigned int i = 0; i < sources.size(); i++)
+    {
+        if (!MappedFile::stamp(sources[i], bakedSources[i].size, bakedSources[i].modified))
+        {
+            throw std::runtime_error("Failed to stat source file: " + sources[i]);
+        }
+        addName(sources[i], bakedSources[i].nameOffset, bakedSources[i].nameLength);
+    }
+
+    for (unsigned int i = 0; i < meshes.size(); i++)
+    {
+        const MeshData& mesh = meshes[i];
+        BakedMesh& baked = bakedMeshes[i];
+        baked.firstVertex = mesh.firstVertex;
+        baked.vertexCount = mesh.vertexCount;
+        baked.firstIndex = mesh.firstIndex;
+        baked.indexCount = mesh.indexCount;
+        baked.material = mesh.material;
+        std::memcpy(baked.translation, glm::value_ptr(mesh.translation), sizeof(baked.translation));
+        std::memcpy(baked.rotation, glm::value_ptr(mesh.rotation), sizeof(baked.rotation));
+        std::memcpy(baked.scale, glm::value_ptr(mesh.scale), sizeof(baked.scale));
+        std::memcpy(baked.matrix, glm::value_ptr(mesh.matrix), sizeof(baked.matrix));
+        baked.lodCount = std::min<size_t>(mesh.lods.size(), MeshData::maxLods);
+        std::memcpy(baked.center, glm::value_ptr(mesh.center), sizeof(baked.center));
+        std::memcpy(baked.extent, glm::value_ptr(mesh.extent), sizeof(baked.extent));
+        baked.radius = mesh.radius;
+        for (uint32_t l = 0; l < baked.lodCount; l++)
+        {
+            baked.lods[l].firstIndex = mesh.lods[l].firstIndex;
+            baked.lods[l].indexCount = mesh.lods[l].indexCount;
+            baked.lods[l].error = mesh.lods[l].error;
+        }
+    }
+
+    for (unsigned int i = 0; i < textures.size(); i++)
+    {
+        const TextureData& texture = textures[i];
+        BakedTexture& baked = bakedTextures[i];
+        baked.type = std::strcmp(texture.type, "diffuse") == 0 ? 0 : 1;
+        baked.embedded = texture.path.empty() ? 1 : 0;
+        baked.minFilter = texture.minFilter;
+        baked.magFilter = texture.magFilter;
+        baked.wrapS = texture.wrapS;
+        baked.wrapT = texture.wrapT;
+        if (baked.embedded)
+        {
+            addBlob(texture.encoded, baked.dataOffset, baked.dataLength);
+        }
+        else
+        {
+            addName(texture.path, baked.dataOffset, baked.dataLength);
+        }
+    }
+
+    for (unsigned int i = 0; i < materials.size(); i++)
+    {
+        bakedMaterials[i].diffuse = materials[i].diffuse;
+        bakedMaterials[i].specular = materials[i].specular;
+        std::memcpy(bakedMaterials[i].baseColor, glm::value_ptr(materials[i].baseColor), sizeof(bakedMaterials[i].baseColor));
+        bakedMaterials[i].doubleSided = materials[i].doubleSided ? 1 : 0;
+    }
+
+    // Write to a temporary file first, so a crash half way never leaves a broken cache behind
+    std::string tempPath = path + ".tmp";
+    std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+    if (!out)
+    {
+        throw std::runtime_error("Failed to open file for writing: " + tempPath);
+    }
+
+    uint64_t written = 0;
+    auto write = [&](const void* data, uint64_t size) {
+        out.write(static_cast<const char*>(data), size);
+        written += size;
+    };
+    auto padTo = [&](uint64_t offset) {
+        static const char zeros[16] = {};
+        write(zeros, offset - written);
+    };
+
+    write(&header, sizeof(BakedHeader));
+    padTo(header.sourcesOffset);
+    write(bakedSources.data(), bakedSources.size() * sizeof(BakedSource));
+    padTo(header.meshesOffset);
+    write(bakedMeshes.data(), bakedMeshes.size() * sizeof(BakedMesh));
+    padTo(header.texturesOffset);
+    write(bakedTextures.data(), bakedTextures.size() * sizeof(BakedTexture));
+    padTo(header.materialsOffset);
+    write(bakedMaterials.data(), bakedMaterials.size() * sizeof(BakedMaterial));
+    padTo(header.verticesOffset);
+    write(vertices.data(), vertices.size_bytes());
+    padTo(header.indicesOffset);
+    write(indices.data(), indices.size_bytes());
+    for (unsigned int i = 0; i < blobs.size(); i++)
+    {
+        write(blobs[i].data(), blobs[i].size());
+    }
+
+    out.close();
+    if (!out)
+    {
+        throw std::runtime_error("Failed to write file: " + tempPath);
+    }
+    std::filesystem::rename(tempPath, path);
+}
+
+std::vector<MeshOptimizer::Report> ModelData::optimize()
+{
+    std::vector<MeshOptimizer::Report> reports;
+    if (vertices.data() != vertexStorage.data() || indices.data() != indexStorage.data())
+    {
+        return reports;
+    }
+
+    // Meshes can shrink, so each one is optimized on its own and appended to fresh arrays
+    std::vector<Vertex> optimizedVertices;
+    std::vector<GLuint> optimizedIndices;
+    optimizedVertices.reserve(vertexStorage.size());
+    optimizedIndices.reserve(indexStorage.size());
+    for (MeshData& mesh : meshes)
+    {
+        std::vector<Vertex> meshVertices(vertexStorage.begin() + mesh.firstVertex, vertexStorage.begin() + mesh.firstVertex + mesh.vertexCount);
+        std::vector<GLuint> meshIndices(indexStorage.begin() + mesh.firstIndex, indexStorage.begin() + mesh.firstIndex + mesh.indexCount);
+        reports.push_back(MeshOptimizer::optimize(meshVertices, meshIndices));
+
+        mesh.firstVertex = optimizedVertices.size();
+        mesh.vertexCount = meshVertices.size();
+        mesh.firstIndex = optimizedIndices.size();
+        mesh.indexCount = meshIndices.size();
+        optimizedVertices.insert(optimizedVertices.end(), meshVertices.begin(), meshVertices.end());
+        optimizedIndices.insert(optimizedIndices.end(), meshIndices.begin(), meshIndices.end());
+    }
+
+    vertexStorage = std::move(optimizedVertices);
+    indexStorage = std::move(optimizedIndices);
+    vertices = vertexStorage;
+    indices = indexStorage;
+    return reports;
+}
+
+// Works out every mesh's bounding sphere: one around the middle of its bounding box, which is tight enough for judging
+// how big it is on screen
+void ModelData::computeBounds()
+{
+    for (MeshData& mesh : meshes)
+    {
+        std::span<const Vertex> meshVertices = vertices.subspan(mesh.firstVertex, mesh.vertexCount);
+        mesh.radius = 0.0f;
+        for (const Vertex& vertex : meshVertices)
+        {
+            mesh.radius = std::max(mesh.radius, glm::length(vertex.position - mesh.center));
+        }
+    }
+}
+
+void ModelData::buildLods()
+{
+    if (vertices.data() != vertexStorage.data() || indices.data() != indexStorage.data())
+    {
+        return;
+    }
+
+    // Each mesh's levels go right after its own indices, so the index array is rebuilt mesh by mesh
+    std::vector<GLuint> lodIndices;
+    lodIndices.reserve(indexStorage.size() * 2);
+    for (MeshData& mesh : meshes)
+    {
+        std::span<const Vertex> meshVertices = vertices.subspan(mesh.firstVertex, mesh.vertexCount);
+        std::span<const GLuint> meshIndices = indices.subspan(mesh.firstIndex, mesh.indexCount);
+
+        size_t firstIndex = lodIndices.size();
+        lodIndices.insert(lodIndices.end(), meshIndices.begin(), meshIndices.end());
+        mesh.lods.clear();
+        mesh.lods.push_back(MeshLod{0, meshIndices.size(), 0.0f});
+
+        // Every level has half the triangles of the one before, and none may stray further than a quarter of the mesh's
+        // size from the original (past that the coarsest level that's left is drawn however small the mesh gets)
+        // Small meshes keep just the full level, since there's little to save
+        if (meshIndices.size() >= 3 * 256)
+        {
+            std::vector<size_t> targets;
+            size_t target = meshIndices.size();
+            for (unsigned int l = 1; l < MeshData::maxLods; l++)
+            {
+                target = target / 6 * 3;
+                targets.push_back(target);
+            }
+            for (MeshSimplifier::Level& level : MeshSimplifier::simplify(meshVertices, meshIndices, targets, mesh.radius * 0.25f))
+            {
+                MeshOptimizer::optimizeTriangles(level.indices, meshVertices);
+                mesh.lods.push_back(MeshLod{lodIndices.size() - firstIndex, level.indices.size(), level.error});
+                lodIndices.insert(lodIndices.end(), level.indices.begin(), level.indices.end());
+            }
+        }
+
+        mesh.firstIndex = firstIndex;
+        mesh.indexCount = lodIndices.size() - firstIndex;
+    }
+
+    indexStorage = std::move(lodIndices);
+    indices = indexStorage;
+}
+
+// Lets go of the decoded data and every file mapping
+void ModelData::clear()
+{
+    vertices = {};
+    indices = {};
+    meshes.clear();
+    textures.clear();
+    materials.clear();
+    sources.clear();
+    textureIndices.clear();
+    defaultMaterial = -1;
+
+    JSON = json();
+    glbBinChunk = {};
+    buffers.clear();
+    bufferFiles.clear();
+    gltfFile.release();
+    vertexStorage.clear();
+    indexStorage.clear();
+    bakedFile.release();
+}
+
+void ModelData::loadMesh(unsigned int indMesh, const MeshData& node)
+{
+    const json& primitives = JSON["meshes"][indMesh]["primitives"];
+    for (unsigned int p = 0; p < primitives.size(); p++)
+    {
+        // Get the attributes of the primitive
+        const json& primitive = primitives[p];
+        if (!primitive.contains("attributes") || !primitive["attributes"].contains("POSITION"))
+        {
+            throw std::runtime_error("Primitive has no POSITION attribute");
+        }
+        const json& attributes = primitive["attributes"];
+
+        // Every primitive is its own mesh, drawn with the node's transform and its own material
+        MeshData mesh = node;
+        if (primitive.contains("material"))
+        {
+            mesh.material = primitive["material"];
+            if (mesh.material >= JSON["materials"].size())
+            {
+                throw std::out_of_range("Primitive uses a material the file doesn't have");
+            }
+        }
+        else
+        {
+            // Primitives without a material get the glTF default (plain white)
+            if (defaultMaterial < 0)
+            {
+                defaultMaterial = materials.size();
+                materials.push_back(MaterialData());
+            }
+            mesh.material = defaultMaterial;
+        }
+
+        // Positions decide how many vertices there are. Every other attribute is decoded straight into its
+        // field of the interleaved Vertex array, so there are no intermediate float vectors
+        const json& positionAccessor = JSON["accessors"][attributes["POSITION"].get<unsigned int>()];
+        AccessorView positions = getAccessor(positionAccessor);
+        mesh.firstVertex = vertexStorage.size();
+        mesh.vertexCount = positions.count;
+        vertexStorage.resize(mesh.firstVertex + mesh.vertexCount, Vertex{glm::vec3(0.0f), glm::vec3(0.0f), glm::vec3(1.0f, 1.0f, 1.0f), glm::vec2(0.0f)});
+        Vertex* vertices = vertexStorage.data() + mesh.firstVertex;
+        Accessor::readFloats(positions, &vertices[0].position[0], sizeof(Vertex), 3);
+
+        // The bounding box is in the accessor (glTF requires min and max for positions), so it's only worked out
+        // from the vertices for files that leave it out
+        glm::vec3 low(INFINITY);
+        glm::vec3 high(-INFINITY);
+        if (positionAccessor.contains("min") && positionAccessor.contains("max")
+            && positionAccessor["min"].size() == 3 && positionAccessor["max"].size() == 3)
+        {
+            for (int axis = 0; axis < 3; axis++)
+            {
+                low[axis] = positionAccessor["min"][axis].get<float>();
+                high[axis] = positionAccessor["max"][axis].get<float>();
+            }
+        }
+        else
+        {
+            for (size_t v = 0; v < mesh.vertexCount; v++)
+            {
+                low = glm::min(low, vertices[v].position);
+                high = glm::max(high, vertices[v].position);
+            }
+        }
+        if (mesh.vertexCount > 0)
+        {
+            mesh.center = (low + high) * 0.5f;
+            mesh.extent = (high - low) * 0.5f;
+        }
+        // Every attribute is written for as many vertices as its accessor has, so they all have to match the positions
+        if (attributes.contains("NORMAL"))
+        {
+            AccessorView normals = getAccessor(JSON["accessors"][attributes["NORMAL"].get<unsigned int>()]);
+            if (normals.count != mesh.vertexCount)
+            {
+                throw std::out_of_range("NORMAL accessor has a different count than POSITION");
+            }
+            Accessor::readFloats(normals, &vertices[0].normal[0], sizeof(Vertex), 3);
+        }
+        if (attributes.contains("TEXCOORD_0"))
+        {
+            AccessorView texUVs = getAccessor(JSON["accessors"][attributes["TEXCOORD_0"].get<unsigned int>()]);
+            if (texUVs.count != mesh.vertexCount)
+            {
+                throw std::out_of_range("TEXCOORD_0 accessor has a different count than POSITION");
+            }
+            Accessor::readFloats(texUVs, &vertices[0].texUV[0], sizeof(Vertex), 2);
+        }
+
+        // Get the indices (a primitive without them is drawn in vertex order)
+        mesh.firstIndex = indexStorage.size();
+        if (primitive.contains("indices"))
+        {
+            AccessorView indexView = getAccessor(JSON["accessors"][primitive["indices"].get<unsigned int>()]);
+            mesh.indexCount = indexView.count;
+            indexStorage.resize(mesh.firstIndex + mesh.indexCount);
+            Accessor::readIndices(indexView, indexStorage.data() + mesh.firstIndex);
+
+            // Everything after this (optimization, simplification, drawing) indexes the vertices with them unchecked
+            auto indices = indexStorage.begin() + mesh.firstIndex;
+            if (mesh.indexCount > 0 && *std::max_element(indices, indexStorage.end()) >= mesh.vertexCount)
+            {
+                throw std::out_of_range("Index points past the primitive's vertices");
+            }
+        }
+        else
+        {
+            mesh.indexCount = mesh.vertexCount;
+            indexStorage.resize(mesh.firstIndex + mesh.indexCount);
+            std::iota(indexStorage.begin() + mesh.firstIndex, indexStorage.end(), 0u);
+        }
+
+        meshes.push_back(mesh);
+    }
+}
+
+void ModelData::traverseNode(unsigned int nextNode, glm::mat4 matrix)
+{
+    // Current node
+    json node = JSON["nodes"][nextNode];
+
+    // Get translation if it exists
+    glm::vec3 translation = glm::vec3(0.0f, 0.0f, 0.0f);
+    if (node.find("translation") != node.end())
+    {
+        float transValues[3];
+        for (unsigned int i = 0; i < node["translation"].size(); i++)
+            transValues[i] = (node["translation"][i]);
+        translation = glm::make_vec3(transValues);
+    }
+    // Get quaternion if it exists
+    glm::quat rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+    if (node.find("rotation") != node.end())
+    {
+        float rotValues[4] =
+            {
+                node["rotation"][3],
+                node["rotation"][0],
+                node["rotation"][1],
+                node["rotation"][2]
+            };
+        rotation = glm::make_quat(rotValues);
+    }
+    // Get scale if it exists
+    glm::vec3 scale = glm::vec3(1.0f, 1.0f, 1.0f);
+    if (node.find("scale") != node.end())
+    {
+        float scaleValues[3];
+        for (unsigned int i = 0; i < node["scale"].size(); i++)
+            scaleValues[i] = (node["scale"][i]);
+        scale = glm::make_vec3(scaleValues);
+    }
+    // Get matrix if it exists
+    glm::mat4 matNode = glm::mat4(1.0f);
+    if (node.find("matrix") != node.end())
+    {
+        float matValues[16];
+        for (unsigned int i = 0; i < node["matrix"].size(); i++)
+            matValues[i] = (node["matrix"][i]);
+        matNode = glm::make_mat4(matValues);
+    }
+
+    // Initialize matrices
+    glm::mat4 trans = glm::mat4(1.0f);
+    glm::mat4 rot = glm::mat4(1.0f);
+    glm::mat4 sca = glm::mat4(1.0f);
+
+    // Use translation, rotation, and scale to change the initialized matrices
+    trans = glm::translate(trans, translation);
+    rot = glm::mat4_cast(rotation);
+    sca = glm::scale(sca, scale);
+
+    // Multiply all matrices together
+    glm::mat4 matNextNode = matrix * matNode * trans * rot * sca;
+
+    // Check if the node contains a mesh and if it does load it
+    if (node.find("mesh") != node.end())
+    {
+        MeshData mesh;
+        mesh.translation = translation;
+        mesh.rotation = rotation;
+        mesh.scale = scale;
+        mesh.matrix = matNextNode;
+
+        loadMesh(node["mesh"], mesh);
+    }
+
+    // Check if the node has children, and if it does, apply this function to them with the matNextNode
+    if (node.find("children") != node.end())
+    {
+        for (unsigned int i = 0; i < node["children"].size(); i++)
+            traverseNode(node["children"][i], matNextNode);
+    }
+}
+
+void ModelData::mapBuffers()
+{
+    // Buffer uris are relative to the .gltf file (fileDirectory)
+    // Map every buffer (rather than just the first) so accessors can point at any of them
+    bufferFiles.clear();
+    buffers.clear();
+    for (unsigned int i = 0; i < JSON["buffers"].size(); i++)
+    {
+        // A buffer without a uri is the BIN chunk of the .glb we've already mapped
+        if (!JSON["buffers"][i].contains("uri"))
+        {
+            if (glbBinChunk.data() == nullptr)
+            {
+                throw std::runtime_error("Buffer has no uri, but the file has no binary chunk");
+            }
+            buffers.push_back(glbBinChunk);
+            continue;
+        }
+
+        std::string uri = JSON["buffers"][i]["uri"];
+        if (uri.rfind("data:", 0) == 0)
+        {
+            throw std::invalid_argument("Embedded data: uris are not supported (convert the model to .glb instead)");
+        }
+        bufferFiles.push_back(MappedFile(fileDirectory + uri));
+        buffers.push_back(bufferFiles.back().bytes());
+        sources.push_back(fileDirectory + uri);
+    }
+}
+
+// Checks for the .glb magic number ("glTF") at the start of the file
+bool ModelData::isGlb(std::span<const unsigned char> bytes)
+{
+    return bytes.size() >= 12 && std::memcmp(bytes.data(), "glTF", 4) == 0;
+}
+
+// Splits a .glb container into its chunks: returns the JSON chunk and stores the (optional) BIN chunk in glbBinChunk
+// Layout is a 12 byte header (magic, version, length) followed by chunks of (length, type, data)
+std::string_view ModelData::readGlbChunks(std::span<const unsigned char> bytes)
+{
+    auto readU32 = [&](size_t offset) {
+        uint32_t value;
+        std::memcpy(&value, bytes.data() + offset, sizeof(uint32_t));
+        return value;
+    };
+
+    const uint32_t chunkJSON = 0x4E4F534A;
+    const uint32_t chunkBIN = 0x004E4942;
+
+    uint32_t version = readU32(4);
+    uint32_t length = readU32(8);
+    if (version != 2)
+    {
+        throw std::runtime_error("Unsupported .glb version " + std::to_string(version));
+    }
+    if (length > bytes.size())
+    {
+        throw std::runtime_error("Truncated .glb file (header says " + std::to_string(length) + " bytes)");
+    }
+
+    std::string_view jsonChunk;
+    size_t offset = 12;
+    while (offset + 8 <= length)
+    {
+        uint32_t chunkLength = readU32(offset);
+        uint32_t chunkType = readU32(offset + 4);
+        offset += 8;
+        if (offset + chunkLength > length)
+        {
+            throw std::runtime_error("Truncated .glb chunk");
+        }
+
+        // The JSON chunk always comes first and the BIN chunk (if there is one) second. Anything else is an extension we skip
+        if (chunkType == chunkJSON && jsonChunk.empty())
+        {
+            jsonChunk = std::string_view(reinterpret_cast<const char*>(bytes.data() + offset), chunkLength);
+        }
+        else if (chunkType == chunkBIN && glbBinChunk.data() == nullptr)
+        {
+            glbBinChunk = bytes.subspan(offset, chunkLength);
+        }
+
+        // Chunks are padded to 4 byte boundaries
+        offset += (chunkLength + 3) & ~3u;
+    }
+
+    if (jsonChunk.empty())
+    {
+        throw std::runtime_error(".glb file has no JSON chunk");
+    }
+    return jsonChunk;
+}
+
+AccessorView ModelData::getAccessor(const json& accessor)
+{
+    AccessorView view;
+
+    // Get properties from the accessor
+    view.count = accessor["count"];
+    view.componentType = accessor["componentType"];
+    view.numComponents = Accessor::componentCount(accessor["type"]);
+    view.normalized = accessor.value("normalized", false);
+
+    unsigned int elementSize = Accessor::componentSize(view.componentType) * view.numComponents;
+    view.stride = elementSize;
+
+    // An accessor without a bufferView is all zeros (view.data stays nullptr)
+    if (!accessor.contains("bufferView"))
+    {
+        return view;
+    }
+
+    // Get properties from the bufferView (byteStride is only there when the data is interleaved)
+    const json& bufferView = bufferViewAt(accessor["bufferView"].get<unsigned int>());
+    size_t byteOffset = bufferView.value("byteOffset", 0) + accessor.value("byteOffset", 0);
+    view.stride = bufferView.value("byteStride", elementSize);
+
+    // Make sure the last element actually fits before handing out the pointer
+    std::span<const unsigned char> data = bufferOf(bufferView);
+    if (view.count > 0 && byteOffset + (view.count - 1) * view.stride + elementSize > data.size())
+    {
+        throw std::out_of_range("Accessor reads past the end of its buffer");
+    }
+    view.data = data.data() + byteOffset;
+
+    return view;
+}
+
+void ModelData::loadMaterials()
+{
+    // The shader has a diffuse and a specular texture, which are the base color and metallic-roughness textures in glTF
+    // Other maps (normal, emissive, occlusion) aren't used, so their images are never loaded
+    for (unsigned int i = 0; i < JSON["materials"].size(); i++)
+    {
+        const json& pbr = JSON["materials"][i].value("pbrMetallicRoughness", json::object());
+
+        MaterialData material;
+        material.doubleSided = JSON["materials"][i].value("doubleSided", false);
+        if (pbr.contains("baseColorFactor"))
+        {
+            for (unsigned int c = 0; c < 4; c++)
+                material.baseColor[c] = pbr["baseColorFactor"][c];
+        }
+        if (pbr.contains("baseColorTexture"))
+        {
+            material.diffuse = loadTexture(pbr["baseColorTexture"]["index"], "diffuse");
+        }
+        if (pbr.contains("metallicRoughnessTexture"))
+        {
+            material.specular = loadTexture(pbr["metallicRoughnessTexture"]["index"], "specular");
+        }
+        materials.push_back(material);
+    }
+}
+
+int ModelData::loadTexture(unsigned int indTexture, const char* type)
+{
+    // Materials often share textures, which only need uploading once
+    auto found = textureIndices.find({indTexture, type});
+    if (found != textureIndices.end())
+    {
+        return found->second;
+    }
+
+    const json& gltfTexture = JSON["textures"][indTexture];
+    if (!gltfTexture.contains("source"))
+    {
+        return -1;
+    }
+    const json& image = JSON["images"][gltfTexture["source"].get<unsigned int>()];
+
+    // Images either point at a file (uri) or live inside a bufferView (always the case in .glb files)
+    TextureData texture;
+    texture.type = type;
+    if (image.contains("uri"))
+    {
+        texture.path = fileDirectory + image["uri"].get<std::string>();
+    }
+    else
+    {
+        texture.encoded = getBufferView(image["bufferView"]);
+    }
+
+    // Anything the sampler leaves out keeps our defaults
+    if (gltfTexture.contains("sampler"))
+    {
+        const json& sampler = JSON["samplers"][gltfTexture["sampler"].get<unsigned int>()];
+        texture.minFilter = sampler.value("minFilter", texture.minFilter);
+        texture.magFilter = sampler.value("magFilter", texture.magFilter);
+        texture.wrapS = sampler.value("wrapS", texture.wrapS);
+        texture.wrapT = sampler.value("wrapT", texture.wrapT);
+    }
+
+    int index = textures.size();
+    textures.push_back(texture);
+    textureIndices[{indTexture, type}] = index;
+    return index;
+}
+
+// Returns the bytes covered by a bufferView
+std::span<const unsigned char> ModelData::getBufferView(unsigned int index)
+{
+    const json& bufferView = bufferViewAt(index);
+    std::span<const unsigned char> data = bufferOf(bufferView);
+    size_t byteOffset = bufferView.value("byteOffset", 0);
+    size_t byteLength = bufferView["byteLength"];
+    if (byteOffset + byteLength > data.size())
+    {
+        throw std::out_of_range("bufferView reads past the end of its buffer");
+    }
+    return data.subspan(byteOffset, byteLength);
+}
+
+// The bufferView at an index the file gave
+const json& ModelData::bufferViewAt(unsigned int index)
+{
+    if (!JSON.contains("bufferViews") || index >= JSON["bufferViews"].size())
+    {
+        throw std::out_of_range("bufferView index is past the file's bufferViews");
+    }
+    return JSON["bufferViews"][index];
+}
+
+// The mapped buffer a bufferView points into
+std::span<const unsigned char> ModelData::bufferOf(const json& bufferView)
+{
+    unsigned int index = bufferView.value("buffer", 0u);
+    if (index >= buffers.size())
+    {
+        throw std::out_of_range("bufferView points past the file's buffers");
+    }
+    return buffers[index];
+}
@@ -0,0 +1,176 @@
+#pragma once
+
+#include "libraries/include/json/json.h"
+#include "meshes/accessor.h"
+#include "meshes/meshoptimizer.h"
+#include "utils/mappedfile.h"
+#include "utils/vbo.h"
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <map>
+#include <span>
+#include <string>
+#include <vector>
+
+using json = nlohmann::json;
+
+// A texture as the file describes it (nothing is decoded or uploaded yet)
+struct TextureData
+{
+    // "diffuse" or "specular" (always a string literal, so Texture can hold onto the pointer)
+    const char* type = nullptr;
+    // Full path of the image file, or empty if the image is embedded in the model file
+    std::string path;
+    // Encoded (PNG/JPEG) bytes of an embedded image
+    std::span<const unsigned char> encoded;
+
+    // How the texture is sampled (GL enums straight from the glTF sampler, or our defaults if it has none)
+    GLint minFilter = GL_NEAREST_MIPMAP_LINEAR;
+    GLint magFilter = GL_NEAREST;
+    GLint wrapS = GL_REPEAT;
+    GLint wrapT = GL_REPEAT;
+};
+
+// A glTF material, reduced to what the model shader uses
+struct MaterialData
+{
+    // Indices into ModelData::textures, or -1 if the material doesn't have that texture
+    int diffuse = -1;
+    int specular = -1;
+    // Multiplies the diffuse texture (or is the whole color, if there's no texture)
+    glm::vec4 baseColor = glm::vec4(1.0f);
+    // Seen from both sides (glTF doubleSided), so its back faces can't be culled
+    bool doubleSided = false;
+};
+
+// A level of detail: a triangle list in its mesh's index range, and how far (in model units) its surface can be from
+// the full mesh's
+struct MeshLod
+{
+    // Relative to the mesh's firstIndex
+    size_t firstIndex = 0;
+    size_t indexCount = 0;
+    float error = 0.0f;
+};
+
+// One primitive of a mesh node, with the part of ModelData's vertex and index arrays that belongs to it
+// Indices are relative to firstVertex
+struct MeshData
+{
+    // Most levels of detail a mesh can have (the full mesh and three simplified ones)
+    static const unsigned int maxLods = 4;
+
+    size_t firstVertex = 0;
+    size_t vertexCount = 0;
+    size_t firstIndex = 0;
+    // Covers every level of detail
+    size_t indexCount = 0;
+    // Index into ModelData::materials
+    unsigned int material = 0;
+
+    // Levels of detail, finest (the full mesh) first, all indexing the same vertices
+    // Empty until ModelData::buildLods runs, which means the whole index range is the only level
+    std::vector<MeshLod> lods;
+    // Bounding box (center plus or minus extent) and sphere (center and radius) of the vertices, before matrix
+    // The box is for frustum culling, and the sphere for working out how big the mesh is on screen
+    glm::vec3 center = glm::vec3(0.0f);
+    glm::vec3 extent = glm::vec3(0.0f);
+    float radius = 0.0f;
+
+    // Node transform pieces and the full matrix it's drawn with
+    glm::vec3 translation = glm::vec3(0.0f);
+    glm::quat rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+    glm::vec3 scale = glm::vec3(1.0f);
+    glm::mat4 matrix = glm::mat4(1.0f);
+};
+
+// Everything needed to put a model on the GPU, decoded without touching OpenGL
+// Comes either from a .gltf/.glb file or from a baked .ymesh cache, which holds the same arrays ready to hand to glBufferData
+class ModelData
+{
+public:
+    // Path of the baked cache that goes with a model file (scene.gltf -> scene.ymesh)
+    static std::string bakedPath(const std::string& path);
+
+    // Loads a model from its .ymesh bake when that's up to date, and from the .gltf/.glb file otherwise
+    void load(const std::string& path);
+    // Decodes a .gltf or .glb file (throws if it can't be read or is malformed)
+    // The meshes are run through optimize() and buildLods(), and optimize()'s reports are returned
+    std::vector<MeshOptimizer::Report> loadGltf(const std::string& path);
+    // Maps a baked .ymesh file. Returns false if it's missing, from another version, or older than the files it was baked from
+    bool loadBaked(const std::string& path);
+    // Writes what's loaded to a .ymesh file (throws std::runtime_error if it can't be written)
+    void writeBaked(const std::string& path) const;
+
+    // Welds and reorders every mesh's vertices and triangles for faster drawing (see MeshOptimizer)
+    // Only decoded glTF data can be optimized (bakes already are), so this returns one report per mesh or nothing
+    std::vector<MeshOptimizer::Report> optimize();
+    // Simplifies every mesh into up to MeshData::maxLods levels of detail (halving the triangles each time), which are
+    // appended to its index range. Like optimize() (which has to run first), only decoded glTF data gets them
+    void buildLods();
+
+    // Lets go of the decoded data and every file mapping
+    void clear();
+
+    // All vertices and indices of the model back to back (each MeshData says which part is its own)
+    // These point into either the decoded glTF data or the mapped .ymesh, so they're only valid until clear()
+    std::span<const Vertex> vertices;
+    std::span<const GLuint> indices;
+    std::vector<MeshData> meshes;
+    // Every texture a material uses (one entry per glTF texture and use, so a texture used as both kinds appears twice)
+    std::vector<TextureData> textures;
+    std::vector<MaterialData> materials;
+
+    // Files the data was decoded from (the model file and its buffers), so a bake can tell when it's stale
+    std::vector<std::string> sources;
+
+private:
+    // Variables for easy access (only valid while a glTF file is being decoded)
+    std::string file;
+    std::string fileDirectory;
+    json JSON;
+
+    // Read-only mappings of the model file and every buffer it references
+    // Embedded images point into these, so they're kept until clear()
+    MappedFile gltfFile;
+    std::vector<MappedFile> bufferFiles;
+    std::vector<std::span<const unsigned char>> buffers;
+    // For .glb files, the binary chunk inside gltfFile (used by the buffer that has no uri)
+    std::span<const unsigned char> glbBinChunk;
+
+    // Decoded glTF geometry (vertices and indices point here unless the data came from a bake)
+    std::vector<Vertex> vertexStorage;
+    std::vector<GLuint> indexStorage;
+
+    // The mapped .ymesh file when the data came from a bake
+    MappedFile bakedFile;
+
+    // Maps every binary buffer referenced by the file
+    void mapBuffers();
+    // Helpers for reading the .glb container format (one file holding both the JSON and the binary data)
+    static bool isGlb(std::span<const unsigned char> bytes);
+    std::string_view readGlbChunks(std::span<const unsigned char> bytes);
+    // Resolves an accessor to the bytes it covers in the mapped buffers
+    AccessorView getAccessor(const json& accessor);
+    // Returns the bytes covered by a bufferView
+    std::span<const unsigned char> getBufferView(unsigned int index);
+    // Look up a bufferView and the mapped buffer it points into, throwing if the file's index is out of range
+    const json& bufferViewAt(unsigned int index);
+    std::span<const unsigned char> bufferOf(const json& bufferView);
+
+    // Where each (glTF texture, kind) pair went in textures, so materials sharing a texture share the upload
+    std::map<std::pair<unsigned int, std::string>, int> textureIndices;
+    // Material for primitives that don't name one (-1 until one needs it)
+    int defaultMaterial = -1;
+
+    // Decodes every primitive of a mesh by its index, each drawn with the node's transform
+    void loadMesh(unsigned int indMesh, const MeshData& node);
+    // Traverses a node recursively, so it essentially traverses all connected nodes
+    void traverseNode(unsigned int nextNode, glm::mat4 matrix = glm::mat4(1.0f));
+    // Fills in every mesh's bounding sphere (around the bounding box loadMesh found)
+    void computeBounds();
+    // Builds the material table from the glTF materials, textures and samplers
+    void loadMaterials();
+    // Adds the texture a material slot refers to (or finds it, if another material already added it)
+    int loadTexture(unsigned int indTexture, const char* type);
+};
@@ -0,0 +1,130 @@
+#include "modelloader.h"
+
+#include "utils/gldeletequeue.h"
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+ModelLoader::ModelLoader(unsigned int threads) : m_pool(threads), m_textures(m_pool) {
+}
+
+// The workers have to be gone before the queues they push into are destroyed
+ModelLoader::~ModelLoader() {
+    shutdown();
+}
+
+// Returns the shared asset for a file, and starts decoding it if no one has asked for it yet
+std::shared_ptr<ModelAsset> ModelLoader::request(const std::string& file) {
+    std::string key = AssetCache::canonicalPath(file);
+    std::shared_ptr<ModelAsset> asset = AssetCache::findModel(key);
+    if (asset != nullptr && !asset->failed) {
+        return asset;
+    }
+
+    // First request for this file: register the (empty) asset straight away, so anyone else asking for the
+    // file while it decodes shares this load instead of starting their own
+    asset = std::make_shared<ModelAsset>();
+    AssetCache::storeModel(key, asset);
+
+    std::shared_ptr<Job> job = std::make_shared<Job>();
+    job->file = file;
+    job->asset = asset;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_decoding++;
+    }
+
+    m_pool.enqueue([this, job] {
+        try {
+            job->data.load(job->file);
+        } catch (const std::exception& e) {
+            std::cerr << "Failed to load model " << job->file << ": " << e.what() << "\n";
+            job->data.clear();
+            job->failed = true;
+        }
+
+        // Failed jobs go through the queue too, since only the GL thread touches the asset
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_decoding--;
+        m_decoded.push_back(job);
+    });
+
+    return asset;
+}
+
+// Uploads decoded meshes, then streams textures, until budgetMs has passed
+void ModelLoader::upload(double budgetMs) {
+    // Whatever was freed since the last frame (on this thread or any other) is deleted here, where the context is current
+    GLDeleteQueue::flush();
+
+    auto start = std::chrono::steady_clock::now();
+    uploadModels(budgetMs);
+    double spentMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    m_textures.upload(budgetMs - spentMs);
+}
+
+// Uploads decoded meshes until budgetMs has passed
+void ModelLoader::uploadModels(double budgetMs) {
+    auto start = std::chrono::steady_clock::now();
+    auto elapsedMs = [&] {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    };
+
+    do {
+        if (m_uploading == nullptr) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_decoded.empty()) {
+                return;
+            }
+            m_uploading = m_decoded.front();
+            m_decoded.pop_front();
+        }
+
+        Job& job = *m_uploading;
+        ModelAsset& asset = *job.asset;
+        if (job.failed) {
+            asset.failed = true;
+            m_uploading = nullptr;
+            continue;
+        }
+
+        // Textures and materials first, since the meshes are drawn with them
+        // Textures start out as placeholders (which is quick), and the real images are decoded and streamed in by m_textures
+        if (job.nextTexture < job.data.textures.size()) {
+            while (job.nextTexture < job.data.textures.size()) {
+                const TextureData& texture = job.data.textures[job.nextTexture++];
+                GLuint slot = std::strcmp(texture.type, "specular") == 0 ? Material::specularUnit : Material::diffuseUnit;
+                asset.addTexture(m_textures.request(texture, slot, job.asset), texture);
+            }
+        } else if (job.nextMaterial < job.data.materials.size()) {
+            while (job.nextMaterial < job.data.materials.size()) {
+                asset.uploadMaterial(job.data.materials[job.nextMaterial++]);
+            }
+        } else if (job.nextMesh < job.data.meshes.size()) {
+            asset.uploadMesh(job.data, job.data.meshes[job.nextMesh++]);
+        }
+
+        // Once everything's on the GPU the decoded data (and its file mappings) can go
+        if (job.nextTexture == job.data.textures.size() && job.nextMaterial == job.data.materials.size()
+            && job.nextMesh == job.data.meshes.size()) {
+            asset.finish();
+            m_uploading = nullptr;
+        }
+    } while (elapsedMs() < budgetMs);
+}
+
+// Number of models still decoding or waiting to be uploaded
+size_t ModelLoader::pending() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_decoding + m_decoded.size() + (m_uploading != nullptr ? 1 : 0) + m_textures.pending();
+}
+
+// Stops the workers and drops anything not uploaded yet
+void ModelLoader::shutdown() {
+    m_pool.shutdown();
+    m_textures.shutdown();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_decoded.clear();
+    m_decoding = 0;
+    m_uploading = nullptr;
+}
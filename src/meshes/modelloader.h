@@ -0,0 +1,66 @@
+#pragma once
+
+#include "meshes/assetcache.h"
+#include "meshes/modeldata.h"
+#include "meshes/texturestreamer.h"
+#include "utils/threadpool.h"
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+
+// Loads models in the background: file I/O, JSON parsing and vertex assembly run on worker threads, and the
+// decoded data waits in a queue until the GL thread uploads it a little at a time (see upload())
+// Textures start out as placeholders and are decoded and streamed in separately, so a model can show up before them
+class ModelLoader
+{
+public:
+    // Starts the worker threads (0 picks a count from the number of cores)
+    explicit ModelLoader(unsigned int threads = 0);
+    ~ModelLoader();
+
+    // Returns the shared asset for a file, and starts decoding it if no one has asked for it yet
+    // The asset can't be drawn until upload() has finished it (asset->ready)
+    std::shared_ptr<ModelAsset> request(const std::string& file);
+
+    // Uploads decoded meshes, then streams textures, until budgetMs has passed (GL thread only, with the context current)
+    // At least one piece of each is uploaded per call, so loading always makes progress
+    // Deletes the GL objects of assets freed since the last call first (see GLDeleteQueue)
+    void upload(double budgetMs);
+
+    // Number of models and textures still decoding or waiting to be uploaded
+    size_t pending() const;
+
+    // Stops the workers and drops anything not uploaded yet (dropped assets queue their GL objects for deletion, so
+    // GLDeleteQueue::flush has to run afterwards, with the context current)
+    void shutdown();
+
+private:
+    // One model on its way from the file to the GPU
+    struct Job
+    {
+        std::string file;
+        std::shared_ptr<ModelAsset> asset;
+        ModelData data;
+        // How far the upload has got
+        size_t nextTexture = 0;
+        size_t nextMaterial = 0;
+        size_t nextMesh = 0;
+        // Set by the worker if the file couldn't be decoded
+        bool failed = false;
+    };
+
+    // Uploads decoded meshes (and creates their placeholder textures) until budgetMs has passed
+    void uploadModels(double budgetMs);
+
+    ThreadPool m_pool;
+    TextureStreamer m_textures;
+
+    // Jobs the workers have finished decoding, oldest first (guarded by m_mutex)
+    mutable std::mutex m_mutex;
+    std::deque<std::shared_ptr<Job>> m_decoded;
+    size_t m_decoding = 0;
+
+    // The job currently being uploaded (GL thread only)
+    std::shared_ptr<Job> m_uploading;
+};
@@ -108,6 +108,9 @@ void Skybox::load_texture(std::vector<std::string> faces) {
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
     Debug::glErrorCheck();
 
+    // Cube map faces aren't flipped. TextureImage::decode turns flipping on for its thread, so turn it off explicitly here
+    stbi_set_flip_vertically_on_load_thread(false);
+
     // Now we can finally start attaching textures to this cube map
     for (unsigned int i = 0; i < 6; i++) {
         int width;
@@ -134,7 +137,7 @@ void Skybox::load_texture(std::vector<std::string> faces) {
 }
 
 // Draws the skybox (sends any necessary uniforms from skybox to shader)
-void Skybox::draw(Shader shader) {
+void Skybox::draw(Shader& shader) {
     if (!instantiated) {
         return;
     }
@@ -144,10 +147,7 @@ void Skybox::draw(Shader shader) {
     Debug::glErrorCheck();
 
     // Shader should have a "cubemap" field which contains the cubemap texture. Send the texture to it
-    GLuint location = glGetUniformLocation(shader.ID, "skybox");
-    Debug::glErrorCheck();
-    glUniform1i(location, 0);
-    Debug::glErrorCheck();
+    shader.setInt("skybox", 0);
 
     // Draw the skybox
     glBindVertexArray(cubemap_VAO);
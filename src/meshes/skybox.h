@@ -15,7 +15,7 @@ public:
     void load_texture(std::vector<std::string> faces);
 
     // Draws the skybox (sends any necessary uniforms from skybox to shader)
-    void draw(Shader shader);
+    void draw(Shader& shader);
 
     // Cleanup any OpenGL memory
     void cleanup();
@@ -1,18 +1,53 @@
 #include"Texture.h"
 #include <stdexcept>
+#include <utility>
 
 Texture::Texture(const char* image, const char* texType, GLuint slot)
 {
     // Assigns the type of the texture ot the texture object
     type = texType;
 
-    // Stores the width, height, and the number of color channels of the image
-    int widthImg, heightImg, numColCh;
-    // Flips the image so it appears right side up
-    stbi_set_flip_vertically_on_load(true);
-    // Reads the image from a file and stores it in bytes
-    unsigned char* bytes = stbi_load(image, &widthImg, &heightImg, &numColCh, 0);
+    // Reads the image from its conditioned container, or from the file itself
+    TextureImage loaded;
+    loaded.load(image, supportsS3TC());
 
+    create(slot);
+    setImage(loaded, loaded.data.data());
+}
+
+Texture::Texture(std::span<const unsigned char> encoded, const char* texType, GLuint slot)
+{
+    // Assigns the type of the texture ot the texture object
+    type = texType;
+
+    // Decodes the image straight from memory
+    TextureImage decoded;
+    decoded.decode(encoded);
+
+    create(slot);
+    setImage(decoded, decoded.data.data());
+}
+
+Texture::Texture(const char* texType, GLuint slot)
+{
+    // Assigns the type of the texture ot the texture object
+    type = texType;
+
+    // A single white pixel stands in until the real image arrives
+    const unsigned char white[4] = {255, 255, 255, 255};
+    TextureImage placeholder;
+    placeholder.setPixels(white, 1, 1, 4);
+    create(slot);
+    setImage(placeholder, placeholder.data.data());
+}
+
+bool Texture::supportsS3TC()
+{
+    return GLEW_EXT_texture_compression_s3tc != 0;
+}
+
+void Texture::create(GLuint slot)
+{
     // Generates an OpenGL texture object
     glGenTextures(1, &ID);
     Debug::glErrorCheck();
@@ -38,73 +73,75 @@ Texture::Texture(const char* image, const char* texType, GLuint slot)
     // Extra lines in case you choose to use GL_CLAMP_TO_BORDER
     // float flatColor[] = {1.0f, 1.0f, 1.0f, 1.0f};
     // glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, flatColor);
+}
 
-    // Check what type of color channels the texture has and load it accordingly
-    if (numColCh == 4)
-        glTexImage2D
-            (
-                GL_TEXTURE_2D,
-                0,
-                GL_RGBA,
-                widthImg,
-                heightImg,
-                0,
-                GL_RGBA,
-                GL_UNSIGNED_BYTE,
-                bytes
-                );
-    else if (numColCh == 3)
-        glTexImage2D
-            (
-                GL_TEXTURE_2D,
-                0,
-                GL_RGBA,
-                widthImg,
-                heightImg,
-                0,
-                GL_RGB,
-                GL_UNSIGNED_BYTE,
-                bytes
-                );
-    else if (numColCh == 1)
-        glTexImage2D
-            (
-                GL_TEXTURE_2D,
-                0,
-                GL_RGBA,
-                widthImg,
-                heightImg,
-                0,
-                GL_RED,
-                GL_UNSIGNED_BYTE,
-                bytes
-                );
-    else
-        throw std::invalid_argument("Automatic Texture type recognition failed");
-    Debug::glErrorCheck();
-
-    // Generates MipMaps
-    glGenerateMipmap(GL_TEXTURE_2D);
-    Debug::glErrorCheck();
-
-    // Deletes the image data as it is already in the OpenGL Texture object
-    stbi_image_free(bytes);
+void Texture::setImage(const TextureImage& image, const unsigned char* base)
+{
+    glBindTexture(GL_TEXTURE_2D, ID);
+    Debug::glErrorCheck();
+
+    // Rows of 1 and 3 channel images aren't 4 byte aligned unless the width happens to work out
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    Debug::glErrorCheck();
+
+    // Uploads every level in the format it's stored in (a sized format, so 1 channel images take 1 byte per pixel)
+    for (unsigned int i = 0; i < image.levels.size(); i++)
+    {
+        const TextureLevel& level = image.levels[i];
+        const void* pixels = base != nullptr ? static_cast<const void*>(base + level.offset) : reinterpret_cast<const void*>(level.offset);
+        if (image.compressed)
+        {
+            glCompressedTexImage2D(GL_TEXTURE_2D, i, image.internalFormat, level.width, level.height, 0, level.size, pixels);
+        }
+        else
+        {
+            glTexImage2D(GL_TEXTURE_2D, i, image.internalFormat, level.width, level.height, 0, image.format, GL_UNSIGNED_BYTE, pixels);
+        }
+        Debug::glErrorCheck();
+    }
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    Debug::glErrorCheck();
+
+    // Sampling only uses the levels that are there (a texture can go from a generated chain to a shorter stored one)
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, image.hasMipmaps() ? image.levels.size() - 1 : 1000);
+    Debug::glErrorCheck();
+
+    // Generates MipMaps unless the image brought its own
+    if (!image.hasMipmaps())
+    {
+        glGenerateMipmap(GL_TEXTURE_2D);
+        Debug::glErrorCheck();
+    }
 
     // Unbinds the OpenGL Texture object so that it can't accidentally be modified
     glBindTexture(GL_TEXTURE_2D, 0);
     Debug::glErrorCheck();
 }
 
-void Texture::texUnit(Shader shader, const char* uniform, GLuint unit)
+void Texture::setSampler(GLint minFilter, GLint magFilter, GLint wrapS, GLint wrapT)
 {
-    // Gets the location of the uniform
-    GLuint texUni = glGetUniformLocation(shader.ID, uniform);
-    // Shader needs to be activated before changing the value of a uniform
-    shader.Activate();
-    // Sets the value of the uniform
-    glUniform1i(texUni, unit);
+    glBindTexture(GL_TEXTURE_2D, ID);
     Debug::glErrorCheck();
 
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, minFilter);
+    Debug::glErrorCheck();
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, magFilter);
+    Debug::glErrorCheck();
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrapS);
+    Debug::glErrorCheck();
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrapT);
+    Debug::glErrorCheck();
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+    Debug::glErrorCheck();
+}
+
+void Texture::texUnit(Shader& shader, const char* uniform, GLuint unit)
+{
+    // Sets the value of the uniform (the shader has to be active, and only changes reach the driver)
+    shader.setInt(uniform, unit);
+
     // Probably want to reset state
     // NOTE: May want to remove for performance issues
     // shader.Deactivate();
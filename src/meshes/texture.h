@@ -1,8 +1,9 @@
 #pragma once
 
 #include "utils/debug.h"
-#include "libraries/include/stb/stb_image.h"
+#include "meshes/textureimage.h"
 #include "utils/shader.h"
+#include <span>
 
 class Texture
 {
@@ -12,13 +13,31 @@ public:
     GLuint unit;
 
     Texture(const char* image, const char* texType, GLuint slot);
+    // Decodes an image that's already in memory (e.g. a PNG embedded in a .glb file)
+    Texture(std::span<const unsigned char> encoded, const char* texType, GLuint slot);
+    // Makes the texture with a white 1x1 placeholder, for when the real image is decoded elsewhere and set later
+    Texture(const char* texType, GLuint slot);
 
-    // Assigns a texture unit to a texture stored in inputted uniform
-    void texUnit(Shader shader, const char* uniform, GLuint unit);
+    // Whether BC1/BC3 (S3TC) containers can be uploaded here (needs a current context)
+    static bool supportsS3TC();
+
+    // Replaces the image with every level of image, generating the mipmaps if it doesn't carry them
+    // The level data is read from base + level.offset; base can be null to read from the bound GL_PIXEL_UNPACK_BUFFER
+    void setImage(const TextureImage& image, const unsigned char* base);
+
+    // Sets how the texture is filtered and wrapped (GL enums, e.g. from a glTF sampler)
+    void setSampler(GLint minFilter, GLint magFilter, GLint wrapS, GLint wrapT);
+
+    // Assigns a texture unit to a texture stored in inputted uniform (of the active shader)
+    void texUnit(Shader& shader, const char* uniform, GLuint unit);
     // Binds a texture
     void Bind();
     // Unbinds a texture
     void Unbind();
     // Deletes a texture
     void Delete();
+
+private:
+    // Generates the OpenGL texture object and sets how it's sampled
+    void create(GLuint slot);
 };
@@ -0,0 +1,431 @@
+#include "textureimage.h"
+
+#include "meshes/blockcompress.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <utility>
+
+namespace
+{
+// Layout of a .ytex file (a cut down KTX2: one 2D image, its mip chain and where it came from)
+// Every level starts on a 16 byte boundary
+//   ConditionedHeader
+//   ConditionedLevel[levelCount]   largest first, down to 1x1
+//   level data
+// Numbers are stored in native byte order; like .ymesh, it's a local cache rather than an interchange format
+const char conditionedMagic[4] = {'Y', 'T', 'E', 'X'};
+// Bump whenever the layout or the encoders change so old containers are ignored
+const uint32_t conditionedVersion = 1;
+
+struct ConditionedHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t channels;
+    // GL enums; format is 0 when the levels are compressed blocks
+    uint32_t internalFormat;
+    uint32_t format;
+    uint32_t levelCount;
+    // Size and modification time of the image the container was made from
+    uint64_t sourceSize;
+    int64_t sourceModified;
+};
+
+struct ConditionedLevel
+{
+    uint32_t width;
+    uint32_t height;
+    uint64_t offset;
+    uint64_t size;
+};
+
+uint64_t alignUp(uint64_t value)
+{
+    return (value + 15) & ~uint64_t(15);
+}
+
+// Sized internal format and pixel format for uncompressed 8-bit data
+void uncompressedFormat(int channels, GLenum& internalFormat, GLenum& format)
+{
+    switch (channels)
+    {
+    case 1: internalFormat = GL_R8; format = GL_RED; return;
+    case 2: internalFormat = GL_RG8; format = GL_RG; return;
+    case 3: internalFormat = GL_RGB8; format = GL_RGB; return;
+    case 4: internalFormat = GL_RGBA8; format = GL_RGBA; return;
+    default: throw std::invalid_argument("Automatic Texture type recognition failed");
+    }
+}
+
+bool isS3TC(GLenum internalFormat)
+{
+    return internalFormat == GL_COMPRESSED_RGB_S3TC_DXT1_EXT || internalFormat == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+}
+
+// Halves an image with a 2x2 box filter (odd edges reuse the last row/column)
+std::vector<unsigned char> downsample(const std::vector<unsigned char>& src, int width, int height, int channels)
+{
+    int nextWidth = std::max(1, width / 2);
+    int nextHeight = std::max(1, height / 2);
+    std::vector<unsigned char> dst(size_t(nextWidth) * nextHeight * channels);
+    for (int y = 0; y < nextHeight; y++)
+    {
+        int y0 = std::min(2 * y, height - 1);
+        int y1 = std::min(2 * y + 1, height - 1);
+        for (int x = 0; x < nextWidth; x++)
+        {
+            int x0 = std::min(2 * x, width - 1);
+            int x1 = std::min(2 * x + 1, width - 1);
+            for (int c = 0; c < channels; c++)
+            {
+                int sum = src[(size_t(y0) * width + x0) * channels + c] + src[(size_t(y0) * width + x1) * channels + c]
+                          + src[(size_t(y1) * width + x0) * channels + c] + src[(size_t(y1) * width + x1) * channels + c];
+                dst[(size_t(y) * nextWidth + x) * channels + c] = static_cast<unsigned char>((sum + 2) / 4);
+            }
+        }
+    }
+    return dst;
+}
+
+// Whether every pixel of an RGBA image is opaque (then BC1 is enough and takes half the space of BC3)
+bool isOpaque(const unsigned char* pixels, size_t pixelCount)
+{
+    for (size_t i = 0; i < pixelCount; i++)
+    {
+        if (pixels[i * 4 + 3] != 255)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+}
+
+DecodedImage::~DecodedImage()
+{
+    // Deletes the image data (by now it is already in the OpenGL Texture object, or no longer needed)
+    stbi_image_free(pixels);
+}
+
+DecodedImage::DecodedImage(DecodedImage&& other) noexcept
+{
+    pixels = std::exchange(other.pixels, nullptr);
+    width = other.width;
+    height = other.height;
+    channels = other.channels;
+}
+
+DecodedImage& DecodedImage::operator=(DecodedImage&& other) noexcept
+{
+    if (this != &other)
+    {
+        stbi_image_free(pixels);
+        pixels = std::exchange(other.pixels, nullptr);
+        width = other.width;
+        height = other.height;
+        channels = other.channels;
+    }
+    return *this;
+}
+
+// Path of the conditioned container that goes with an image (wood.png -> wood.ytex)
+std::string TextureImage::conditionedPath(const std::string& path)
+{
+    size_t slash = path.find_last_of('/');
+    size_t dot = path.find_last_of('.');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+    {
+        return path + ".ytex";
+    }
+    return path.substr(0, dot) + ".ytex";
+}
+
+void TextureImage::load(const std::string& path, bool allowS3TC)
+{
+    // The container already has every level in its final format, so the image only gets decoded when it's missing or stale
+    if (!loadConditioned(conditionedPath(path), path, allowS3TC))
+    {
+        decode(path);
+    }
+}
+
+void TextureImage::decode(const std::string& path)
+{
+    clear();
+
+    // Flips the image so it appears right side up (per thread, so decoders on other threads don't interfere)
+    stbi_set_flip_vertically_on_load_thread(true);
+
+    decoded.pixels = stbi_load(path.c_str(), &decoded.width, &decoded.height, &decoded.channels, 0);
+    if (decoded.pixels == nullptr)
+    {
+        std::cerr << "Throwing exception from bad texture load of file: " << path << "\n";
+        throw std::runtime_error(std::string("Failed to decode image: ") + stbi_failure_reason());
+    }
+    useDecoded();
+}
+
+void TextureImage::decode(std::span<const unsigned char> encoded)
+{
+    clear();
+
+    // Flips the image so it appears right side up (per thread, so decoders on other threads don't interfere)
+    stbi_set_flip_vertically_on_load_thread(true);
+
+    decoded.pixels = stbi_load_from_memory(encoded.data(), static_cast<int>(encoded.size()), &decoded.width, &decoded.height, &decoded.channels, 0);
+    if (decoded.pixels == nullptr)
+    {
+        throw std::runtime_error(std::string("Failed to decode embedded image: ") + stbi_failure_reason());
+    }
+    useDecoded();
+}
+
+bool TextureImage::loadConditioned(const std::string& path, const std::string& imagePath, bool allowS3TC)
+{
+    clear();
+
+    std::error_code error;
+    if (!std::filesystem::exists(path, error))
+    {
+        return false;
+    }
+
+    try
+    {
+        conditionedFile = MappedFile(path);
+    }
+    catch (const std::exception&)
+    {
+        return false;
+    }
+    std::span<const unsigned char> bytes = conditionedFile.bytes();
+
+    // Anything that doesn't look exactly like what we'd write is ignored, and the image gets decoded instead
+    ConditionedHeader header;
+    if (bytes.size() < sizeof(ConditionedHeader))
+    {
+        clear();
+        return false;
+    }
+    std::memcpy(&header, bytes.data(), sizeof(ConditionedHeader));
+    if (std::memcmp(header.magic, conditionedMagic, 4) != 0 || header.version != conditionedVersion || header.levelCount == 0
+        || (isS3TC(header.internalFormat) && !allowS3TC))
+    {
+        clear();
+        return false;
+    }
+
+    uint64_t size = 0;
+    int64_t modified = 0;
+    if (!MappedFile::stamp(imagePath, size, modified) || size != header.sourceSize || modified != header.sourceModified)
+    {
+        clear();
+        return false;
+    }
+
+    uint64_t levelsOffset = alignUp(sizeof(ConditionedHeader));
+    if (levelsOffset + uint64_t(header.levelCount) * sizeof(ConditionedLevel) > bytes.size())
+    {
+        clear();
+        return false;
+    }
+
+    levels.resize(header.levelCount);
+    for (unsigned int i = 0; i < header.levelCount; i++)
+    {
+        ConditionedLevel level;
+        std::memcpy(&level, bytes.data() + levelsOffset + i * sizeof(ConditionedLevel), sizeof(ConditionedLevel));
+        if (level.offset + level.size > bytes.size())
+        {
+            clear();
+            return false;
+        }
+        levels[i].width = level.width;
+        levels[i].height = level.height;
+        levels[i].offset = level.offset;
+        levels[i].size = level.size;
+    }
+
+    // Level offsets are relative to the start of the file, so data is the whole mapping
+    width = header.width;
+    height = header.height;
+    channels = header.channels;
+    internalFormat = header.internalFormat;
+    format = header.format;
+    compressed = header.format == 0;
+    data = bytes;
+    return true;
+}
+
+// Uses a copy of raw 8-bit pixels as the only level
+void TextureImage::setPixels(const unsigned char* pixels, int widthImg, int heightImg, int numColCh)
+{
+    clear();
+    storage.assign(pixels, pixels + size_t(widthImg) * heightImg * numColCh);
+    width = widthImg;
+    height = heightImg;
+    channels = numColCh;
+    uncompressedFormat(channels, internalFormat, format);
+    levels.push_back({width, height, 0, storage.size()});
+    data = storage;
+}
+
+void TextureImage::condition(const std::string& imagePath, const std::string& path, bool compress)
+{
+    TextureImage image;
+    image.decode(imagePath);
+    int channels = image.channels;
+
+    ConditionedHeader header = {};
+    std::memcpy(header.magic, conditionedMagic, 4);
+    header.version = conditionedVersion;
+    header.width = image.width;
+    header.height = image.height;
+    header.channels = channels;
+    if (!MappedFile::stamp(imagePath, header.sourceSize, header.sourceModified))
+    {
+        throw std::runtime_error("Failed to stat source file: " + imagePath);
+    }
+
+    // Pick the format: the smallest block format that keeps every channel, or the sized format matching the channels
+    GLenum internalFormat;
+    GLenum format;
+    int blockBytes = 0;
+    if (compress)
+    {
+        format = 0;
+        switch (channels)
+        {
+        case 1: internalFormat = GL_COMPRESSED_RED_RGTC1; blockBytes = 8; break;
+        case 2: internalFormat = GL_COMPRESSED_RG_RGTC2; blockBytes = 16; break;
+        case 3: internalFormat = GL_COMPRESSED_RGB_S3TC_DXT1_EXT; blockBytes = 8; break;
+        default:
+        {
+            bool opaque = isOpaque(image.decoded.pixels, size_t(image.width) * image.height);
+            internalFormat = opaque ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+            blockBytes = opaque ? 8 : 16;
+            break;
+        }
+        }
+    }
+    else
+    {
+        uncompressedFormat(channels, internalFormat, format);
+    }
+    header.internalFormat = internalFormat;
+    header.format = format;
+
+    // Build the chain down to 1x1, encoding each level as it's made
+    std::vector<std::vector<unsigned char>> levelData;
+    std::vector<ConditionedLevel> levels;
+    std::vector<unsigned char> pixels(image.decoded.pixels, image.decoded.pixels + image.decoded.size());
+    int levelWidth = image.width;
+    int levelHeight = image.height;
+    unsigned int levelCount = 1;
+    for (int w = levelWidth, h = levelHeight; w > 1 || h > 1; w = std::max(1, w / 2), h = std::max(1, h / 2))
+    {
+        levelCount++;
+    }
+    uint64_t offset = alignUp(alignUp(sizeof(ConditionedHeader)) + levelCount * sizeof(ConditionedLevel));
+    while (true)
+    {
+        std::vector<unsigned char> encoded;
+        if (compress)
+        {
+            encoded.resize(BlockCompress::encodedSize(levelWidth, levelHeight, blockBytes));
+            switch (internalFormat)
+            {
+            case GL_COMPRESSED_RED_RGTC1: BlockCompress::encodeBC4(pixels.data(), levelWidth, levelHeight, encoded.data()); break;
+            case GL_COMPRESSED_RG_RGTC2: BlockCompress::encodeBC5(pixels.data(), levelWidth, levelHeight, encoded.data()); break;
+            case GL_COMPRESSED_RGB_S3TC_DXT1_EXT: BlockCompress::encodeBC1(pixels.data(), levelWidth, levelHeight, channels, encoded.data()); break;
+            default: BlockCompress::encodeBC3(pixels.data(), levelWidth, levelHeight, encoded.data()); break;
+            }
+        }
+        else
+        {
+            encoded = pixels;
+        }
+
+        levels.push_back({uint32_t(levelWidth), uint32_t(levelHeight), offset, encoded.size()});
+        offset = alignUp(offset + encoded.size());
+        levelData.push_back(std::move(encoded));
+
+        if (levelWidth == 1 && levelHeight == 1)
+        {
+            break;
+        }
+        pixels = downsample(pixels, levelWidth, levelHeight, channels);
+        levelWidth = std::max(1, levelWidth / 2);
+        levelHeight = std::max(1, levelHeight / 2);
+    }
+    header.levelCount = levelCount;
+
+    // Write to a temporary file first, so a crash half way never leaves a broken container behind
+    std::string tempPath = path + ".tmp";
+    std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+    if (!out)
+    {
+        throw std::runtime_error("Failed to open file for writing: " + tempPath);
+    }
+
+    uint64_t written = 0;
+    auto write = [&](const void* data, uint64_t size) {
+        out.write(static_cast<const char*>(data), size);
+        written += size;
+    };
+    auto padTo = [&](uint64_t offset) {
+        static const char zeros[16] = {};
+        write(zeros, offset - written);
+    };
+
+    write(&header, sizeof(ConditionedHeader));
+    padTo(alignUp(sizeof(ConditionedHeader)));
+    write(levels.data(), levels.size() * sizeof(ConditionedLevel));
+    for (unsigned int i = 0; i < levels.size(); i++)
+    {
+        padTo(levels[i].offset);
+        write(levelData[i].data(), levelData[i].size());
+    }
+
+    out.close();
+    if (!out)
+    {
+        throw std::runtime_error("Failed to write file: " + tempPath);
+    }
+    std::filesystem::rename(tempPath, path);
+}
+
+// Lets go of the pixels and any file mapping
+void TextureImage::clear()
+{
+    width = 0;
+    height = 0;
+    channels = 0;
+    internalFormat = GL_RGBA8;
+    format = GL_RGBA;
+    compressed = false;
+    levels.clear();
+    data = {};
+
+    decoded = DecodedImage();
+    conditionedFile.release();
+    storage.clear();
+}
+
+// Makes the decoded pixels the only level
+void TextureImage::useDecoded()
+{
+    width = decoded.width;
+    height = decoded.height;
+    channels = decoded.channels;
+    uncompressedFormat(channels, internalFormat, format);
+    levels.push_back({width, height, 0, decoded.size()});
+    data = std::span<const unsigned char>(decoded.pixels, decoded.size());
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "libraries/include/stb/stb_image.h"
+#include "utils/debug.h"
+#include "utils/mappedfile.h"
+#include <span>
+#include <string>
+#include <vector>
+
+// Pixels decoded by stb_image
+struct DecodedImage
+{
+    unsigned char* pixels = nullptr;
+    int width = 0;
+    int height = 0;
+    int channels = 0;
+
+    DecodedImage() = default;
+    ~DecodedImage();
+    DecodedImage(DecodedImage&& other) noexcept;
+    DecodedImage& operator=(DecodedImage&& other) noexcept;
+    DecodedImage(const DecodedImage&) = delete;
+    DecodedImage& operator=(const DecodedImage&) = delete;
+
+    size_t size() const { return size_t(width) * height * channels; }
+};
+
+// One mip level, as a part of TextureImage::data
+struct TextureLevel
+{
+    int width = 0;
+    int height = 0;
+    size_t offset = 0;
+    size_t size = 0;
+};
+
+// A texture ready to hand to glTexImage2D/glCompressedTexImage2D, decoded without touching OpenGL (so on any thread)
+// Comes either from an image file, which gives a single level the driver makes the mipmaps from, or from the .ytex
+// container the conditioning step writes next to it, which holds the whole mip chain (optionally BC compressed)
+class TextureImage
+{
+public:
+    // Path of the conditioned container that goes with an image (wood.png -> wood.ytex)
+    static std::string conditionedPath(const std::string& path);
+
+    // Loads an image from its .ytex when that's up to date and usable, and decodes the image file otherwise
+    // allowS3TC says whether the GL implementation can take BC1/BC3 data (RGTC is core, so it's always allowed)
+    void load(const std::string& path, bool allowS3TC);
+    // Decodes an image file or an encoded image in memory, flipped so it appears right side up
+    // Throws std::runtime_error if the image can't be decoded
+    void decode(const std::string& path);
+    void decode(std::span<const unsigned char> encoded);
+    // Maps a .ytex file. Returns false if it's missing, from another version, older than its image, or needs S3TC when that's not allowed
+    bool loadConditioned(const std::string& path, const std::string& imagePath, bool allowS3TC);
+    // Uses a copy of raw 8-bit pixels as the only level
+    void setPixels(const unsigned char* pixels, int widthImg, int heightImg, int numColCh);
+
+    // Decodes an image, builds its mip chain (BC compressing every level if compress is set) and writes it to a .ytex
+    // Throws std::runtime_error if the image can't be decoded or the container can't be written
+    static void condition(const std::string& imagePath, const std::string& path, bool compress);
+
+    // Lets go of the pixels and any file mapping
+    void clear();
+
+    // Size of the top level and how many channels the source image had
+    int width = 0;
+    int height = 0;
+    int channels = 0;
+    // Sized internal format (GL_R8 ... GL_RGBA8, or a compressed format) and the pixel format for uncompressed data
+    GLenum internalFormat = GL_RGBA8;
+    GLenum format = GL_RGBA;
+    bool compressed = false;
+    // The mip chain, largest first. Holds only level 0 when the mipmaps are left to glGenerateMipmap
+    std::vector<TextureLevel> levels;
+    // Every level back to back (points into the decoded pixels, the mapped .ytex or storage, so only valid until clear())
+    std::span<const unsigned char> data;
+
+    // True if levels is the complete chain down to 1x1
+    bool hasMipmaps() const { return levels.size() > 1 || compressed; }
+
+private:
+    DecodedImage decoded;
+    MappedFile conditionedFile;
+    std::vector<unsigned char> storage;
+
+    // Makes the decoded pixels the only level
+    void useDecoded();
+};
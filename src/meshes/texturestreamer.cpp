@@ -0,0 +1,160 @@
+#include "texturestreamer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+TextureStreamer::TextureStreamer(ThreadPool& pool) : m_pool(pool) {
+}
+
+// Creates the texture straight away (with a placeholder image) and starts decoding the real one
+Texture TextureStreamer::request(const TextureData& texture, GLuint slot, std::weak_ptr<void> owner) {
+    std::shared_ptr<Job> job = std::make_shared<Job>(Texture(texture.type, slot));
+    job->owner = owner;
+    job->path = texture.path;
+    job->allowS3TC = Texture::supportsS3TC();
+    if (texture.path.empty()) {
+        job->encoded.assign(texture.encoded.begin(), texture.encoded.end());
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_decoding++;
+    }
+
+    m_pool.enqueue([this, job] {
+        // No point decoding an image no one is going to see
+        if (!job->owner.expired()) {
+            try {
+                if (job->path.empty()) {
+                    job->image.decode(job->encoded);
+                } else {
+                    job->image.load(job->path, job->allowS3TC);
+                }
+            } catch (const std::exception& e) {
+                std::cerr << "Failed to load texture " << job->path << ": " << e.what() << "\n";
+                job->failed = true;
+            }
+        }
+        job->encoded.clear();
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_decoding--;
+        m_decoded.push_back(job);
+    });
+
+    return job->texture;
+}
+
+// Streams decoded images to the GPU until budgetMs has passed
+void TextureStreamer::upload(double budgetMs) {
+    auto start = std::chrono::steady_clock::now();
+    auto elapsedMs = [&] {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    };
+
+    do {
+        if (m_uploading == nullptr) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_decoded.empty()) {
+                return;
+            }
+            m_uploading = m_decoded.front();
+            m_decoded.pop_front();
+        }
+
+        // If whoever owns the texture has deleted it, or the image couldn't be decoded, keep what's there
+        Job& job = *m_uploading;
+        if (job.owner.expired() || job.failed || job.image.data.empty()) {
+            releaseBuffer(job);
+            m_uploading = nullptr;
+            continue;
+        }
+
+        // Map an unpack buffer big enough for every level (invalidating, so the driver never has to wait on it)
+        size_t size = job.image.data.size();
+        if (job.pbo == 0) {
+            glGenBuffers(1, &job.pbo);
+            Debug::glErrorCheck();
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, job.pbo);
+            Debug::glErrorCheck();
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, size, nullptr, GL_STREAM_DRAW);
+            Debug::glErrorCheck();
+            job.mapped = static_cast<unsigned char*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+            Debug::glErrorCheck();
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            Debug::glErrorCheck();
+            job.copied = 0;
+            if (job.mapped == nullptr) {
+                // Couldn't map it, so upload straight from memory instead
+                releaseBuffer(job);
+                job.texture.setImage(job.image, job.image.data.data());
+                m_uploading = nullptr;
+                continue;
+            }
+        }
+
+        // Copy the next chunk (the buffer stays mapped between frames, GL doesn't touch it until it's unmapped)
+        size_t chunk = std::min(chunkBytes, size - job.copied);
+        std::memcpy(job.mapped + job.copied, job.image.data.data() + job.copied, chunk);
+        job.copied += chunk;
+        if (job.copied < size) {
+            continue;
+        }
+
+        // All there: hand the buffer to GL, which copies it into the texture without the CPU waiting on it
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, job.pbo);
+        Debug::glErrorCheck();
+        GLboolean intact = glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        Debug::glErrorCheck();
+        job.mapped = nullptr;
+        if (intact == GL_TRUE) {
+            job.texture.setImage(job.image, nullptr);
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        Debug::glErrorCheck();
+        releaseBuffer(job);
+
+        // The buffer's contents can be lost while it's mapped (rare), in which case the copy starts over
+        if (intact != GL_TRUE) {
+            continue;
+        }
+        m_uploading = nullptr;
+    } while (elapsedMs() < budgetMs);
+}
+
+// Number of textures still decoding or streaming
+size_t TextureStreamer::pending() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_decoding + m_decoded.size() + (m_uploading != nullptr ? 1 : 0);
+}
+
+// Drops everything not uploaded yet and deletes the unpack buffers
+void TextureStreamer::shutdown() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_uploading != nullptr) {
+        releaseBuffer(*m_uploading);
+        m_uploading = nullptr;
+    }
+    m_decoded.clear();
+    m_decoding = 0;
+}
+
+// Frees a job's unpack buffer (unmapping it first if it's still mapped)
+void TextureStreamer::releaseBuffer(Job& job) {
+    if (job.pbo == 0) {
+        return;
+    }
+    if (job.mapped != nullptr) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, job.pbo);
+        Debug::glErrorCheck();
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        Debug::glErrorCheck();
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        Debug::glErrorCheck();
+        job.mapped = nullptr;
+    }
+    glDeleteBuffers(1, &job.pbo);
+    Debug::glErrorCheck();
+    job.pbo = 0;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "Texture.h"
+#include "meshes/modeldata.h"
+#include "utils/threadpool.h"
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Gets textures onto the GPU without stalling the GL thread
+// Images are decoded (or their .ytex containers mapped) in parallel on a thread pool, copied into pixel unpack buffers a chunk at a time over as many
+// frames as it takes, and then set on the texture in one go, replacing the placeholder it was created with
+class TextureStreamer
+{
+public:
+    explicit TextureStreamer(ThreadPool& pool);
+
+    // Creates the texture straight away (with a placeholder image) and starts decoding the real one (GL thread only)
+    // owner is whatever deletes the texture; if it's gone by the time the image is ready, the image is dropped
+    Texture request(const TextureData& texture, GLuint slot, std::weak_ptr<void> owner);
+
+    // Streams decoded images to the GPU until budgetMs has passed (GL thread only, with the context current)
+    // At least one step is done per call, so streaming always makes progress
+    void upload(double budgetMs);
+
+    // Number of textures still decoding or streaming
+    size_t pending() const;
+
+    // Drops everything not uploaded yet and deletes the unpack buffers (the GL context must be current)
+    // The pool must already have been shut down, so nothing is still decoding
+    void shutdown();
+
+private:
+    // One image on its way from the file to the GPU
+    struct Job
+    {
+        Job(const Texture& texture) : texture(texture) {}
+
+        Texture texture;
+        std::weak_ptr<void> owner;
+        // Where the image comes from: a file, or a copy of the encoded bytes (the model's mappings don't live long enough)
+        std::string path;
+        std::vector<unsigned char> encoded;
+        // Whether a BC1/BC3 container can be used (checked on the GL thread when the job is made)
+        bool allowS3TC = false;
+
+        // Filled in by the worker: the image file's conditioned container, or the decoded image
+        TextureImage image;
+        bool failed = false;
+
+        // Pixel unpack buffer being filled, and how much of the image has been copied into it
+        GLuint pbo = 0;
+        unsigned char* mapped = nullptr;
+        size_t copied = 0;
+    };
+
+    // Bytes copied into an unpack buffer per step, so one big image is spread over several frames
+    static const size_t chunkBytes = 1 << 20;
+
+    // Frees a job's unpack buffer (unmapping it first if it's still mapped)
+    void releaseBuffer(Job& job);
+
+    ThreadPool& m_pool;
+
+    // Jobs the workers have finished decoding, oldest first (guarded by m_mutex)
+    mutable std::mutex m_mutex;
+    std::deque<std::shared_ptr<Job>> m_decoded;
+    size_t m_decoding = 0;
+
+    // The job currently being streamed (GL thread only)
+    std::shared_ptr<Job> m_uploading;
+};
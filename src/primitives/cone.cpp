@@ -18,13 +18,13 @@ Cone::~Cone() {
 }
 
 // Function to draw the cone
-void Cone::draw(GLuint shader) {
+void Cone::draw_instances(GLsizei count) {
     // If there aren't enough wedges, don't render this shape
     if (shape_parameter_2 < 3 || shape_parameter_1 < 1) {
         return;
     }
 
-    Primitive::draw(shader);
+    Primitive::draw_instances(count);
 }
 
 // Function to delete buffers
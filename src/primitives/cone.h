@@ -17,7 +17,7 @@ public:
     ~Cone();
 
     // Function to draw Cone (don't draw if certain shape params set)
-    void draw(GLuint shader);
+    void draw_instances(GLsizei count) override;
 
     // Function to delete buffers
     void delete_buffers() override;
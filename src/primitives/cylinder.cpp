@@ -33,13 +33,13 @@ void Cylinder::delete_buffers() {
 }
 
 // Function to draw the cylinder
-void Cylinder::draw(GLuint shader) {
+void Cylinder::draw_instances(GLsizei count) {
     // If there aren't enough wedges, don't render this shape
     if (shape_parameter_2 < 3 || shape_parameter_1 < 1) {
         return;
     }
 
-    Primitive::draw(shader);
+    Primitive::draw_instances(count);
 }
 
 // Helper functiont to make a tile (sector) of a cylinder on the side
@@ -8,6 +8,11 @@ Primitive::Primitive(const glm::mat4 &pctm, const ScenePrimitive &pprimitive) {
     // Initialize the normal transforming matrix
     m_inverse_normal = glm::inverse(glm::transpose(glm::mat3(m_model)));
 
+    // Every primitive fits in the unit cube around the origin, so the bounding box is that cube after the CTM
+    // (each axis of the new box reaches as far as the cube's half extents do along it)
+    m_bounds_center = glm::vec3(m_model[3]);
+    m_bounds_extent = 0.5f * (glm::abs(glm::vec3(m_model[0])) + glm::abs(glm::vec3(m_model[1])) + glm::abs(glm::vec3(m_model[2])));
+
     // Store relevant data for coloring/lighting in relevant fields
     m_ambient = pprimitive.material.cAmbient;
     m_diffuse = pprimitive.material.cDiffuse;
@@ -21,6 +26,8 @@ Primitive::Primitive() {
     m_model = glm::mat4(1.0f);
     m_inverse_model = glm::mat4(1.0f);
     m_inverse_normal = glm::mat3(1.0f);
+    m_bounds_center = glm::vec3(0.0f);
+    m_bounds_extent = glm::vec3(0.5f);
 
     // Junk lighting data
     m_ambient = glm::vec4(1.0f);
@@ -29,6 +36,15 @@ Primitive::Primitive() {
     m_shininess = 1.0f;
 }
 
+// Getters for the world space bounding box
+glm::vec3 Primitive::get_bounds_center() const {
+    return m_bounds_center;
+}
+
+glm::vec3 Primitive::get_bounds_extent() const {
+    return m_bounds_extent;
+}
+
 // Easily converts from cylindrical to cartesian coordinates
 glm::vec3 Primitive::cylinder_to_cartesian(float theta, float r, float h) {
     // Using:
@@ -54,53 +70,33 @@ void Primitive::insert_vec3(std::vector<GLfloat> &data, glm::vec3 vec) {
     data.push_back(vec.z);
 }
 
-// Draws the shape in OpenGL (yay, we're using OpenGL now!)
+// Packs the model matrix, normal matrix and material for an instance buffer
+PrimitiveInstance Primitive::get_instance() const {
+    PrimitiveInstance instance;
+    instance.model_matrix = m_model;
+    instance.inverse_model_normal_matrix = m_inverse_normal;
+    instance.ambient = m_ambient;
+    instance.diffuse = m_diffuse;
+    instance.specular = m_specular;
+    instance.shininess = m_shininess;
+    return instance;
+}
+
+// Draws the shape in OpenGL (yay, we're using OpenGL now!), once per instance
 // NOTE: Assumes the shader is already bound (this is an expensive operation)
 // Also assume that camera and projection matrices have already been passed in
-// Assumes relevant VAO has already been bound
-void Primitive::draw(GLuint shader) {
+// Assumes relevant VAO has already been bound, with the instances attached to it
+// Every per-primitive value comes from the instance attributes, so there's nothing to set between draws
+void Primitive::draw_instances(GLsizei count) {
     // Do not attempt to draw if VAO or VBO does not exist (the mesh hasn't been generated)
     assert(get_vao() != 0);
     assert(get_vbo() != 0);
 
-    // Pass in necessary uniforms
-    // Note that the view and projection matrices (from Camera) should already be passed in
-    GLuint location;
-
-    // Pass in model matrix
-    location = glGetUniformLocation(shader, "model_matrix");
-    Debug::glErrorCheck();
-    glUniformMatrix4fv(location, 1, GL_FALSE, &(m_model[0][0]));
-    Debug::glErrorCheck();
-
-    // Pass in upper 3x3 transpose inverse for normal computation
-    location = glGetUniformLocation(shader, "inverse_model_normal_matrix");
-    Debug::glErrorCheck();
-    glUniformMatrix3fv(location, 1, GL_FALSE, &(m_inverse_normal[0][0]));
-    Debug::glErrorCheck();
-
-    // Pass in relevant uniforms for primitive
-    location = glGetUniformLocation(shader, "ambient");
-    Debug::glErrorCheck();
-    glUniform4f(location, m_ambient[0], m_ambient[1], m_ambient[2], m_ambient[3]);
-    Debug::glErrorCheck();
-
-    location = glGetUniformLocation(shader, "diffuse");
-    Debug::glErrorCheck();
-    glUniform4f(location, m_diffuse[0], m_diffuse[1], m_diffuse[2], m_diffuse[3]);
-    Debug::glErrorCheck();
-
-    location = glGetUniformLocation(shader, "specular");
-    Debug::glErrorCheck();
-    glUniform4f(location, m_specular[0], m_specular[1], m_specular[2], m_specular[3]);
-    Debug::glErrorCheck();
-
-    location = glGetUniformLocation(shader, "shininess");
-    Debug::glErrorCheck();
-    glUniform1f(location, m_shininess);
-    Debug::glErrorCheck();
+    if (count == 0) {
+        return;
+    }
 
-    // Then draw it
-    glDrawArrays(GL_TRIANGLES, 0, get_triangles() * 3);
+    // Then draw all of them
+    glDrawArraysInstanced(GL_TRIANGLES, 0, get_triangles() * 3, count);
     Debug::glErrorCheck();
 }
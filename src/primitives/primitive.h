@@ -5,8 +5,21 @@
 #include "utils/scenedata.h"
 #include "glm/glm.hpp"
 #include "utils/debug.h"
+#include "utils/shader.h"
 #include "numbers"
 
+// What one primitive draws with: its transforms and material, laid out as phong.vert's instance attributes read it
+// (locations 2 to 12, see PrimitiveInstances::attach)
+struct PrimitiveInstance {
+    glm::mat4 model_matrix;
+    glm::mat3 inverse_model_normal_matrix;
+    glm::vec4 ambient;
+    glm::vec4 diffuse;
+    glm::vec4 specular;
+    float shininess;
+};
+static_assert(sizeof(PrimitiveInstance) == 152);
+
 class Primitive
 {
 public:
@@ -14,8 +27,15 @@ public:
     Primitive(const glm::mat4 &pctm, const ScenePrimitive &pprimitive);
     Primitive();
 
-    // Function to draw this primitive in OpenGL
-    void draw(GLuint shader);
+    // Draws count primitives of this type, one per instance bound to its VAO (see PrimitiveInstances)
+    virtual void draw_instances(GLsizei count);
+
+    // This primitive's transforms and material, as they go into an instance buffer
+    PrimitiveInstance get_instance() const;
+
+    // World space bounding box (center plus or minus extent), for frustum culling
+    glm::vec3 get_bounds_center() const;
+    glm::vec3 get_bounds_extent() const;
 
     // Generates mesh for this primitive and binds VAOs and VBOs to it
     virtual void generate_mesh(const int shape_param_1, const int shape_param_2) = 0;
@@ -56,6 +76,10 @@ protected:
     // Matrix for transforming normal vectors
     glm::mat3 m_inverse_normal;
 
+    // Bounding box of the unit primitive after the CTM
+    glm::vec3 m_bounds_center;
+    glm::vec3 m_bounds_extent;
+
     // Fields to determine color for ambient, diffuse, specular
     glm::vec4 m_ambient;
     glm::vec4 m_diffuse;
@@ -0,0 +1,114 @@
+#include "primitiveinstances.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+
+// First instance attribute in phong.vert (after position and normal)
+static const GLuint first_instance_location = 2;
+
+// Keeps the instances and makes room for all of them in the buffer (the buffer keeps its name, so the VAOs it's
+// attached to stay attached)
+void PrimitiveInstances::build(std::vector<PrimitiveInstance> instances) {
+    m_instances = std::move(instances);
+    m_packed.clear();
+    m_packed_visible.clear();
+
+    if (m_vbo == 0) {
+        glGenBuffers(1, &m_vbo);
+        Debug::glErrorCheck();
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+    Debug::glErrorCheck();
+    glBufferData(GL_ARRAY_BUFFER, m_instances.size() * sizeof(PrimitiveInstance), nullptr, GL_DYNAMIC_DRAW);
+    Debug::glErrorCheck();
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    Debug::glErrorCheck();
+}
+
+// Sets up locations 2 to 12 to step once per instance:
+// model matrix (4 columns), normal matrix (3 columns), ambient, diffuse, specular and shininess
+void PrimitiveInstances::attach(GLuint vao) {
+    if (m_vbo == 0 || vao == 0) {
+        return;
+    }
+
+    struct Attribute {
+        GLint size;
+        size_t offset;
+    };
+    const Attribute attributes[] = {
+        {4, offsetof(PrimitiveInstance, model_matrix)},
+        {4, offsetof(PrimitiveInstance, model_matrix) + sizeof(glm::vec4)},
+        {4, offsetof(PrimitiveInstance, model_matrix) + 2 * sizeof(glm::vec4)},
+        {4, offsetof(PrimitiveInstance, model_matrix) + 3 * sizeof(glm::vec4)},
+        {3, offsetof(PrimitiveInstance, inverse_model_normal_matrix)},
+        {3, offsetof(PrimitiveInstance, inverse_model_normal_matrix) + sizeof(glm::vec3)},
+        {3, offsetof(PrimitiveInstance, inverse_model_normal_matrix) + 2 * sizeof(glm::vec3)},
+        {4, offsetof(PrimitiveInstance, ambient)},
+        {4, offsetof(PrimitiveInstance, diffuse)},
+        {4, offsetof(PrimitiveInstance, specular)},
+        {1, offsetof(PrimitiveInstance, shininess)},
+    };
+
+    glBindVertexArray(vao);
+    Debug::glErrorCheck();
+    glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+    Debug::glErrorCheck();
+    for (GLuint i = 0; i < std::size(attributes); i++) {
+        GLuint location = first_instance_location + i;
+        glEnableVertexAttribArray(location);
+        Debug::glErrorCheck();
+        glVertexAttribPointer(location, attributes[i].size, GL_FLOAT, GL_FALSE, sizeof(PrimitiveInstance), reinterpret_cast<void*>(attributes[i].offset));
+        Debug::glErrorCheck();
+        glVertexAttribDivisor(location, 1);
+        Debug::glErrorCheck();
+    }
+    glBindVertexArray(0);
+    Debug::glErrorCheck();
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    Debug::glErrorCheck();
+}
+
+// Packs the visible instances to the front of the buffer, skipping the upload if visibility hasn't changed
+GLsizei PrimitiveInstances::update_visible(const std::vector<unsigned char> &visible, size_t first) {
+    if (m_vbo == 0) {
+        return 0;
+    }
+
+    auto begin = visible.begin() + first;
+    auto end = begin + m_instances.size();
+    if (m_packed_visible.size() == m_instances.size() && std::equal(begin, end, m_packed_visible.begin())) {
+        return m_packed.size();
+    }
+    m_packed_visible.assign(begin, end);
+
+    m_packed.clear();
+    for (size_t i = 0; i < m_instances.size(); i++) {
+        if (m_packed_visible[i]) {
+            m_packed.push_back(m_instances[i]);
+        }
+    }
+
+    if (!m_packed.empty()) {
+        glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+        Debug::glErrorCheck();
+        glBufferSubData(GL_ARRAY_BUFFER, 0, m_packed.size() * sizeof(PrimitiveInstance), m_packed.data());
+        Debug::glErrorCheck();
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        Debug::glErrorCheck();
+    }
+    return m_packed.size();
+}
+
+// Function to delete the instance buffer
+void PrimitiveInstances::delete_buffers() {
+    if (m_vbo != 0) {
+        glDeleteBuffers(1, &m_vbo);
+        Debug::glErrorCheck();
+        m_vbo = 0;
+    }
+    m_instances.clear();
+    m_packed.clear();
+    m_packed_visible.clear();
+}
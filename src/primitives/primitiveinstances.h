@@ -0,0 +1,50 @@
+#ifndef PRIMITIVEINSTANCES_H
+#define PRIMITIVEINSTANCES_H
+
+#include "primitive.h"
+#include <vector>
+
+// Instance buffer for every primitive of one type in the scene, so the whole type goes out in one instanced draw
+// (instead of six uniforms and a glDrawArrays per primitive)
+// Built when the scene changes; after that only the visible instances are packed to the front of the buffer, and
+// only on frames where what's visible has changed
+class PrimitiveInstances
+{
+public:
+    // Takes the instances of the scene's primitives of this type (in the order they're culled in)
+    template <typename T>
+    void build(const std::vector<T> &primitives) {
+        std::vector<PrimitiveInstance> instances;
+        instances.reserve(primitives.size());
+        for (const T &primitive : primitives) {
+            instances.push_back(primitive.get_instance());
+        }
+        build(std::move(instances));
+    }
+    void build(std::vector<PrimitiveInstance> instances);
+
+    // Points the instance attributes of a primitive type's VAO at the buffer (again whenever the VAO is regenerated)
+    // Does nothing until there's a buffer or a VAO
+    void attach(GLuint vao);
+
+    // Packs the instances marked in visible (this type's run of it starts at first) into the buffer, and returns how
+    // many there are to draw
+    GLsizei update_visible(const std::vector<unsigned char> &visible, size_t first);
+
+    // Number of primitives of this type in the scene
+    size_t size() const { return m_instances.size(); }
+
+    // Deletes the instance buffer
+    void delete_buffers();
+
+private:
+    GLuint m_vbo = 0;
+
+    // Every instance, and the visible ones as they were last uploaded
+    std::vector<PrimitiveInstance> m_instances;
+    std::vector<PrimitiveInstance> m_packed;
+    // Visibility the buffer was last packed for (empty after building, so the first frame always packs)
+    std::vector<unsigned char> m_packed_visible;
+};
+
+#endif // PRIMITIVEINSTANCES_H
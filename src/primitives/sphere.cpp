@@ -33,14 +33,14 @@ void Sphere::delete_buffers() {
 }
 
 // Drawing function (does not render if params are small enough)
-void Sphere::draw(GLuint shader) {
+void Sphere::draw_instances(GLsizei count) {
     // If minimum shape params are not met, do not draw
     if (shape_parameter_1 < 2 || shape_parameter_2 < 3) {
         return;
     }
 
     // Otherwise draw
-    Primitive::draw(shader);
+    Primitive::draw_instances(count);
 }
 
 // Helper function to make a tile (sector) of a sphere. Used in making mesh
@@ -17,7 +17,7 @@ public:
     ~Sphere();
 
     // Draw function with additional functionality to check params
-    void draw(GLuint shader);
+    void draw_instances(GLsizei count) override;
 
     // Function to delete buffers
     void delete_buffers() override;
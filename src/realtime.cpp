@@ -3,6 +3,7 @@
 #include "realtime.h"
 
 #include <QCoreApplication>
+#include <QThread>
 #include <QMouseEvent>
 #include <QKeyEvent>
 #include <iostream>
@@ -10,7 +11,12 @@
 #include "settings.h"
 #include <glm/gtc/matrix_transform.hpp>
 #include <random>
+#include <algorithm>
 #include "noise/fastnoise.h"
+#include "meshes/lod.h"
+#include "meshes/instanceculler.h"
+#include "renderthread.h"
+#include "utils/gldeletequeue.h"
 #include <glm/gtx/string_cast.hpp>
 
 // ================== Project 5: Lights, Camera
@@ -29,6 +35,11 @@ Realtime::Realtime(QWidget *parent)
     m_keyMap[Qt::Key_Control] = false;
     m_keyMap[Qt::Key_Space]   = false;
 
+    // Frames are drawn on a thread of their own if asked for on the command line
+    m_use_render_thread = QCoreApplication::arguments().contains("--render-thread");
+    // Opaque geometry fills in the depth buffer before it's shaded, unless that's turned off on the command line
+    m_render_queue.depthPrepass = !QCoreApplication::arguments().contains("--no-depth-prepass");
+
     // TIME TO INITIALIZE ALL OUR FIELDS!!!
 
     // Configure default primitive pointers
@@ -37,11 +48,6 @@ Realtime::Realtime(QWidget *parent)
     default_cylinder = Cylinder();
     default_cone = Cone();
 
-    // Configure lights (disable them all)
-    for (int i = 0; i < 8; i++) {
-        lights[i].type = -1;
-    }
-
     // Initialize global data
     ka = 0;
     kd = 0;
@@ -72,6 +78,14 @@ Realtime::Realtime(QWidget *parent)
     m_instancing_shader = Shader();
     m_skybox_shader = Shader();
     m_spaceship_shader = Shader();
+    m_model_batch_shader = Shader();
+    m_spaceship_batch_shader = Shader();
+    m_phong_depth_shader = Shader();
+    m_model_depth_shader = Shader();
+    m_instancing_depth_shader = Shader();
+    m_spaceship_depth_shader = Shader();
+    m_model_batch_depth_shader = Shader();
+    m_spaceship_batch_depth_shader = Shader();
 
     // MODELS!
     planet1 = Model();
@@ -83,18 +97,10 @@ Realtime::Realtime(QWidget *parent)
     // SKYBOX!
     box = Skybox();
 
-    // Plane movement params
-    speed = 0.1f;
-
-    // Spaceship data for controlling rotation
-    pitch_radians = 0.0f;
-    roll_radians = 0.0f;
-    yaw_radians = 0.0f;
-
-    // Spaceship data for determining rotation
-    delta_pitch = 0.0f;
-    delta_roll = 0.0f;
-    delta_yaw = 0.0f;
+    // Plane movement params (and rotation)
+    m_flight = FlightState();
+    m_prev_flight = m_flight;
+    m_drawn_flight = m_flight;
 
     planets_instantiated = false;
 
@@ -102,7 +108,13 @@ Realtime::Realtime(QWidget *parent)
 }
 
 void Realtime::finish() {
-    killTimer(m_timer);
+    // Frames stop first, which leaves the context back on this thread
+    if (m_render_thread != nullptr) {
+        m_render_thread->stop();
+        delete m_render_thread;
+        m_render_thread = nullptr;
+    }
+
     this->makeCurrent();
 
     // Students: anything requiring OpenGL calls when the program exits should be done here
@@ -122,12 +134,17 @@ void Realtime::finish() {
         Debug::glErrorCheck();
     }
 
+    // Stop loading models (anything half uploaded is freed here)
+    m_model_loader.shutdown();
+
     // Clean up all associated model data here
     planet1.cleanup();
     planet2.cleanup();
     planet3.cleanup();
     asteroids.cleanup();
     spaceship.cleanup();
+    // Freed assets only queue their GL objects, so they're deleted now, while the context is current
+    GLDeleteQueue::flush();
 
     // Cleanup all shader stuff here
     m_phong_shader.Delete();
@@ -136,10 +153,133 @@ void Realtime::finish() {
     m_instancing_shader.Delete();
     m_skybox_shader.Delete();
     m_spaceship_shader.Delete();
+    m_model_batch_shader.Delete();
+    m_spaceship_batch_shader.Delete();
+    m_phong_depth_shader.Delete();
+    m_model_depth_shader.Delete();
+    m_instancing_depth_shader.Delete();
+    m_spaceship_depth_shader.Delete();
+    m_model_batch_depth_shader.Delete();
+    m_spaceship_batch_depth_shader.Delete();
+    InstanceCuller::deletePrograms();
+
+    // And the uniform buffers they read from
+    m_frame_ubo.Delete();
+    m_light_ubo.Delete();
+    RingBuffer::deleteFences();
 
     this->doneCurrent();
 }
 
+// Starts drawing frames on the render thread, and has Qt wait for whatever frame is being drawn before it uses the
+// context on this thread (to compose the widget, or resize its framebuffer)
+void Realtime::start_render_thread() {
+    m_render_thread = new RenderThread(this);
+    connect(this, &QOpenGLWidget::aboutToCompose, this, [this]() {
+        if (m_render_thread != nullptr) {
+            m_render_thread->lock();
+        }
+    });
+    // Once a frame is on screen, the next one can start
+    connect(this, &QOpenGLWidget::frameSwapped, this, [this]() {
+        if (m_render_thread != nullptr) {
+            m_render_thread->unlock();
+            m_render_thread->request_frame();
+        }
+    });
+    connect(this, &QOpenGLWidget::aboutToResize, this, [this]() {
+        if (m_render_thread != nullptr) {
+            m_render_thread->lock();
+        }
+    });
+    connect(this, &QOpenGLWidget::resized, this, [this]() {
+        if (m_render_thread != nullptr) {
+            m_render_thread->unlock();
+        }
+    });
+    m_render_thread->start();
+}
+
+// Hands a call over to the render thread when it's made on the GUI thread, with a copy of the settings as they are now
+// Returns false when the call should go ahead where it is (there's no render thread, or this is it)
+bool Realtime::post_to_render_thread(RenderCommand command) {
+    if (m_render_thread == nullptr) {
+        m_settings = settings;
+        return false;
+    }
+    if (QThread::currentThread() == m_render_thread->thread()) {
+        return false;
+    }
+    command.settings = settings;
+    // The render thread empties the queue every frame, so it's only ever full for a moment (and only this thread waits)
+    while (!m_render_commands.push(command)) {
+        QThread::yieldCurrentThread();
+    }
+    return true;
+}
+
+// saveViewportImage draws with the context, so with a render thread it's called there instead
+void Realtime::save_image(std::string file_path) {
+    RenderCommand command;
+    command.type = RenderCommand::Type::SaveImage;
+    command.path = file_path;
+    if (post_to_render_thread(command)) {
+        return;
+    }
+    saveViewportImage(file_path);
+}
+
+// Makes a call the GUI thread posted (on the render thread, with the settings it was posted with)
+void Realtime::run_command(const RenderCommand& command) {
+    m_settings = command.settings;
+    switch (command.type) {
+        case RenderCommand::Type::Key:
+            m_keyMap[command.key] = command.pressed;
+            note_input(command.time);
+            break;
+        case RenderCommand::Type::Resize:
+            resizeGL(command.width, command.height);
+            break;
+        case RenderCommand::Type::SettingsChanged:
+            settingsChanged();
+            break;
+        case RenderCommand::Type::SceneChanged:
+            sceneChanged();
+            break;
+        case RenderCommand::Type::GenerateScene:
+            generate_scene();
+            break;
+        case RenderCommand::Type::SaveImage:
+            saveViewportImage(command.path);
+            break;
+    }
+}
+
+// Catches up on what the GUI thread posted, then draws (into the widget's framebuffer, which Qt then composes)
+void Realtime::render_frame() {
+    RenderCommand command;
+    while (m_render_commands.pop(command)) {
+        run_command(command);
+    }
+    default_fbo = defaultFramebufferObject();
+    paintGL();
+}
+
+// Without a render thread, frames are drawn here when Qt paints the widget; with one, they're already in the widget's
+// framebuffer, and Qt only has to compose them
+void Realtime::paintEvent(QPaintEvent *event) {
+    if (m_render_thread == nullptr) {
+        QOpenGLWidget::paintEvent(event);
+    }
+}
+
+// Asks for a paintGL call (the render thread draws frames back to back anyway, and can't ask for them from its thread)
+void Realtime::request_frame() {
+    if (m_render_thread == nullptr) {
+        update();
+    }
+}
+
 // Function to cleanup OpenGL memory associated with a framebuffer
 void Realtime::delete_fbo() {
     // Delete texture, renderbuffer, and framebuffer
@@ -160,13 +300,16 @@ void Realtime::delete_fbo() {
 
 void Realtime::initializeGL() {
     m_devicePixelRatio = this->devicePixelRatio();
+    m_settings = settings;
 
     // Now we can determine how big our FBOs and screen should be
     m_fbo_width = size().width() * m_devicePixelRatio;
     m_fbo_height = size().height() * m_devicePixelRatio;
 
-    m_timer = startTimer(1000/60);
+    // The simulation runs on real time from here (frames are drawn back to back, see paintGL)
     m_elapsedTimer.start();
+    m_clock.start();
+    reset_flight();
 
     // Initializing GL.
     // GLEW (GL Extension Wrangler) provides access to OpenGL functions.
@@ -179,23 +322,62 @@ void Realtime::initializeGL() {
 
     // Allows OpenGL to draw objects appropriately on top of one another
     glEnable(GL_DEPTH_TEST);
-    // Tells OpenGL to only draw the front face
-    //glEnable(GL_CULL_FACE);
-    //glCullFace(GL_FRONT);
+    // Tells OpenGL which faces are the back ones (the render queue culls them draw by draw, since some materials are
+    // seen from both sides)
+    glCullFace(GL_BACK);
     glFrontFace(GL_CCW);
 
     // Tells OpenGL how big the screen is
     glViewport(0, 0, size().width() * m_devicePixelRatio, size().height() * m_devicePixelRatio);
 
+    // The light array has to fit in a uniform block, so that's as many lights as we can have
+    GLint max_block_size = 0;
+    glGetIntegerv(GL_MAX_UNIFORM_BLOCK_SIZE, &max_block_size);
+    Debug::glErrorCheck();
+    int block_lights = int((max_block_size - sizeof(LightBlockHeader)) / sizeof(Light));
+    max_lights = std::clamp(max_lights, 1, block_lights);
+    std::string light_defines = "#define MAX_LIGHTS " + std::to_string(max_lights) + "\n";
+
     // Students: anything requiring OpenGL calls when the program starts should be done here
     // Like loading the shader
-    m_phong_shader.loadData(":/resources/shaders/phong.vert", ":/resources/shaders/phong.frag");
+    m_phong_shader.loadData(":/resources/shaders/phong.vert", ":/resources/shaders/phong.frag", light_defines);
     // And the other shader
     m_framebuffer_shader.loadData(":/resources/shaders/framebuffer.vert", ":/resources/shaders/framebuffer.frag");
-    m_model_shader.loadData(":/resources/shaders/model.vert", ":/resources/shaders/model.frag");
-    m_instancing_shader.loadData(":/resources/shaders/instancing.vert", ":/resources/shaders/model.frag");
+    m_model_shader.loadData(":/resources/shaders/model.vert", ":/resources/shaders/model.frag", light_defines);
+    m_instancing_shader.loadData(":/resources/shaders/instancing.vert", ":/resources/shaders/model.frag", light_defines);
     m_skybox_shader.loadData(":/resources/shaders/skybox.vert", ":/resources/shaders/skybox.frag");
-    m_spaceship_shader.loadData(":/resources/shaders/spaceship.vert", ":/resources/shaders/model.frag");
+    m_spaceship_shader.loadData(":/resources/shaders/spaceship.vert", ":/resources/shaders/model.frag", light_defines);
+
+    // The planets and the spaceship draw each material's meshes in one call once they're loaded (see ModelBatch)
+    m_model_batch_shader.loadData(":/resources/shaders/modelbatch.vert", ":/resources/shaders/model.frag", light_defines);
+    m_spaceship_batch_shader.loadData(":/resources/shaders/modelbatch.vert", ":/resources/shaders/model.frag", light_defines + "#define SPACESHIP\n");
+
+    // The depth pre-pass draws the same vertex stages, with a fragment stage that does nothing
+    auto load_depth_only = [&](Shader& shader, Shader& depth_shader, const char* vertex_file, const std::string& defines) {
+        depth_shader.loadData(vertex_file, ":/resources/shaders/depth.frag", defines);
+        shader.depthOnly = &depth_shader;
+    };
+    load_depth_only(m_phong_shader, m_phong_depth_shader, ":/resources/shaders/phong.vert", light_defines);
+    load_depth_only(m_model_shader, m_model_depth_shader, ":/resources/shaders/model.vert", light_defines);
+    load_depth_only(m_instancing_shader, m_instancing_depth_shader, ":/resources/shaders/instancing.vert", light_defines);
+    load_depth_only(m_spaceship_shader, m_spaceship_depth_shader, ":/resources/shaders/spaceship.vert", light_defines);
+    load_depth_only(m_model_batch_shader, m_model_batch_depth_shader, ":/resources/shaders/modelbatch.vert", light_defines);
+    load_depth_only(m_spaceship_batch_shader, m_spaceship_batch_depth_shader, ":/resources/shaders/modelbatch.vert", light_defines + "#define SPACESHIP\n");
+
+    planet1.setBatchShader(&m_model_batch_shader);
+    planet2.setBatchShader(&m_model_batch_shader);
+    planet3.setBatchShader(&m_model_batch_shader);
+    spaceship.setBatchShader(&m_spaceship_batch_shader);
+
+    // The camera and lights live in uniform buffers all of the shaders read from (bound for good here)
+    // The light buffer has room for max_lights, though only the scene's lights are ever written to it
+    // The frame's block is bound as a range of its ring, so its regions start where a uniform range can
+    GLint ubo_alignment = 1;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &ubo_alignment);
+    Debug::glErrorCheck();
+    m_frame_ubo.create(sizeof(FrameBlock), ubo_alignment);
+    m_light_ubo.create(UniformBlocks::lights, sizeof(LightBlockHeader) + max_lights * sizeof(Light));
+    lights_changed = true;
 
     // The skybox shouldn't change when loading a new scene (only where the model is, so we can load it here)
     // Note the order for the elements of the Skybox must be in:
@@ -218,10 +400,11 @@ void Realtime::initializeGL() {
     box.load_texture(skybox_images);
 
     // Load the spaceship in at start
+    // Models load in the background and show up once they've been uploaded (see paintGL)
     std::cerr << "Trying to load spaceship model...\n";
     std::string spaceship_path = "/resources/models/airplane/scene.gltf";
-    spaceship.loadModel((working_dir + spaceship_path).c_str());
-    std::cerr << "Spaceship model loaded using path: " << working_dir << spaceship_path << "\n";
+    spaceship.loadModelAsync(m_model_loader, (working_dir + spaceship_path).c_str());
+    std::cerr << "Spaceship model requested using path: " << working_dir << spaceship_path << "\n";
 
     // Now that we've initialized GL, we can actually process settings changes
     gl_initialized = true;
@@ -279,6 +462,11 @@ void Realtime::initializeGL() {
 
     // Make the FBO
     make_fbo();
+
+    // From here on, frames (and everything else that uses GL) are the render thread's, if there is one
+    if (m_use_render_thread) {
+        start_render_thread();
+    }
 }
 
 // Function to make the framebuffer (lifted straight from lab)
@@ -346,6 +534,12 @@ void Realtime::paintGL() {
         return;
     }
 
+    // Step the simulation up to now, and put the camera between its last two steps
+    advance_simulation();
+
+    // Upload whatever the model loader has finished decoding, without going over the frame's budget
+    m_model_loader.upload(model_upload_budget_ms);
+
     // Render our scene to the framebuffer first
     glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
     Debug::glErrorCheck();
@@ -358,6 +552,17 @@ void Realtime::paintGL() {
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     Debug::glErrorCheck();
 
+    // Camera and lights go to the GPU once, for every shader
+    upload_frame_data();
+
+    // Everything drawn this frame is culled against the camera's view
+    Culling::stats = Culling::Stats();
+    Culling::frustum = m_camera.get_frustum();
+
+    // Everything is queued first, then drawn sorted by state (and front to back)
+    m_render_queue.clear();
+    m_render_queue.farDistance = far_plane;
+
     // Now paint the scene geometry
     paint_scene_geometry();
 
@@ -367,6 +572,11 @@ void Realtime::paintGL() {
     // The moment of truth. Paint the skybox...
     paint_skybox();
 
+    // The very last thing before submitting: the camera and spaceship are put where the newest input has them
+    latch_input();
+
+    m_render_queue.submit();
+
     // Render scene to the default framebuffer (the one that we actually display our stuff on)
     glBindFramebuffer(GL_FRAMEBUFFER, default_fbo);
     Debug::glErrorCheck();
@@ -379,216 +589,73 @@ void Realtime::paintGL() {
     // Helper to apply post processing
     paint_post_process(m_fbo_texture);
 
-    // Advance the camera by movement (Speed)
-    glm::vec4 delta_pos = speed * m_camera.get_camera_look();
-    m_camera.update_translation_matrix(m_camera.get_camera_pos() + delta_pos);
-    m_camera.update_view_matrix();
+    // That's everything for this frame, so the ring buffers' regions it drew from are fenced off
+    RingBuffer::endFrame();
+
+    // The frame's stats are handed over for frame_stats (whoever shows them reads them whenever it likes)
+    m_frame_stats.culling = Culling::stats;
+    m_frame_stats.queue = m_render_queue.stats;
+    {
+        std::lock_guard<std::mutex> lock(m_stats_mutex);
+        m_last_frame_stats = m_frame_stats;
+    }
+    m_frame_stats = FrameStats();
+
+    // Ask for the next frame straight away (swaps wait for vsync, so this is paced by the display)
+    request_frame();
 }
 
 // Function to make the skybox (similar to making the model)
 void Realtime::paint_skybox() {
-    m_skybox_shader.Activate();
-
-    // Compute a version of the view matrix that doesn't use translation (do not want to translate skybox)
-    glm::mat4 view_no_translate = glm::mat4(glm::mat3(m_camera.get_view_matrix()));
-
-    // Send necessary uniforms for camera
-    GLuint location;
-    location = glGetUniformLocation(m_skybox_shader.ID, "view_matrix");
-    Debug::glErrorCheck();
-    glUniformMatrix4fv(location, 1, GL_FALSE, &view_no_translate[0][0]);
-    Debug::glErrorCheck();
-
-    location = glGetUniformLocation(m_skybox_shader.ID, "proj_matrix");
-    Debug::glErrorCheck();
-    glUniformMatrix4fv(location, 1, GL_FALSE, &((m_camera.get_projection_matrix()))[0][0]);
-    Debug::glErrorCheck();
-
-    // DRAW THE BOX
-    box.draw(m_skybox_shader);
-
-    m_skybox_shader.Deactivate();
+    // The camera comes from the frame's uniform buffer (the shader drops the view matrix's translation itself)
+    // It goes in its own pass after everything else, and binds its own VAO and cubemap
+    RenderQueue::Packet packet;
+    packet.shader = &m_skybox_shader;
+    packet.draw = [](const RenderQueue::Packet& packet) {
+        // DRAW THE BOX
+        static_cast<Skybox*>(packet.object)->draw(*packet.shader);
+    };
+    packet.object = &box;
+    // Seen from the inside
+    packet.doubleSided = true;
+    m_render_queue.push(RenderQueue::Pass::Sky, packet);
 }
 
 // New func to test painting model shaders
 void Realtime::paint_model_geometry() {
-    m_model_shader.Activate();
-
-    // Send necessary uniforms for camera
-    GLuint location;
-    location = glGetUniformLocation(m_model_shader.ID, "view_matrix");
-    Debug::glErrorCheck();
-    glUniformMatrix4fv(location, 1, GL_FALSE, &((m_camera.get_view_matrix())[0][0]));
-    Debug::glErrorCheck();
-
-    location = glGetUniformLocation(m_model_shader.ID, "proj_matrix");
-    Debug::glErrorCheck();
-    glUniformMatrix4fv(location, 1, GL_FALSE, &((m_camera.get_projection_matrix()))[0][0]);
-    Debug::glErrorCheck();
-
-    // Remaining uniforms for vertex shader sent via model
-
-    // Uniform for light needs to be sent via this func, other samplers are sent via model
-    // Camera position
-    // TODO: Change to actually load in light data like the original Phong Shader
-    location = glGetUniformLocation(m_model_shader.ID, "camera_pos");
-    Debug::glErrorCheck();
-    glUniform3f(location, m_camera.get_camera_pos()[0], m_camera.get_camera_pos()[1], m_camera.get_camera_pos()[2]);
-    Debug::glErrorCheck();
-
-    location = glGetUniformLocation(m_model_shader.ID, "light_color");
-    Debug::glErrorCheck();
-    glUniform4f(location, 1.0f, 1.0f, 1.0f, 1.0f);
-    Debug::glErrorCheck();
-    location = glGetUniformLocation(m_model_shader.ID, "light_pos");
-    Debug::glErrorCheck();
-    glUniform3f(location, 0.0f, 0.0f, 0.0f);
-    Debug::glErrorCheck();
+    // Levels of detail for the planets and asteroids are picked from their size on screen as seen from the camera
+    Lod::view = Lod::View(glm::vec3(m_camera.get_camera_pos()), m_camera.get_camera_height_angle(), m_fbo_height);
 
+    // Camera and lights come from the frame's uniform buffers, everything else is sent via model
     // Draw planet using model shader (since it is not instanced
     if (planets_instantiated) {
-        planet1.Draw(m_model_shader, planet_translations[0], glm::quat(1.0f, 0.0f, 0.0f, 0.0f), planet_scales[0]);
-        planet2.Draw(m_model_shader, planet_translations[1], glm::quat(1.0f, 0.0f, 0.0f, 0.0f), planet_scales[1]);
-        planet3.Draw(m_model_shader, planet_translations[2], glm::quat(1.0f, 0.0f, 0.0f, 0.0f), planet_scales[2]);
+        planet1.Draw(m_render_queue, m_model_shader, planet_translations[0], glm::quat(1.0f, 0.0f, 0.0f, 0.0f), planet_scales[0]);
+        planet2.Draw(m_render_queue, m_model_shader, planet_translations[1], glm::quat(1.0f, 0.0f, 0.0f, 0.0f), planet_scales[1]);
+        planet3.Draw(m_render_queue, m_model_shader, planet_translations[2], glm::quat(1.0f, 0.0f, 0.0f, 0.0f), planet_scales[2]);
     }
 
-    m_model_shader.Deactivate();
-
     // Asteroids need to be configured to use separate model shader
+    asteroids.Draw(m_render_queue, m_instancing_shader);
 
-    m_instancing_shader.Activate();
-
-    // Send necessary uniforms for the instancing shader
-    location = glGetUniformLocation(m_instancing_shader.ID, "view_matrix");
-    Debug::glErrorCheck();
-    glUniformMatrix4fv(location, 1, GL_FALSE, &((m_camera.get_view_matrix())[0][0]));
-    Debug::glErrorCheck();
-
-    location = glGetUniformLocation(m_instancing_shader.ID, "proj_matrix");
-    Debug::glErrorCheck();
-    glUniformMatrix4fv(location, 1, GL_FALSE, &((m_camera.get_projection_matrix()))[0][0]);
-    Debug::glErrorCheck();
-
-    // Uniform for light needs to be sent via this func, other samplers are sent via model
-    // Camera position
-    // TODO: Change to actually load in light data like the original Phong Shader
-    location = glGetUniformLocation(m_instancing_shader.ID, "camera_pos");
-    Debug::glErrorCheck();
-    glUniform3f(location, m_camera.get_camera_pos()[0], m_camera.get_camera_pos()[1], m_camera.get_camera_pos()[2]);
-    Debug::glErrorCheck();
-
-    location = glGetUniformLocation(m_instancing_shader.ID, "light_color");
-    Debug::glErrorCheck();
-    glUniform4f(location, 1.0f, 1.0f, 1.0f, 1.0f);
-    Debug::glErrorCheck();
-    location = glGetUniformLocation(m_instancing_shader.ID, "light_pos");
-    Debug::glErrorCheck();
-    glUniform3f(location, 0.0f, 0.0f, 0.0f);
-    Debug::glErrorCheck();
-
-    asteroids.Draw(m_instancing_shader);
-
-    m_instancing_shader.Deactivate();
-
-    // Draw the spaceship
-    m_spaceship_shader.Activate();
-    // Send camera uniforms
-    location = glGetUniformLocation(m_spaceship_shader.ID, "inverse_view_matrix");
-    Debug::glErrorCheck();
-    glUniformMatrix4fv(location, 1, GL_FALSE, &((m_camera.get_inverse_view_matrix())[0][0]));
-    Debug::glErrorCheck();
-
-    location = glGetUniformLocation(m_spaceship_shader.ID, "proj_matrix");
-    Debug::glErrorCheck();
-    glUniformMatrix4fv(location, 1, GL_FALSE, &((m_camera.get_projection_matrix()))[0][0]);
-    Debug::glErrorCheck();
-
-    location = glGetUniformLocation(m_spaceship_shader.ID, "camera_pos");
-    Debug::glErrorCheck();
-    glUniform3f(location, m_camera.get_camera_pos()[0], m_camera.get_camera_pos()[1], m_camera.get_camera_pos()[2]);
-    Debug::glErrorCheck();
-
-    location = glGetUniformLocation(m_spaceship_shader.ID, "light_color");
-    Debug::glErrorCheck();
-    glUniform4f(location, 1.0f, 1.0f, 1.0f, 1.0f);
-    Debug::glErrorCheck();
-    location = glGetUniformLocation(m_spaceship_shader.ID, "light_pos");
-    Debug::glErrorCheck();
-    glUniform3f(location, 0.0f, 0.0f, 0.0f);
-    Debug::glErrorCheck();
+    // Draw the spaceship (latch_input turns it again right before it's submitted)
+    // It's placed relative to the camera, so it's drawn in view space: never culled (its shader doesn't place it with
+    // the mesh matrices Model culls with, and it's always in front of the camera anyway), with levels picked as seen
+    // from the origin
+    spaceship.Draw(m_render_queue, m_spaceship_shader, glm::vec3(0.0f, -0.2f, -1.5f), spaceship_rotation(), glm::vec3(0.25f, 0.25f, 0.25f), true);
+}
 
+// How the spaceship is turned, as the drawn flight has it tilted
+glm::quat Realtime::spaceship_rotation() {
     // Scale spaceship down
     // JANK INCOMING
     glm::quat rotation = glm::quat_cast(glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(1.0f, 0.2f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f)));
     glm::vec4 rotation_vec = glm::vec4(rotation[0], rotation[1], rotation[2], rotation[3]);
-    // Determine how much we need to rotate the plane based on previous values
-
-    // Update yaw, pitch, and roll accordingly
-    if (delta_yaw != 0) {
-        yaw_radians += delta_yaw;
-        delta_yaw = 0.0f;
-
-        // Clamp
-        yaw_radians = std::min(yaw_radians, 0.44f);
-        yaw_radians = std::max(yaw_radians, -0.44f);
-    }
-    else {
-        // Move back to 0
-        if (yaw_radians < 0) {
-            yaw_radians += 0.44f / 60.0f;
-            yaw_radians = std::min(yaw_radians, 0.0f);
-        }
-        else if (yaw_radians > 0) {
-            yaw_radians += -0.44f / 60.0f;
-            yaw_radians = std::max(yaw_radians, 0.0f);
-        }
-    }
-
-    // Change pitch of plane
-    if (delta_pitch != 0) {
-        pitch_radians += delta_pitch;
-        delta_pitch = 0.0f;
-
-        // Clamp
-        pitch_radians = std::min(pitch_radians, 0.6f);
-        pitch_radians = std::max(pitch_radians, -0.6f);
-    }
-    else {
-        // Move back to 0
-        if (pitch_radians < 0) {
-            pitch_radians += 0.6f / 60.0f;
-            pitch_radians = std::min(pitch_radians, 0.0f);
-        }
-        else if (pitch_radians > 0) {
-            pitch_radians += -0.6f / 60.0f;
-            pitch_radians = std::max(pitch_radians, 0.0f);
-        }
-    }
-
-    // Change roll of plane
-    if (delta_roll != 0) {
-        roll_radians += delta_roll;
-        delta_roll = 0.0f;
-
-        // Clamp
-        roll_radians = std::min(roll_radians, 0.88f);
-        roll_radians = std::max(roll_radians, -0.88f);
-    }
-    else {
-        if (roll_radians < 0) {
-            roll_radians += 0.88f / 60.0f;
-            roll_radians = std::min(roll_radians, 0.0f);
-        }
-        else if (roll_radians > 0) {
-            roll_radians += -0.88f / 60.0f;
-            roll_radians = std::max(roll_radians, 0.0f);
-        }
-    }
+    // How far the plane is rotated comes from the simulation (see simulate_step)
 
     // Incorporate changes
-    glm::vec4 yaw_rotation = rotation_to_quaternion(glm::vec3(0.0f, 1.0f, 0.0f), yaw_radians);
-    glm::vec4 pitch_rotation = rotation_to_quaternion(glm::normalize(glm::vec3(1.0f, 0.0f, 0.0f)), pitch_radians);
-    glm::vec4 roll_rotation = rotation_to_quaternion(glm::normalize(glm::vec3(0.0f, -0.2f, 1.0f)), roll_radians);
+    glm::vec4 yaw_rotation = rotation_to_quaternion(glm::vec3(0.0f, 1.0f, 0.0f), m_drawn_flight.yaw_radians);
+    glm::vec4 pitch_rotation = rotation_to_quaternion(glm::normalize(glm::vec3(1.0f, 0.0f, 0.0f)), m_drawn_flight.pitch_radians);
+    glm::vec4 roll_rotation = rotation_to_quaternion(glm::normalize(glm::vec3(0.0f, -0.2f, 1.0f)), m_drawn_flight.roll_radians);
 
     // Accumulate changes
     glm::vec4 total_rotation = quaternion_multiply(quaternion_multiply(quaternion_multiply(roll_rotation, yaw_rotation), pitch_rotation), rotation_vec);
@@ -598,9 +665,7 @@ void Realtime::paint_model_geometry() {
     rotation[1] = total_rotation[1];
     rotation[2] = total_rotation[2];
     rotation[3] = total_rotation[3];
-
-    spaceship.Draw(m_spaceship_shader, glm::vec3(0.0f, -0.2f, -1.5f), rotation, glm::vec3(0.25f, 0.25f, 0.25f));
-    m_spaceship_shader.Deactivate();
+    return rotation;
 }
 
 // Helper function to apply post processing effects to rendered image
@@ -620,44 +685,25 @@ void Realtime::paint_post_process(GLuint texture) {
     Debug::glErrorCheck();
 
     // Send necessary uniforms to the framebuffer shader
-    GLuint location;
 
-    // Send texture so we can sample from it
-    location = glGetUniformLocation(m_framebuffer_shader.ID, "sampler2D");
-    Debug::glErrorCheck();
-    glUniform1i(location, GL_TEXTURE0);
-    Debug::glErrorCheck();
+    // Send texture so we can sample from it (the sampler takes the unit number, not the GL_TEXTURE0 enum)
+    m_framebuffer_shader.setInt("tex", 0);
 
     // Send booleans indicating if we should use certain post-processing techniques
     // Per-pixel
-    location = glGetUniformLocation(m_framebuffer_shader.ID, "per_pixel");
-    Debug::glErrorCheck();
-    glUniform1i(location, settings.perPixelFilter);
-    Debug::glErrorCheck();
+    m_framebuffer_shader.setInt("per_pixel", m_settings.perPixelFilter);
 
     // Kernel-based
-    location = glGetUniformLocation(m_framebuffer_shader.ID, "per_kernel");
-    Debug::glErrorCheck();
-    glUniform1i(location, settings.kernelBasedFilter);
-    Debug::glErrorCheck();
+    m_framebuffer_shader.setInt("per_kernel", m_settings.kernelBasedFilter);
 
     // Send the width of the screen for convolution
-    location = glGetUniformLocation(m_framebuffer_shader.ID, "u_step");
-    Debug::glErrorCheck();
-    glUniform1f(location, 1.0f / (m_fbo_width * m_devicePixelRatio));
-    Debug::glErrorCheck();
+    m_framebuffer_shader.setFloat("u_step", 1.0f / (m_fbo_width * m_devicePixelRatio));
 
     // Send the height of the screen for convolution
-    location = glGetUniformLocation(m_framebuffer_shader.ID, "v_step");
-    Debug::glErrorCheck();
-    glUniform1f(location, 1.0f / (m_fbo_height * m_devicePixelRatio));
-    Debug::glErrorCheck();
+    m_framebuffer_shader.setFloat("v_step", 1.0f / (m_fbo_height * m_devicePixelRatio));
 
     // Send radius of convolution
-    location = glGetUniformLocation(m_framebuffer_shader.ID, "radius");
-    Debug::glErrorCheck();
-    glUniform1i(location, filter_radius);
-    Debug::glErrorCheck();
+    m_framebuffer_shader.setInt("radius", filter_radius);
 
     // Draw!
     glDrawArrays(GL_TRIANGLES, 0, 6);
@@ -672,119 +718,60 @@ void Realtime::paint_post_process(GLuint texture) {
     Debug::glErrorCheck();
 }
 
-// Helper function that paints the scene geometry to whatever framebuffer we want to paint to (default or our own)
+// Helper function that queues the scene geometry to be painted to whatever framebuffer we want to paint to (default or our own)
 void Realtime::paint_scene_geometry() {
     // Normally one would iterate over shaders, but since we only have 1 shader that's not necessary
     m_phong_shader.Activate();
     Debug::glErrorCheck();
 
-    // Pass in relevant uniforms defined in the Realtime instance (Camera, lights)
-    GLuint location;
-    location = glGetUniformLocation(m_phong_shader.ID, "view_matrix");
-    Debug::glErrorCheck();
-    glUniformMatrix4fv(location, 1, GL_FALSE, &((m_camera.get_view_matrix())[0][0]));
-    Debug::glErrorCheck();
-
-    location = glGetUniformLocation(m_phong_shader.ID, "proj_matrix");
-    Debug::glErrorCheck();
-    glUniformMatrix4fv(location, 1, GL_FALSE, &((m_camera.get_projection_matrix()))[0][0]);
-    Debug::glErrorCheck();
-
-    // Pass in ALL the uniforms required for the shader (Lights)
-    for(int i = 0; i < 8; i++) {
-        // Compute the location for inserting the light
-        send_light_to_shader(m_phong_shader, i);
-    }
+    // Camera and lights come from the frame's uniform buffers
+    // Find out which primitives are in view, so only those get drawn
+    Culling::cull(Culling::frustum, primitive_boxes, primitive_visible);
+    // Index of the first primitive of each type in primitive_visible
+    size_t first_visible = 0;
 
     // Pass in the global data uniforms
-    location = glGetUniformLocation(m_phong_shader.ID, "ka");
-    Debug::glErrorCheck();
-    glUniform1f(location, ka);
-    Debug::glErrorCheck();
-
-    location = glGetUniformLocation(m_phong_shader.ID, "kd");
-    Debug::glErrorCheck();
-    glUniform1f(location, kd);
-    Debug::glErrorCheck();
-
-    location = glGetUniformLocation(m_phong_shader.ID, "ks");
-    Debug::glErrorCheck();
-    glUniform1f(location, ks);
-    Debug::glErrorCheck();
-
-    // Camera position
-    location = glGetUniformLocation(m_phong_shader.ID, "camera_pos");
-    Debug::glErrorCheck();
-    glUniform3f(location, m_camera.get_camera_pos()[0], m_camera.get_camera_pos()[1], m_camera.get_camera_pos()[2]);
-    Debug::glErrorCheck();
+    m_phong_shader.setFloat("ka", ka);
 
-    // Iterate over all primitives and render them using their draw function
-    // Bind VAO for spheres when we draw them
-    if (default_sphere.get_vao() != 0) {
-        glBindVertexArray(default_sphere.get_vao());
-        Debug::glErrorCheck();
+    m_phong_shader.setFloat("kd", kd);
 
-        // Then draw them
-        for(int i = 0; i < spheres.size(); i++) {
-            spheres[i].draw(m_phong_shader.ID);
-        }
+    m_phong_shader.setFloat("ks", ks);
 
-        // Then unbind the spheres
-        glBindVertexArray(0);
-        Debug::glErrorCheck();
-    }
+    m_phong_shader.Deactivate();
 
-    // We do each primitive type separately because (pending optimizations) you can bind a single VAO once
-    // Bind VAO for cubes when we draw them
-    if (default_cube.get_vao() != 0) {
-        glBindVertexArray(default_cube.get_vao());
-        Debug::glErrorCheck();
-
-        // Then draw them
-        for(int i = 0; i < cubes.size(); i++) {
-            cubes[i].draw(m_phong_shader.ID);
+    // Each type's visible primitives are one instanced draw with its VAO (the instance buffers have everything else)
+    auto queue_primitives = [&](PrimitiveInstances& instances, auto& type) {
+        GLsizei count = instances.update_visible(primitive_visible, first_visible);
+        first_visible += instances.size();
+        if (type.get_vao() == 0 || count == 0) {
+            return;
         }
+        RenderQueue::Packet packet;
+        packet.shader = &m_phong_shader;
+        packet.vao = type.get_vao();
+        packet.draw = [](const RenderQueue::Packet& packet) {
+            static_cast<Primitive*>(packet.object)->draw_instances(packet.index);
+        };
+        packet.object = static_cast<Primitive*>(&type);
+        packet.index = count;
+        m_render_queue.push(RenderQueue::Pass::Opaque, packet);
+    };
 
-        // Then unbind the cubes
-        glBindVertexArray(0);
-        Debug::glErrorCheck();
-    }
-
-    // Bind VAO for cylinders when we draw them
-    if (default_cylinder.get_vao() != 0) {
-        glBindVertexArray(default_cylinder.get_vao());
-        Debug::glErrorCheck();
-
-        // Then draw them
-        for(int i = 0; i < cylinders.size(); i++) {
-            cylinders[i].draw(m_phong_shader.ID);
-        }
-
-        // Then unbind the cylinders
-        glBindVertexArray(0);
-        Debug::glErrorCheck();
-    }
-
-    // Bind VAO for cones when we draw them
-    if (default_cone.get_vao() != 0) {
-        glBindVertexArray(default_cone.get_vao());
-        Debug::glErrorCheck();
-
-        // Then draw them
-        for(int i = 0; i < cones.size(); i++) {
-            cones[i].draw(m_phong_shader.ID);
-        }
-
-        // Then unbind the cylinders
-        glBindVertexArray(0);
-        Debug::glErrorCheck();
-    }
-
-    glUseProgram(0);
-    Debug::glErrorCheck();
+    queue_primitives(sphere_instances, default_sphere);
+    queue_primitives(cube_instances, default_cube);
+    queue_primitives(cylinder_instances, default_cylinder);
+    queue_primitives(cone_instances, default_cone);
 }
 
 void Realtime::resizeGL(int w, int h) {
+    RenderCommand command;
+    command.type = RenderCommand::Type::Resize;
+    command.width = w;
+    command.height = h;
+    if (post_to_render_thread(command)) {
+        return;
+    }
+
     // Tells OpenGL how big the screen is
     // Compute and cache window size (to regenerate framebuffer)
     m_fbo_width = w * m_devicePixelRatio;
@@ -800,27 +787,33 @@ void Realtime::resizeGL(int w, int h) {
     make_fbo();
 
     // New draw!
-    update();
+    request_frame();
 }
 
 // Function that generates a new allotment of asteroids
 void Realtime::generate_scene() {
+    RenderCommand command;
+    command.type = RenderCommand::Type::GenerateScene;
+    if (post_to_render_thread(command)) {
+        return;
+    }
+
     makeCurrent();
     // Let's just focus on generating a new planet
     std::string working_dir = QDir::currentPath().toStdString();
     std::string planet_path = "/resources/models/planet/scene.gltf";
 
     std::cerr << "Trying to load planet model...\n";
-    planet1.loadModel((working_dir + planet_path).c_str());
-    std::cerr << "Planet model loaded using path: " << working_dir << planet_path << "\n";
+    planet1.loadModelAsync(m_model_loader, (working_dir + planet_path).c_str());
+    std::cerr << "Planet model requested using path: " << working_dir << planet_path << "\n";
 
     std::cerr << "Trying to load planet model...\n";
-    planet2.loadModel((working_dir + planet_path).c_str());
-    std::cerr << "Planet model loaded using path: " << working_dir << planet_path << "\n";
+    planet2.loadModelAsync(m_model_loader, (working_dir + planet_path).c_str());
+    std::cerr << "Planet model requested using path: " << working_dir << planet_path << "\n";
 
     std::cerr << "Trying to load planet model...\n";
-    planet3.loadModel((working_dir + planet_path).c_str());
-    std::cerr << "Planet model loaded using path: " << working_dir << planet_path << "\n";
+    planet3.loadModelAsync(m_model_loader, (working_dir + planet_path).c_str());
+    std::cerr << "Planet model requested using path: " << working_dir << planet_path << "\n";
 
     planets_instantiated = false;
 
@@ -842,23 +835,28 @@ void Realtime::generate_scene() {
 
     // Also add asteroids
     // FIX some instancing number
-    unsigned int instances = settings.shapeParameter1;
+    unsigned int instances = m_settings.shapeParameter1;
     std::vector<glm::mat4> asteroid_matrices = generateAsteroidTransformations(instances, planet_translations);
     std::string asteroid_path = "/resources/models/asteroid/scene.gltf";
 
     std::cerr << "Trying to load " << instances << " instances of asteroids model...\n";
-    asteroids.loadModel((working_dir + asteroid_path).c_str(), 3 * instances, asteroid_matrices);
-    std::cerr << "Asteroid model loaded using path: " << working_dir << asteroid_path << "\n";
+    asteroids.loadModelAsync(m_model_loader, (working_dir + asteroid_path).c_str(), 3 * instances, asteroid_matrices);
+    std::cerr << "Asteroid model requested using path: " << working_dir << asteroid_path << "\n";
 }
 
 // Load a new scene file's data into the scene
 void Realtime::sceneChanged() {
+    RenderCommand command;
+    command.type = RenderCommand::Type::SceneChanged;
+    if (post_to_render_thread(command)) {
+        return;
+    }
+
     makeCurrent();
     // Clear existing data
-    // Remove all lights (disable their type)
-    for (int i = 0; i < 8; i++) {
-        lights[i].type = -1;
-    }
+    // Remove all lights
+    lights.clear();
+    lights_changed = true;
 
     // Remove all primitives from lists to draw
     spheres.clear();
@@ -868,13 +866,17 @@ void Realtime::sceneChanged() {
 
     // This is where you load the scene and parse it
     RenderData data;
-    SceneParser::parse(settings.sceneFilePath, data);
+    SceneParser::parse(m_settings.sceneFilePath, data);
 
-    // Store the scene's lights
-    for (int i = 0; i < data.lights.size(); i++) {
+    // Store the scene's lights (as many as the shaders have room for)
+    if (data.lights.size() > max_lights) {
+        std::cerr << "Scene has " << data.lights.size() << " lights, only the first " << max_lights << " will be used\n";
+    }
+    lights.resize(std::min<size_t>(data.lights.size(), max_lights));
+    for (int i = 0; i < lights.size(); i++) {
         // Copy out the relevant data into our structs which get sent to the shader
         lights[i].color = data.lights[i].color;
-        lights[i].pos = glm::vec3(data.lights[i].pos);
+        lights[i].pos = data.lights[i].pos;
         lights[i].attenuation_func = data.lights[i].function;
         lights[i].dir = data.lights[i].dir;
         lights[i].penumbra = data.lights[i].penumbra;
@@ -919,12 +921,16 @@ void Realtime::sceneChanged() {
         }
     }
 
-    // Update meshes
+    // Update meshes (the instance buffers go first, so the meshes' VAOs get them attached)
+    update_primitive_instances();
     updateMeshes();
+    update_primitive_bounds();
 
     // Store the camera data
     float aspect_ratio = (float) size().width() / (float) size().height();
-    m_camera = Camera(data.cameraData, settings.nearPlane, settings.farPlane, aspect_ratio);
+    m_camera = Camera(data.cameraData, m_settings.nearPlane, m_settings.farPlane, aspect_ratio);
+    // The simulation flies on from the scene's camera
+    reset_flight();
 
     // Store the global data
     ka = data.globalData.ka;
@@ -932,57 +938,61 @@ void Realtime::sceneChanged() {
     ks = data.globalData.ks;
 
     // Ask for a paint GL call
-    update();
+    request_frame();
 }
 
-// Function to send a single light of data to shader
-void Realtime::send_light_to_shader(Shader shader, int index) {
-    // Prepare some variables to determine where we can put uniforms for this struct
-    std::string light_index = "lights[" + std::to_string(index) + "]";
-    GLuint location;
-
-    // Send each of the fields to the shader
-    std::string color_loc = light_index + ".color";
-    location = glGetUniformLocation(shader.ID, color_loc.c_str());
-    Debug::glErrorCheck();
-    glUniform4f(location, lights[index].color[0], lights[index].color[1], lights[index].color[2], lights[index].color[3]);
-    Debug::glErrorCheck();
-
-    std::string pos_loc = light_index + ".pos";
-    location = glGetUniformLocation(shader.ID, pos_loc.c_str());
-    Debug::glErrorCheck();
-    glUniform3f(location, lights[index].pos[0], lights[index].pos[1], lights[index].pos[2]);
-    Debug::glErrorCheck();
-
-    std::string attenuation_func_loc = light_index + ".attenuation_func";
-    location = glGetUniformLocation(shader.ID, attenuation_func_loc.c_str());
-    Debug::glErrorCheck();
-    glUniform3f(location, lights[index].attenuation_func[0], lights[index].attenuation_func[1], lights[index].attenuation_func[2]);
-    Debug::glErrorCheck();
+// The camera as it is now, laid out for the FrameData block
+FrameBlock Realtime::frame_block() {
+    FrameBlock frame;
+    frame.view_matrix = m_camera.get_view_matrix();
+    frame.proj_matrix = m_camera.get_projection_matrix();
+    frame.inverse_view_matrix = m_camera.get_inverse_view_matrix();
+    frame.camera_pos = m_camera.get_camera_pos();
+    frame.time = m_clock.elapsed() * 0.001f;
+    return frame;
+}
 
-    std::string dir_loc = light_index + ".dir";
-    location = glGetUniformLocation(shader.ID, dir_loc.c_str());
-    Debug::glErrorCheck();
-    glUniform4f(location, lights[index].dir[0], lights[index].dir[1], lights[index].dir[2], lights[index].dir[3]);
-    Debug::glErrorCheck();
+// Collects the primitives' bounding boxes, in the order paint_scene_geometry draws them
+void Realtime::update_primitive_bounds() {
+    primitive_boxes.clear();
+    primitive_boxes.reserve(spheres.size() + cubes.size() + cylinders.size() + cones.size());
+    for (const Sphere& sphere : spheres) {
+        primitive_boxes.add(sphere.get_bounds_center(), sphere.get_bounds_extent());
+    }
+    for (const Cube& cube : cubes) {
+        primitive_boxes.add(cube.get_bounds_center(), cube.get_bounds_extent());
+    }
+    for (const Cylinder& cylinder : cylinders) {
+        primitive_boxes.add(cylinder.get_bounds_center(), cylinder.get_bounds_extent());
+    }
+    for (const Cone& cone : cones) {
+        primitive_boxes.add(cone.get_bounds_center(), cone.get_bounds_extent());
+    }
+}
 
-    std::string penumbra_loc = light_index + ".penumbra";
-    location = glGetUniformLocation(shader.ID, penumbra_loc.c_str());
-    Debug::glErrorCheck();
-    glUniform1f(location, lights[index].penumbra);
-    Debug::glErrorCheck();
+// Rebuilds each type's instance buffer from the scene's primitives, in the same order as the bounding boxes
+void Realtime::update_primitive_instances() {
+    sphere_instances.build(spheres);
+    cube_instances.build(cubes);
+    cylinder_instances.build(cylinders);
+    cone_instances.build(cones);
+}
 
-    std::string angle_loc = light_index + ".angle";
-    location = glGetUniformLocation(shader.ID, angle_loc.c_str());
-    Debug::glErrorCheck();
-    glUniform1f(location, lights[index].angle);
+// Writes the camera (every frame) and lights (when they've changed) to the uniform buffers every shader reads them from
+void Realtime::upload_frame_data() {
+    m_frame_ubo.next();
+    m_frame_ubo.write(frame_block());
+    glBindBufferRange(GL_UNIFORM_BUFFER, UniformBlocks::frame.binding, m_frame_ubo.ID, m_frame_ubo.offset(), sizeof(FrameBlock));
     Debug::glErrorCheck();
 
-    std::string type_loc = light_index + ".type";
-    location = glGetUniformLocation(shader.ID, type_loc.c_str());
-    Debug::glErrorCheck();
-    glUniform1i(location, lights[index].type);
-    Debug::glErrorCheck();
+    // Only the scene's lights are written (the shaders don't look past light_count)
+    if (lights_changed) {
+        LightBlockHeader header = {};
+        header.light_count = std::min<int>(lights.size(), max_lights);
+        m_light_ubo.update(header);
+        m_light_ubo.update(lights.data(), header.light_count * sizeof(Light), sizeof(LightBlockHeader));
+        lights_changed = false;
+    }
 }
 
 // Function to update all meshes in OpenGL
@@ -998,6 +1008,12 @@ void Realtime::updateMeshes() {
 
     // Cone
     default_cone.generate_mesh(shape_param_1, shape_param_2);
+
+    // Regenerating a mesh makes it a new VAO, so the instances are attached to all of them again
+    sphere_instances.attach(default_sphere.get_vao());
+    cube_instances.attach(default_cube.get_vao());
+    cylinder_instances.attach(default_cylinder.get_vao());
+    cone_instances.attach(default_cone.get_vao());
 }
 
 // Function to delete the meshes of all primitives
@@ -1013,9 +1029,21 @@ void Realtime::deleteMeshes() {
 
     // Cone
     default_cone.delete_buffers();
+
+    // And the instances they were drawn with
+    sphere_instances.delete_buffers();
+    cube_instances.delete_buffers();
+    cylinder_instances.delete_buffers();
+    cone_instances.delete_buffers();
 }
 
 void Realtime::settingsChanged() {
+    RenderCommand command;
+    command.type = RenderCommand::Type::SettingsChanged;
+    if (post_to_render_thread(command)) {
+        return;
+    }
+
     // Don't do anything if we haven't been initialized
     if (!gl_initialized) {
         return;
@@ -1032,9 +1060,9 @@ void Realtime::settingsChanged() {
 //    }
 
     // Check if change occurred to view plane
-    if (near_plane != settings.nearPlane || far_plane != settings.farPlane) {
-        near_plane = settings.nearPlane;
-        far_plane = settings.farPlane;
+    if (near_plane != m_settings.nearPlane || far_plane != m_settings.farPlane) {
+        near_plane = m_settings.nearPlane;
+        far_plane = m_settings.farPlane;
 
         // Make sure they don't overlap (that's wonky)
         if (near_plane != far_plane) {
@@ -1045,17 +1073,35 @@ void Realtime::settingsChanged() {
         }
     }
 
-    update(); // asks for a PaintGL() call to occur
+    request_frame(); // asks for a PaintGL() call to occur
 }
 
 // ================== Project 6: Action!
 
 void Realtime::keyPressEvent(QKeyEvent *event) {
+    RenderCommand command;
+    command.type = RenderCommand::Type::Key;
+    command.key = Qt::Key(event->key());
+    command.pressed = true;
+    command.time = m_clock.nsecsElapsed();
+    if (post_to_render_thread(command)) {
+        return;
+    }
     m_keyMap[Qt::Key(event->key())] = true;
+    note_input(command.time);
 }
 
 void Realtime::keyReleaseEvent(QKeyEvent *event) {
+    RenderCommand command;
+    command.type = RenderCommand::Type::Key;
+    command.key = Qt::Key(event->key());
+    command.pressed = false;
+    command.time = m_clock.nsecsElapsed();
+    if (post_to_render_thread(command)) {
+        return;
+    }
     m_keyMap[Qt::Key(event->key())] = false;
+    note_input(command.time);
 }
 
 void Realtime::mousePressEvent(QMouseEvent *event) {
@@ -1169,15 +1215,110 @@ void Realtime::mouseMoveEvent(QMouseEvent *event) {
 //            m_camera.update_view_matrix();
 //        }
 
-        update(); // asks for a PaintGL() call to occur
+        request_frame(); // asks for a PaintGL() call to occur
 }
 
-// Handles translation of camera
-void Realtime::timerEvent(QTimerEvent *event) {
-    int elapsedms   = m_elapsedTimer.elapsed();
-    float deltaTime = elapsedms * 0.001f;
+// Steps the simulation through the real time that's gone by since the last frame, in fixed steps, and puts what's
+// drawn between the last two of them (so motion is the same at any frame rate, and still smooth)
+void Realtime::advance_simulation() {
+    // Nanoseconds, since a millisecond timer would lose most of a step at high frame rates
+    double elapsed = m_elapsedTimer.nsecsElapsed() * 1e-9;
     m_elapsedTimer.restart();
 
+    // After a long stall (a breakpoint, a scene load) the simulation skips ahead instead of trying to catch up all at once
+    m_sim_accumulator += std::min(elapsed, 0.25);
+
+    float step = 1.0f / simulation_rate;
+    while (m_sim_accumulator >= step) {
+        m_prev_flight = m_flight;
+        simulate_step(step);
+        m_sim_accumulator -= step;
+    }
+
+    interpolate_flight(float(m_sim_accumulator / step));
+}
+
+// Starts the simulation over from wherever the camera is now (keeping the speed)
+void Realtime::reset_flight() {
+    m_flight.camera_pos = m_camera.get_camera_pos();
+    m_flight.camera_look = m_camera.get_camera_look();
+    m_flight.camera_up = m_camera.get_camera_up();
+    m_flight.pitch_radians = 0.0f;
+    m_flight.roll_radians = 0.0f;
+    m_flight.yaw_radians = 0.0f;
+    m_prev_flight = m_flight;
+    m_drawn_flight = m_flight;
+    m_sim_accumulator = 0.0;
+}
+
+// Blends the last two steps (alpha of the way from the previous to the latest) into the camera and the drawn flight
+void Realtime::interpolate_flight(float alpha) {
+    m_drawn_flight.camera_pos = glm::mix(m_prev_flight.camera_pos, m_flight.camera_pos, alpha);
+    // A step turns the camera very little, so blending the vectors and normalizing them is as good as a slerp
+    m_drawn_flight.camera_look = glm::normalize(glm::mix(m_prev_flight.camera_look, m_flight.camera_look, alpha));
+    m_drawn_flight.camera_up = glm::normalize(glm::mix(m_prev_flight.camera_up, m_flight.camera_up, alpha));
+    m_drawn_flight.speed = glm::mix(m_prev_flight.speed, m_flight.speed, alpha);
+    m_drawn_flight.pitch_radians = glm::mix(m_prev_flight.pitch_radians, m_flight.pitch_radians, alpha);
+    m_drawn_flight.roll_radians = glm::mix(m_prev_flight.roll_radians, m_flight.roll_radians, alpha);
+    m_drawn_flight.yaw_radians = glm::mix(m_prev_flight.yaw_radians, m_flight.yaw_radians, alpha);
+
+    m_camera.update_translation_matrix(m_drawn_flight.camera_pos);
+    m_camera.update_rotation_matrix(m_drawn_flight.camera_look, m_drawn_flight.camera_up);
+    m_camera.update_view_matrix();
+}
+
+// Remembers when input came in, unless older input is still waiting for a frame to pick it up
+void Realtime::note_input(qint64 time) {
+    if (m_pending_input_ns < 0) {
+        m_pending_input_ns = time;
+    }
+}
+
+// Late latching: the frame was queued with the camera as it was when the frame started (which is what culling and
+// levels of detail went by), but what's on screen should be as recent as possible, so right before submitting the
+// newest input is picked up, the simulation is stepped up to now, and the camera in the frame's uniform buffer region
+// and the spaceship's rotation are written again (neither has been read by anything yet; the draws read them once
+// they're submitted)
+void Realtime::latch_input() {
+    // With a render thread, key presses that came in while the frame was being queued are still waiting to be picked
+    // up (anything else waits for the next frame, since it can change what's already queued)
+    if (m_render_thread != nullptr) {
+        RenderCommand command;
+        while (m_render_commands.front() != nullptr && m_render_commands.front()->type == RenderCommand::Type::Key) {
+            m_render_commands.pop(command);
+            m_keyMap[command.key] = command.pressed;
+            note_input(command.time);
+        }
+    }
+
+    advance_simulation();
+    m_frame_ubo.write(frame_block());
+    spaceship.setDrawRotation(spaceship_rotation());
+
+    // How long the oldest input this frame picked up waited to be submitted
+    if (m_pending_input_ns >= 0) {
+        double latency_ms = (m_clock.nsecsElapsed() - m_pending_input_ns) * 1e-6;
+        m_pending_input_ns = -1;
+        m_frame_stats.input_to_submit_ms = latency_ms;
+    }
+}
+
+// A copy of the last frame's stats (taken under the lock, since frames can be drawn on the render thread)
+Realtime::FrameStats Realtime::frame_stats() const {
+    std::lock_guard<std::mutex> lock(m_stats_mutex);
+    return m_last_frame_stats;
+}
+
+// Handles translation of camera: one fixed step of the simulation, deltaTime seconds long
+void Realtime::simulate_step(float deltaTime) {
+    // The camera's left axis (Camera works it out the same way)
+    glm::vec3 left = -glm::normalize(glm::cross(glm::vec3(m_flight.camera_look), glm::vec3(m_flight.camera_up)));
+
+    // How much the plane tilts this step
+    float delta_pitch = 0.0f;
+    float delta_roll = 0.0f;
+    float delta_yaw = 0.0f;
+
     // Booleans to indicate if we need to update matrices
     bool update_rotation = false;
 
@@ -1204,7 +1345,7 @@ void Realtime::timerEvent(QTimerEvent *event) {
         float radians = 35.f * deltaTime * radian_conversion;
         delta_yaw -= radians / plane_tilt;
         // Rotate around the up vector
-        glm::vec4 quat_to_rotate = rotation_to_quaternion(glm::vec3(m_camera.get_camera_up()), radians);
+        glm::vec4 quat_to_rotate = rotation_to_quaternion(glm::vec3(m_flight.camera_up), radians);
         rotation = glm::normalize(quaternion_multiply(rotation, quat_to_rotate));
         update_rotation = true;
     }
@@ -1214,7 +1355,7 @@ void Realtime::timerEvent(QTimerEvent *event) {
         float radians = 35.f * -deltaTime * radian_conversion;
         delta_yaw -= radians / plane_tilt;
         // Rotate around the up vector
-        glm::vec4 quat_to_rotate = rotation_to_quaternion(glm::vec3(m_camera.get_camera_up()), radians);
+        glm::vec4 quat_to_rotate = rotation_to_quaternion(glm::vec3(m_flight.camera_up), radians);
         rotation = glm::normalize(quaternion_multiply(rotation, quat_to_rotate));
         update_rotation = true;
     }
@@ -1224,7 +1365,7 @@ void Realtime::timerEvent(QTimerEvent *event) {
         float radians = 100.f * deltaTime * radian_conversion;
         delta_pitch += radians / plane_tilt;
         // Rotate around the up vector
-        glm::vec4 quat_to_rotate = rotation_to_quaternion(glm::vec3(m_camera.get_left()), radians);
+        glm::vec4 quat_to_rotate = rotation_to_quaternion(left, radians);
         rotation = glm::normalize(quaternion_multiply(rotation, quat_to_rotate));
         update_rotation = true;
     }
@@ -1234,7 +1375,7 @@ void Realtime::timerEvent(QTimerEvent *event) {
         float radians = 200.f * -deltaTime * radian_conversion;
         delta_pitch += radians / plane_tilt;
         // Rotate around the up vector
-        glm::vec4 quat_to_rotate = rotation_to_quaternion(glm::vec3(m_camera.get_left()), radians);
+        glm::vec4 quat_to_rotate = rotation_to_quaternion(left, radians);
         rotation = glm::normalize(quaternion_multiply(rotation, quat_to_rotate));
         update_rotation = true;
     }
@@ -1244,7 +1385,7 @@ void Realtime::timerEvent(QTimerEvent *event) {
         float radians = 250.f * -deltaTime * radian_conversion;
         delta_roll += radians / plane_tilt;
         // Rotate around the up vector
-        glm::vec4 quat_to_rotate = rotation_to_quaternion(glm::vec3(m_camera.get_camera_look()), radians);
+        glm::vec4 quat_to_rotate = rotation_to_quaternion(glm::vec3(m_flight.camera_look), radians);
         rotation = glm::normalize(quaternion_multiply(rotation, quat_to_rotate));
         update_rotation = true;
     }
@@ -1254,28 +1395,89 @@ void Realtime::timerEvent(QTimerEvent *event) {
         float radians = 250.f * deltaTime * radian_conversion;
         delta_roll += radians / plane_tilt;
         // Rotate around the up vector
-        glm::vec4 quat_to_rotate = rotation_to_quaternion(glm::vec3(m_camera.get_camera_look()), radians);
+        glm::vec4 quat_to_rotate = rotation_to_quaternion(glm::vec3(m_flight.camera_look), radians);
         rotation = glm::normalize(quaternion_multiply(rotation, quat_to_rotate));
         update_rotation = true;
     }
 
     if (update_rotation) {
         // Compute newly rotated look and up vectors that define camera rotation matrix
-        glm::vec4 new_look = glm::vec4(quaternion_rotate(glm::vec3(m_camera.get_camera_look()), rotation), 0.0f);
-        glm::vec4 new_up = glm::vec4(quaternion_rotate(glm::vec3(m_camera.get_camera_up()), rotation), 0.0f);
+        glm::vec4 new_look = glm::vec4(quaternion_rotate(glm::vec3(m_flight.camera_look), rotation), 0.0f);
+        glm::vec4 new_up = glm::vec4(quaternion_rotate(glm::vec3(m_flight.camera_up), rotation), 0.0f);
 
-        // Apply these changes to the view matrix
-        m_camera.update_rotation_matrix(new_look, new_up);
-        m_camera.update_view_matrix();
+        // Apply these changes to the flight (normalized, as the camera would)
+        m_flight.camera_look = glm::normalize(new_look);
+        m_flight.camera_up = glm::normalize(new_up);
     }
 
     // Update speed
-    speed += delta_speed;
+    m_flight.speed += delta_speed;
     // Clamping for min and max speeds
-    speed = std::min(speed, 1.0f);
-    speed = std::max(speed, 0.05f);
+    m_flight.speed = std::min(m_flight.speed, 1.0f);
+    m_flight.speed = std::max(m_flight.speed, 0.05f);
+
+    // Update yaw, pitch, and roll accordingly (each springs back to 0 over a second once its key is let go)
+    if (delta_yaw != 0) {
+        m_flight.yaw_radians += delta_yaw;
+
+        // Clamp
+        m_flight.yaw_radians = std::min(m_flight.yaw_radians, 0.44f);
+        m_flight.yaw_radians = std::max(m_flight.yaw_radians, -0.44f);
+    }
+    else {
+        // Move back to 0
+        if (m_flight.yaw_radians < 0) {
+            m_flight.yaw_radians += 0.44f * deltaTime;
+            m_flight.yaw_radians = std::min(m_flight.yaw_radians, 0.0f);
+        }
+        else if (m_flight.yaw_radians > 0) {
+            m_flight.yaw_radians += -0.44f * deltaTime;
+            m_flight.yaw_radians = std::max(m_flight.yaw_radians, 0.0f);
+        }
+    }
+
+    // Change pitch of plane
+    if (delta_pitch != 0) {
+        m_flight.pitch_radians += delta_pitch;
+
+        // Clamp
+        m_flight.pitch_radians = std::min(m_flight.pitch_radians, 0.6f);
+        m_flight.pitch_radians = std::max(m_flight.pitch_radians, -0.6f);
+    }
+    else {
+        // Move back to 0
+        if (m_flight.pitch_radians < 0) {
+            m_flight.pitch_radians += 0.6f * deltaTime;
+            m_flight.pitch_radians = std::min(m_flight.pitch_radians, 0.0f);
+        }
+        else if (m_flight.pitch_radians > 0) {
+            m_flight.pitch_radians += -0.6f * deltaTime;
+            m_flight.pitch_radians = std::max(m_flight.pitch_radians, 0.0f);
+        }
+    }
+
+    // Change roll of plane
+    if (delta_roll != 0) {
+        m_flight.roll_radians += delta_roll;
+
+        // Clamp
+        m_flight.roll_radians = std::min(m_flight.roll_radians, 0.88f);
+        m_flight.roll_radians = std::max(m_flight.roll_radians, -0.88f);
+    }
+    else {
+        if (m_flight.roll_radians < 0) {
+            m_flight.roll_radians += 0.88f * deltaTime;
+            m_flight.roll_radians = std::min(m_flight.roll_radians, 0.0f);
+        }
+        else if (m_flight.roll_radians > 0) {
+            m_flight.roll_radians += -0.88f * deltaTime;
+            m_flight.roll_radians = std::max(m_flight.roll_radians, 0.0f);
+        }
+    }
 
-    update(); // asks for a PaintGL() call to occur
+    // Advance the camera by movement (Speed is how far it goes in a 60th of a second)
+    glm::vec4 delta_pos = m_flight.speed * 60.0f * deltaTime * m_flight.camera_look;
+    m_flight.camera_pos += delta_pos;
 }
 
 // DO NOT EDIT
@@ -1355,7 +1557,7 @@ void printMatrix(const glm::mat4& matrix) {
 // I take it this generates NUMBER amount of random model matrices? Nice
 std::vector<glm::mat4> Realtime::generateAsteroidTransformations(const unsigned int number, const std::vector<glm::vec3> coordinates) {
     const float radius = 100.0f;
-    const float radiusDeviation = settings.shapeParameter2;
+    const float radiusDeviation = m_settings.shapeParameter2;
     std::vector<glm::mat4> instanceMatrix;
 
     auto randf = []() {
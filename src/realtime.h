@@ -7,6 +7,8 @@
 #include <GL/glew.h>
 #include <glm/glm.hpp>
 
+#include <cstddef>
+#include <mutex>
 #include <unordered_map>
 #include <QFileDialog>
 #include <QElapsedTimer>
@@ -19,25 +21,100 @@
 #include "primitives/cube.h"
 #include "primitives/cylinder.h"
 #include "primitives/cone.h"
+#include "primitives/primitiveinstances.h"
 #include "utils/sceneparser.h"
 #include "utils/shaderloader.h"
 #include "utils/shader.h"
+#include "utils/uniformbuffer.h"
+#include "utils/ringbuffer.h"
+#include "utils/renderqueue.h"
+#include "utils/spscqueue.h"
+#include "settings.h"
 #include "meshes/skybox.h"
+#include "meshes/modelloader.h"
 
 // Holds light data in a specific way for passing to the shader
+// Laid out as std140 lays out the Light struct in the shaders' LightData block (hence the vec4 position)
 struct Light {
     glm::vec4 color;
-    glm::vec3 pos;
-    glm::vec3 attenuation_func;
+    glm::vec4 pos;
     glm::vec4 dir;
+    glm::vec3 attenuation_func;
     float penumbra;
     float angle;
     // Type indicates what kind of light this is
     // 0 -> Directional
     // 1 -> Point
     // 2 -> Spot
-    // -1 -> Light doesn't exist
-    int type = -1;
+    int type = 0;
+    // std140 rounds structs up to a multiple of 16 bytes
+    int padding[2] = {};
+};
+static_assert(sizeof(Light) == 80 && offsetof(Light, attenuation_func) == 48 && offsetof(Light, type) == 68);
+
+// Mirrors the FrameData uniform block (std140), which every shader reads its camera from
+// Written once a frame, however many programs draw with it
+struct FrameBlock {
+    glm::mat4 view_matrix;
+    glm::mat4 proj_matrix;
+    glm::mat4 inverse_view_matrix;
+    // w is 1
+    glm::vec4 camera_pos;
+    // Seconds since the widget was initialized
+    float time;
+    float padding[3];
+};
+static_assert(sizeof(FrameBlock) == 224);
+
+// Mirrors the start of the LightData uniform block (std140), which the phong and model shaders light with
+// The block's lights follow it, and only the first light_count of them are uploaded (or read)
+struct LightBlockHeader {
+    int light_count;
+    // std140 starts the array of Light structs on a 16 byte boundary
+    int padding[3];
+};
+
+class RenderThread;
+
+// A call the GUI thread hands to the render thread to make (see Realtime::post_to_render_thread), along with the
+// settings as they were when it was made (the render thread never reads the global settings, which the GUI changes)
+struct RenderCommand {
+    enum class Type {
+        Key,
+        Resize,
+        SettingsChanged,
+        SceneChanged,
+        GenerateScene,
+        SaveImage,
+    };
+    Type type = Type::SettingsChanged;
+    Settings settings;
+
+    // For keys, whether it was pressed or released, and when (m_clock nanoseconds)
+    Qt::Key key = Qt::Key_unknown;
+    bool pressed = false;
+    qint64 time = 0;
+    // For resizes, the new size
+    int width = 0;
+    int height = 0;
+    // For saving the image, where to
+    std::string path;
+};
+
+// Everything the simulation moves, which is stepped at a fixed rate and drawn between its last two steps
+struct FlightState {
+    // Camera (the spaceship flies with it)
+    glm::vec4 camera_pos = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+    glm::vec4 camera_look = glm::vec4(0.0f, 0.0f, -1.0f, 0.0f);
+    glm::vec4 camera_up = glm::vec4(0.0f, 1.0f, 0.0f, 0.0f);
+
+    // Spaceship data for controlling flight (distance covered per 60th of a second)
+    float speed = 0.1f;
+
+    // Spaceship data for controlling rotation
+    float pitch_radians = 0.0f;
+    float roll_radians = 0.0f;
+    float yaw_radians = 0.0f;
 };
 
 class Realtime : public QOpenGLWidget
@@ -49,14 +126,28 @@ public:
     void generate_scene();
     void settingsChanged();
     void saveViewportImage(std::string filePath);
-
-public slots:
-    void tick(QTimerEvent* event);                      // Called once per tick of m_timer
+    // Saves the viewport from whichever thread renders it (the render thread's next frame, if there is one)
+    void save_image(std::string file_path);
+
+    // Draws a frame on the render thread (with the context current there), once it's made the calls posted to it
+    void render_frame();
+
+    // What the last frame did, for the UI or a debug overlay to show (can be read from any thread)
+    struct FrameStats {
+        // Boxes tested and culled (primitives, model meshes and asteroid instances)
+        Culling::Stats culling;
+        // Draws submitted and the state changes they made
+        RenderQueue::Stats queue;
+        // How long the oldest input the frame picked up waited to be submitted, or -1 if it picked up none
+        double input_to_submit_ms = -1.0;
+    };
+    FrameStats frame_stats() const;
 
 protected:
     void initializeGL() override;                       // Called once at the start of the program
     void paintGL() override;                            // Called whenever the OpenGL context changes or by an update() request
     void resizeGL(int width, int height) override;      // Called when window size changes
+    void paintEvent(QPaintEvent *event) override;       // Draws with paintGL, unless the render thread does
 
 private:
     void keyPressEvent(QKeyEvent *event) override;
@@ -64,14 +155,27 @@ private:
     void mousePressEvent(QMouseEvent *event) override;
     void mouseReleaseEvent(QMouseEvent *event) override;
     void mouseMoveEvent(QMouseEvent *event) override;
-    void timerEvent(QTimerEvent *event) override;
+    void start_render_thread();
+    bool post_to_render_thread(RenderCommand command);
+    void run_command(const RenderCommand& command);
+    void request_frame();
+    void advance_simulation();
+    void simulate_step(float deltaTime);
+    void reset_flight();
+    void interpolate_flight(float alpha);
+    void note_input(qint64 time);
+    void latch_input();
     void updateMeshes();
     void deleteMeshes();
-    void send_light_to_shader(Shader shader, int index);
+    void upload_frame_data();
+    FrameBlock frame_block();
     void make_fbo();
     void delete_fbo();
     void paint_scene_geometry();
+    void update_primitive_bounds();
+    void update_primitive_instances();
     void paint_model_geometry();
+    glm::quat spaceship_rotation();
     void paint_skybox();
     void paint_post_process(GLuint texture);
 
@@ -88,17 +192,28 @@ private:
     glm::vec4 rotation_to_quaternion(glm::vec3 axis, float theta);
 
     // Tick Related Variables
-    int m_timer;                                        // Stores timer which attempts to run ~60 times per second
     QElapsedTimer m_elapsedTimer;                       // Stores timer which keeps track of actual time between frames
+    float simulation_rate = 120.0f;                     // Simulation steps per second (however often frames are drawn)
+    double m_sim_accumulator = 0.0;                     // Seconds of real time the simulation hasn't stepped through yet
+    QElapsedTimer m_clock;                              // Stores timer which keeps track of time since initializeGL (for shaders)
 
     // Input Related Variables
     bool m_mouseDown = false;                           // Stores state of left mouse button
     glm::vec2 m_prev_mouse_pos;                         // Stores mouse position
     std::unordered_map<Qt::Key, bool> m_keyMap;         // Stores whether keys are pressed or not
+    qint64 m_pending_input_ns = -1;                     // When the oldest input no frame has picked up yet came in (m_clock nanoseconds, or -1)
 
     // Device Correction Variables
     int m_devicePixelRatio;
 
+    // Render thread (nullptr when frames are drawn on the GUI thread, which is the default; run with --render-thread
+    // for one), and the calls the GUI thread posted to it that it hasn't made yet
+    bool m_use_render_thread = false;
+    RenderThread* m_render_thread = nullptr;
+    SpscQueue<RenderCommand, 256> m_render_commands;
+    // The settings as of the last call made on whichever thread draws (a copy, so the GUI can change the global ones)
+    Settings m_settings;
+
     // Primitives of each type (used to generate the meshes)
     Sphere default_sphere;
     Cube default_cube;
@@ -108,8 +223,13 @@ private:
     // Space to hold camera
     Camera m_camera;
 
-    // Space to hold lights
-    Light lights[8];
+    // Space to hold lights (the scene's, up to max_lights of them)
+    std::vector<Light> lights;
+    // Most lights a scene can have, which is how big the shaders' light array is (MAX_LIGHTS in them)
+    // Read when the shaders are compiled, and lowered then if the GL can't fit that many in a uniform block
+    int max_lights = 16;
+    // Set when lights changes, so they're uploaded at the next frame (and not at every frame)
+    bool lights_changed = true;
 
     // Space to hold primitives, separated by type
     std::vector<Sphere> spheres;
@@ -117,6 +237,22 @@ private:
     std::vector<Cylinder> cylinders;
     std::vector<Cone> cones;
 
+    // World space bounding boxes of the primitives above (spheres, then cubes, cylinders and cones), for culling
+    // The primitives don't move, so these are only rebuilt when the scene changes
+    Culling::Boxes primitive_boxes;
+    std::vector<unsigned char> primitive_visible;
+
+    // Instance buffers of the primitives above, one per type, so each type is one instanced draw
+    PrimitiveInstances sphere_instances;
+    PrimitiveInstances cube_instances;
+    PrimitiveInstances cylinder_instances;
+    PrimitiveInstances cone_instances;
+
+    // Stats of the frame being drawn, and of the last one drawn (which frame_stats hands out, under m_stats_mutex)
+    FrameStats m_frame_stats;
+    FrameStats m_last_frame_stats;
+    mutable std::mutex m_stats_mutex;
+
     // Shaders for Phong lighting equation and framebuffer operations
     Shader m_phong_shader;
     Shader m_framebuffer_shader;
@@ -124,6 +260,26 @@ private:
     Shader m_instancing_shader;
     Shader m_skybox_shader;
     Shader m_spaceship_shader;
+    // Versions of the model and spaceship shaders for models drawn through their ModelBatch
+    Shader m_model_batch_shader;
+    Shader m_spaceship_batch_shader;
+    // Depth-only versions of the shaders that draw opaque geometry, for the depth pre-pass (each shader above points
+    // at its own through depthOnly)
+    Shader m_phong_depth_shader;
+    Shader m_model_depth_shader;
+    Shader m_instancing_depth_shader;
+    Shader m_spaceship_depth_shader;
+    Shader m_model_batch_depth_shader;
+    Shader m_spaceship_batch_depth_shader;
+
+    // Every draw of the frame is queued here and submitted sorted, once everything is queued (see paintGL)
+    RenderQueue m_render_queue;
+
+    // Uniform buffers every shader shares (see UniformBlocks), written by upload_frame_data
+    // The frame's goes up once per frame, into the next region of a ring (so it never waits on the frames in flight
+    // still reading the last ones), the light one whenever lights has changed
+    RingBuffer m_frame_ubo;
+    UniformBuffer m_light_ubo;
 
     // Skybox!
     Skybox box;
@@ -168,6 +324,10 @@ private:
     // For asteroid generation
     std::vector<glm::mat4> generateAsteroidTransformations(const unsigned int number, const std::vector<glm::vec3> coordinates);
 
+    // Decodes models on worker threads; paintGL uploads what's ready, spending at most this long per frame
+    ModelLoader m_model_loader;
+    double model_upload_budget_ms = 4.0;
+
     // For holding different models to instantiate
     // TODO: Possibly make this a vector with multiple planets
     Model planet1;
@@ -184,18 +344,10 @@ private:
 
     bool planets_instantiated = false;
 
-    // Spaceship data for controlling flight
-    float speed = 0.1f;
-
-    // Spaceship data for controlling rotation
-    float pitch_radians = 0.0f;
-    float roll_radians = 0.0f;
-    float yaw_radians = 0.0f;
-
-    // Spaceship data for determining rotation
-    float delta_pitch = 0.0f;
-    float delta_roll = 0.0f;
-    float delta_yaw = 0.0f;
+    // Flight as of the last two simulation steps, and as drawn this frame (in between them)
+    FlightState m_flight;
+    FlightState m_prev_flight;
+    FlightState m_drawn_flight;
 
     // Param that controls how much the plane tilts
     float plane_tilt = 7.5f;
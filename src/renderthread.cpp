@@ -0,0 +1,98 @@
+#include "renderthread.h"
+
+#include "realtime.h"
+#include <QCoreApplication>
+#include <QOpenGLContext>
+
+RenderThread::RenderThread(Realtime* widget)
+    : m_widget(widget)
+{
+    m_thread.setObjectName("Render thread");
+    moveToThread(&m_thread);
+}
+
+RenderThread::~RenderThread() {
+    stop();
+}
+
+// Starts the thread's event loop, which render() runs in
+void RenderThread::start() {
+    m_thread.start();
+    request_frame();
+}
+
+// Stops the thread, waking render() if it's waiting for the context
+void RenderThread::stop() {
+    if (!m_thread.isRunning()) {
+        return;
+    }
+    m_exiting = true;
+    {
+        // render() checks m_exiting holding this, so it either sees it or is already waiting to be woken
+        QMutexLocker grab_lock(&m_grab_mutex);
+        m_grab_condition.wakeAll();
+    }
+    m_thread.quit();
+    m_thread.wait();
+}
+
+// Queued, so it runs on the render thread's event loop
+void RenderThread::request_frame() {
+    QMetaObject::invokeMethod(this, [this]() { render(); }, Qt::QueuedConnection);
+}
+
+// One frame: everything from input to submission happens here, whatever the GUI thread is up to
+void RenderThread::render() {
+    QOpenGLContext* context = m_widget->context();
+    if (context == nullptr) {
+        return;
+    }
+
+    // The context lives on the GUI thread between frames, so ask for it and wait until it's been moved here
+    m_grab_mutex.lock();
+    if (m_exiting) {
+        m_grab_mutex.unlock();
+        return;
+    }
+    m_handed_over = false;
+    QMetaObject::invokeMethod(m_widget, [this]() { hand_over_context(); }, Qt::QueuedConnection);
+    while (!m_handed_over && !m_exiting) {
+        m_grab_condition.wait(&m_grab_mutex);
+    }
+    bool handed_over = m_handed_over;
+    QMutexLocker render_lock(&m_render_mutex);
+    m_grab_mutex.unlock();
+
+    // Stopping wakes this up without handing the context over
+    if (!handed_over) {
+        return;
+    }
+
+    if (!m_exiting) {
+        m_widget->makeCurrent();
+        m_widget->render_frame();
+        m_widget->doneCurrent();
+    }
+
+    // The GUI thread composes the frame (and finish() cleans up) with the context, so it goes back there
+    context->moveToThread(QCoreApplication::instance()->thread());
+    render_lock.unlock();
+
+    // Composition is asked for on the GUI thread, and asks for the next frame once the swap is done
+    if (!m_exiting) {
+        QMetaObject::invokeMethod(m_widget, [widget = m_widget]() { widget->update(); }, Qt::QueuedConnection);
+    }
+}
+
+// Gives the context to the render thread (unless it's stopping, in which case it was already woken)
+void RenderThread::hand_over_context() {
+    if (m_exiting) {
+        return;
+    }
+    QMutexLocker grab_lock(&m_grab_mutex);
+    // A context can only be moved while it isn't current
+    m_widget->doneCurrent();
+    m_widget->context()->moveToThread(&m_thread);
+    m_handed_over = true;
+    m_grab_condition.wakeAll();
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <QMutex>
+#include <QObject>
+#include <QThread>
+#include <QWaitCondition>
+#include <atomic>
+
+class Realtime;
+
+// Draws Realtime's frames on a thread of its own, so the frame's CPU work (culling, sorting, submitting draws) runs
+// alongside the GUI thread's instead of in between its events
+// The widget's GL context is moved over here for each frame and handed back afterwards, since Qt composes the widget
+// (from the framebuffer the frame was drawn to) on the GUI thread. The GUI thread holds the render lock while it
+// composes or resizes that framebuffer, so neither happens in the middle of a frame
+// The object itself lives on the render thread: render() runs there, and the next frame is asked for once the last one
+// has been composed (so frames are paced by the display)
+// That hand-over is also its limit: a frame can't start until the GUI thread's event loop gets to hand_over_context(),
+// and the next one is only asked for from frameSwapped, so anything that keeps the GUI thread busy (a file dialog, a
+// slow slot) still delays submission. Getting out of that would need a context the render thread keeps for good,
+// drawing into a texture the widget only composes, or a QWindow surface instead of a QOpenGLWidget
+class RenderThread : public QObject
+{
+public:
+    explicit RenderThread(Realtime* widget);
+    ~RenderThread();
+
+    // Starts the thread and asks for its first frame
+    void start();
+    // Stops once the frame in progress (if any) is done, and waits for the thread to finish
+    // The context is back on the GUI thread afterwards
+    void stop();
+
+    // Asks for a frame to be drawn on the render thread (from any thread)
+    void request_frame();
+    // Draws a frame (render thread only): takes the context from the GUI thread, draws, and hands it back
+    void render();
+
+    // Moves the context to the render thread and lets render() go on (GUI thread only, where the context is between
+    // frames)
+    void hand_over_context();
+
+    // Held by the GUI thread while it uses the context itself
+    void lock() { m_render_mutex.lock(); }
+    void unlock() { m_render_mutex.unlock(); }
+
+private:
+    Realtime* m_widget;
+    QThread m_thread;
+    // Held for the whole of a frame
+    QMutex m_render_mutex;
+    // What render() waits on until hand_over_context() has moved the context
+    QMutex m_grab_mutex;
+    QWaitCondition m_grab_condition;
+    // Set (under m_grab_mutex) once the context has been moved for the frame render() is waiting to draw
+    bool m_handed_over = false;
+    std::atomic<bool> m_exiting = false;
+};
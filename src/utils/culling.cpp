@@ -0,0 +1,191 @@
+#include "culling.h"
+
+#include <algorithm>
+#include <cmath>
+#include <initializer_list>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define CULLING_AVX
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CULLING_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define CULLING_NEON
+#endif
+
+namespace Culling
+{
+Frustum frustum;
+Stats stats;
+
+// Every plane is a sum or difference of the matrix's last row and one of the others (clip space is -w <= x, y, z <= w)
+Frustum::Frustum(const glm::mat4& viewProjection) : enabled(true)
+{
+    glm::mat4 rows = glm::transpose(viewProjection);
+    planes[0] = rows[3] + rows[0]; // Left
+    planes[1] = rows[3] - rows[0]; // Right
+    planes[2] = rows[3] + rows[1]; // Bottom
+    planes[3] = rows[3] - rows[1]; // Top
+    planes[4] = rows[3] + rows[2]; // Near
+    planes[5] = rows[3] - rows[2]; // Far
+    for (glm::vec4& plane : planes)
+    {
+        plane /= glm::length(glm::vec3(plane));
+    }
+}
+
+void Boxes::clear()
+{
+    for (std::vector<float>* component : {&centerX, &centerY, &centerZ, &extentX, &extentY, &extentZ})
+    {
+        component->clear();
+    }
+}
+
+void Boxes::reserve(size_t count)
+{
+    for (std::vector<float>* component : {&centerX, &centerY, &centerZ, &extentX, &extentY, &extentZ})
+    {
+        component->reserve(count);
+    }
+}
+
+void Boxes::add(glm::vec3 center, glm::vec3 extent)
+{
+    centerX.push_back(center.x);
+    centerY.push_back(center.y);
+    centerZ.push_back(center.z);
+    extentX.push_back(extent.x);
+    extentY.push_back(extent.y);
+    extentZ.push_back(extent.z);
+}
+
+// The center goes through the matrix, and each new half extent is how far the old extents reach along that axis
+void Boxes::add(const glm::mat4& matrix, glm::vec3 center, glm::vec3 extent)
+{
+    glm::vec3 worldCenter = glm::vec3(matrix * glm::vec4(center, 1.0f));
+    glm::mat3 linear(matrix);
+    glm::vec3 worldExtent = glm::abs(linear[0]) * extent.x + glm::abs(linear[1]) * extent.y + glm::abs(linear[2]) * extent.z;
+    add(worldCenter, worldExtent);
+}
+
+// A box is outside a plane when even its corner furthest along the normal is behind it, so for each plane it's
+// kept while dot(normal, center) + distance + dot(|normal|, extent) >= 0
+size_t cull(const Frustum& frustum, const Boxes& boxes, std::vector<unsigned char>& visible)
+{
+    size_t count = boxes.size();
+    visible.resize(count);
+    if (!frustum.enabled)
+    {
+        std::fill(visible.begin(), visible.end(), 1);
+        stats.tested += count;
+        return count;
+    }
+
+    size_t i = 0;
+#if defined(CULLING_AVX)
+    const __m256 signMask = _mm256_set1_ps(-0.0f);
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256 cx = _mm256_loadu_ps(&boxes.centerX[i]);
+        __m256 cy = _mm256_loadu_ps(&boxes.centerY[i]);
+        __m256 cz = _mm256_loadu_ps(&boxes.centerZ[i]);
+        __m256 ex = _mm256_loadu_ps(&boxes.extentX[i]);
+        __m256 ey = _mm256_loadu_ps(&boxes.extentY[i]);
+        __m256 ez = _mm256_loadu_ps(&boxes.extentZ[i]);
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (const glm::vec4& plane : frustum.planes)
+        {
+            __m256 nx = _mm256_set1_ps(plane.x);
+            __m256 ny = _mm256_set1_ps(plane.y);
+            __m256 nz = _mm256_set1_ps(plane.z);
+            __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, cx), _mm256_mul_ps(ny, cy)),
+                                            _mm256_add_ps(_mm256_mul_ps(nz, cz), _mm256_set1_ps(plane.w)));
+            __m256 reach = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_andnot_ps(signMask, nx), ex),
+                                                       _mm256_mul_ps(_mm256_andnot_ps(signMask, ny), ey)),
+                                         _mm256_mul_ps(_mm256_andnot_ps(signMask, nz), ez));
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(distance, reach), _mm256_setzero_ps(), _CMP_GE_OQ));
+        }
+        int mask = _mm256_movemask_ps(inside);
+        for (int lane = 0; lane < 8; lane++)
+        {
+            visible[i + lane] = (mask >> lane) & 1;
+        }
+    }
+#elif defined(CULLING_SSE2)
+    const __m128 signMask = _mm_set1_ps(-0.0f);
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 cx = _mm_loadu_ps(&boxes.centerX[i]);
+        __m128 cy = _mm_loadu_ps(&boxes.centerY[i]);
+        __m128 cz = _mm_loadu_ps(&boxes.centerZ[i]);
+        __m128 ex = _mm_loadu_ps(&boxes.extentX[i]);
+        __m128 ey = _mm_loadu_ps(&boxes.extentY[i]);
+        __m128 ez = _mm_loadu_ps(&boxes.extentZ[i]);
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (const glm::vec4& plane : frustum.planes)
+        {
+            __m128 nx = _mm_set1_ps(plane.x);
+            __m128 ny = _mm_set1_ps(plane.y);
+            __m128 nz = _mm_set1_ps(plane.z);
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, cx), _mm_mul_ps(ny, cy)),
+                                         _mm_add_ps(_mm_mul_ps(nz, cz), _mm_set1_ps(plane.w)));
+            __m128 reach = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_andnot_ps(signMask, nx), ex),
+                                                 _mm_mul_ps(_mm_andnot_ps(signMask, ny), ey)),
+                                      _mm_mul_ps(_mm_andnot_ps(signMask, nz), ez));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(distance, reach), _mm_setzero_ps()));
+        }
+        int mask = _mm_movemask_ps(inside);
+        for (int lane = 0; lane < 4; lane++)
+        {
+            visible[i + lane] = (mask >> lane) & 1;
+        }
+    }
+#elif defined(CULLING_NEON)
+    for (; i + 4 <= count; i += 4)
+    {
+        float32x4_t cx = vld1q_f32(&boxes.centerX[i]);
+        float32x4_t cy = vld1q_f32(&boxes.centerY[i]);
+        float32x4_t cz = vld1q_f32(&boxes.centerZ[i]);
+        float32x4_t ex = vld1q_f32(&boxes.extentX[i]);
+        float32x4_t ey = vld1q_f32(&boxes.extentY[i]);
+        float32x4_t ez = vld1q_f32(&boxes.extentZ[i]);
+        uint32x4_t inside = vdupq_n_u32(~0u);
+        for (const glm::vec4& plane : frustum.planes)
+        {
+            float32x4_t distance = vmlaq_n_f32(vmlaq_n_f32(vmlaq_n_f32(vdupq_n_f32(plane.w), cx, plane.x), cy, plane.y), cz, plane.z);
+            float32x4_t reach = vmlaq_n_f32(vmlaq_n_f32(vmulq_n_f32(ex, std::fabs(plane.x)), ey, std::fabs(plane.y)), ez, std::fabs(plane.z));
+            inside = vandq_u32(inside, vcgeq_f32(vaddq_f32(distance, reach), vdupq_n_f32(0.0f)));
+        }
+        uint32_t lanes[4];
+        vst1q_u32(lanes, inside);
+        for (int lane = 0; lane < 4; lane++)
+        {
+            visible[i + lane] = lanes[lane] != 0;
+        }
+    }
+#endif
+    for (; i < count; i++)
+    {
+        bool inside = true;
+        for (const glm::vec4& plane : frustum.planes)
+        {
+            float distance = plane.x * boxes.centerX[i] + plane.y * boxes.centerY[i] + plane.z * boxes.centerZ[i] + plane.w;
+            float reach = std::fabs(plane.x) * boxes.extentX[i] + std::fabs(plane.y) * boxes.extentY[i] + std::fabs(plane.z) * boxes.extentZ[i];
+            inside = inside && distance + reach >= 0.0f;
+        }
+        visible[i] = inside;
+    }
+
+    size_t kept = 0;
+    for (unsigned char v : visible)
+    {
+        kept += v;
+    }
+    stats.tested += count;
+    stats.culled += count - kept;
+    return kept;
+}
+}
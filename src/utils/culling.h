@@ -0,0 +1,52 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <vector>
+
+// Frustum culling: throwing away objects whose bounding boxes are entirely outside what the camera sees, before
+// anything is drawn. Boxes are kept structure-of-arrays, so one SIMD instruction tests a plane against 4 (or 8) boxes
+namespace Culling
+{
+// The six planes around what a camera sees, as (normal, distance) with the normals pointing inwards and normalized:
+// a point p is on the inside of a plane when dot(normal, p) + distance >= 0
+struct Frustum
+{
+    glm::vec4 planes[6];
+    // A default Frustum culls nothing
+    bool enabled = false;
+
+    Frustum() = default;
+    // Pulls the planes out of a projection * view matrix (Gribb and Hartmann), in the space the matrix maps from
+    explicit Frustum(const glm::mat4& viewProjection);
+};
+
+// Axis-aligned bounding boxes (as centers and half extents), one array per component
+struct Boxes
+{
+    std::vector<float> centerX, centerY, centerZ;
+    std::vector<float> extentX, extentY, extentZ;
+
+    size_t size() const { return centerX.size(); }
+    void clear();
+    void reserve(size_t count);
+    void add(glm::vec3 center, glm::vec3 extent);
+    // Adds the box around another box (center, extent) after matrix (Arvo's method)
+    void add(const glm::mat4& matrix, glm::vec3 center, glm::vec3 extent);
+};
+
+// What Model::Draw culls its meshes against (set before drawing; a Frustum() draws everything)
+extern Frustum frustum;
+
+// How many boxes were tested and how many of those were culled, since the last reset (Realtime resets it every frame)
+struct Stats
+{
+    size_t tested = 0;
+    size_t culled = 0;
+};
+extern Stats stats;
+
+// Sets visible[i] to 1 for every box at least partly inside the frustum and to 0 for the rest, and returns how many
+// are visible. A box that straddles the corner outside two planes can be kept, but one that's visible never goes
+size_t cull(const Frustum& frustum, const Boxes& boxes, std::vector<unsigned char>& visible);
+}
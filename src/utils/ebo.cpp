@@ -11,6 +11,12 @@ EBO::EBO(std::vector<GLuint>& indices)
     Debug::glErrorCheck();
 }
 
+// Wraps a buffer that already exists (e.g. one shared between meshes) without creating a new one
+EBO::EBO(GLuint existingID)
+{
+    ID = existingID;
+}
+
 // Binds the EBO
 void EBO::Bind()
 {
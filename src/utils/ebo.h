@@ -10,6 +10,8 @@ public:
     GLuint ID;
     // Constructor that generates a Elements Buffer Object and links it to indices
     EBO(std::vector<GLuint>& indices);
+    // Wraps a buffer that already exists (e.g. one shared between meshes) without creating a new one
+    explicit EBO(GLuint existingID);
 
     // Binds the EBO
     void Bind();
@@ -0,0 +1,25 @@
+#include "gldeletequeue.h"
+
+std::mutex GLDeleteQueue::s_mutex;
+std::vector<std::function<void()>> GLDeleteQueue::s_pending;
+
+// Queues deleter to run on the GL thread
+void GLDeleteQueue::defer(std::function<void()> deleter)
+{
+    std::lock_guard<std::mutex> lock(s_mutex);
+    s_pending.push_back(std::move(deleter));
+}
+
+// Takes the queue as it is and runs it without the lock, so a deleter that frees another asset can queue more
+void GLDeleteQueue::flush()
+{
+    std::vector<std::function<void()>> pending;
+    {
+        std::lock_guard<std::mutex> lock(s_mutex);
+        pending.swap(s_pending);
+    }
+    for (std::function<void()>& deleter : pending)
+    {
+        deleter();
+    }
+}
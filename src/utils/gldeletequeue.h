@@ -0,0 +1,21 @@
+#pragma once
+
+#include <functional>
+#include <mutex>
+#include <vector>
+
+// GL objects whose owner can go away on any thread (the last reference to a shared asset can be dropped by a loader
+// worker, a loader callback or the GUI thread, none of which have the context current) are deleted through here:
+// the owner queues what deletes them, and the GL thread runs it once a frame
+class GLDeleteQueue
+{
+public:
+    // Queues deleter to run on the GL thread (from any thread)
+    static void defer(std::function<void()> deleter);
+    // Runs everything queued so far (GL thread only, with the context current)
+    static void flush();
+
+private:
+    static std::mutex s_mutex;
+    static std::vector<std::function<void()>> s_pending;
+};
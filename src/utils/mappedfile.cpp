@@ -0,0 +1,143 @@
+#include "mappedfile.h"
+
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+#include <utility>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Constructor for an empty mapping
+MappedFile::MappedFile() {
+    m_data = nullptr;
+    m_size = 0;
+    m_open = false;
+}
+
+// Maps the whole file read-only. The file handle itself is closed straight away since the mapping keeps the pages alive
+MappedFile::MappedFile(const std::string& path) {
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        std::cerr << "Throwing exception from bad file load of file: " << path << "\n";
+        throw std::runtime_error("Failed to open file: " + path);
+    }
+
+    LARGE_INTEGER fileSize;
+    GetFileSizeEx(file, &fileSize);
+    m_size = static_cast<size_t>(fileSize.QuadPart);
+
+    if (m_size > 0) {
+        HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping != nullptr) {
+            m_data = static_cast<const unsigned char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+            // The view holds its own reference to the mapping
+            CloseHandle(mapping);
+        }
+        if (m_data == nullptr) {
+            CloseHandle(file);
+            throw std::runtime_error("Failed to map file: " + path);
+        }
+    }
+    CloseHandle(file);
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "Throwing exception from bad file load of file: " << path << "\n";
+        throw std::runtime_error("Failed to open file: " + path);
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        close(fd);
+        throw std::runtime_error("Failed to stat file: " + path);
+    }
+    m_size = static_cast<size_t>(info.st_size);
+
+    if (m_size > 0) {
+        void* mapped = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped == MAP_FAILED) {
+            close(fd);
+            throw std::runtime_error("Failed to map file: " + path);
+        }
+        // We read the whole thing front to back, so let the kernel read ahead
+        madvise(mapped, m_size, MADV_SEQUENTIAL);
+        m_data = static_cast<const unsigned char*>(mapped);
+    }
+    close(fd);
+#endif
+    m_open = true;
+}
+
+MappedFile::~MappedFile() {
+    release();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept {
+    m_data = std::exchange(other.m_data, nullptr);
+    m_size = std::exchange(other.m_size, 0);
+    m_open = std::exchange(other.m_open, false);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+    if (this != &other) {
+        release();
+        m_data = std::exchange(other.m_data, nullptr);
+        m_size = std::exchange(other.m_size, 0);
+        m_open = std::exchange(other.m_open, false);
+    }
+    return *this;
+}
+
+// Read-only view over the mapped bytes
+std::span<const unsigned char> MappedFile::bytes() const {
+    return std::span<const unsigned char>(m_data, m_size);
+}
+
+// Same bytes, viewed as text (used for parsing JSON without copying it first)
+std::string_view MappedFile::text() const {
+    return std::string_view(reinterpret_cast<const char*>(m_data), m_size);
+}
+
+size_t MappedFile::size() const {
+    return m_size;
+}
+
+bool MappedFile::isOpen() const {
+    return m_open;
+}
+
+// Size and modification time of a file, or false if it doesn't exist
+bool MappedFile::stamp(const std::string& path, uint64_t& size, int64_t& modified) {
+    std::error_code error;
+    size = std::filesystem::file_size(path, error);
+    if (error) {
+        return false;
+    }
+    modified = std::filesystem::last_write_time(path, error).time_since_epoch().count();
+    return !error;
+}
+
+// Unmaps the file
+void MappedFile::release() {
+    if (m_data != nullptr) {
+#ifdef _WIN32
+        UnmapViewOfFile(m_data);
+#else
+        munmap(const_cast<unsigned char*>(m_data), m_size);
+#endif
+    }
+    m_data = nullptr;
+    m_size = 0;
+    m_open = false;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+
+// Read-only memory mapping of a whole file
+// Views handed out by bytes() and text() point straight into the mapping, so they are only valid while
+// the MappedFile that produced them is alive (and hasn't been released)
+class MappedFile
+{
+public:
+    // Constructor for an empty mapping
+    MappedFile();
+    // Maps the file at path (throws std::runtime_error if it can't be opened or mapped)
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+
+    // A mapping has exactly one owner, so it can be moved but not copied
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // Views over the mapped bytes
+    std::span<const unsigned char> bytes() const;
+    std::string_view text() const;
+
+    size_t size() const;
+    bool isOpen() const;
+
+    // Size and modification time of a file, or false if it doesn't exist
+    // Caches built from a file store these, so they can tell when the file has changed since
+    static bool stamp(const std::string& path, uint64_t& size, int64_t& modified);
+
+    // Unmaps the file (any views into it become invalid)
+    void release();
+
+private:
+    const unsigned char* m_data = nullptr;
+    size_t m_size = 0;
+    // Zero-length files can't be mapped, so we track "open" separately from m_data
+    bool m_open = false;
+};
@@ -0,0 +1,209 @@
+#include "renderqueue.h"
+
+#include "meshes/material.h"
+#include <algorithm>
+#include <array>
+
+namespace
+{
+// Keeps the low bits of an id, shifted to where they go in the key
+uint64_t field(uint64_t value, int bits, int shift)
+{
+    return (value & ((uint64_t(1) << bits) - 1)) << shift;
+}
+
+// Whether a draw's back faces are seen, so they can't be culled
+bool doubleSided(const RenderQueue::Packet& packet)
+{
+    return packet.doubleSided || (packet.material != nullptr && packet.material->doubleSided);
+}
+}
+
+// Empties the queue for the next frame
+void RenderQueue::clear()
+{
+    packets.clear();
+}
+
+// Queues a draw with its key
+void RenderQueue::push(Pass pass, Packet packet, float distance)
+{
+    // Nearer draws sort first, so the depth test throws away more of what's behind them
+    float fraction = std::clamp(distance / farDistance, 0.0f, 1.0f);
+    uint64_t depth = uint64_t(fraction * float((1 << 24) - 1));
+
+    // With the pre-pass, the draw's depth goes in first (no material, since nothing is shaded), and the shaded draw
+    // after it is sorted by state, since the depth test only lets through what's on screen whatever the order
+    if (pass == Pass::Opaque && depthPrepass && packet.shader != nullptr && packet.shader->depthOnly != nullptr)
+    {
+        Packet depthPacket = packet;
+        depthPacket.shader = packet.shader->depthOnly;
+        depthPacket.material = nullptr;
+        depthPacket.doubleSided = doubleSided(packet);
+        depthPacket.key = field(uint64_t(Pass::Depth), 4, 60)
+            | field(depth, 24, 36)
+            | field(depthPacket.shader->ID, 8, 28)
+            | field(packet.vao, 12, 0);
+        packets.push_back(depthPacket);
+    }
+
+    GLuint program = packet.shader != nullptr ? packet.shader->ID : 0;
+    GLuint texture = packet.material != nullptr ? packet.material->diffuse.ID : 0;
+    if (pass == Pass::Opaque && !depthPrepass)
+    {
+        packet.key = field(uint64_t(pass), 4, 60)
+            | field(depth, 24, 36)
+            | field(program, 8, 28)
+            | field(texture, 16, 12)
+            | field(packet.vao, 12, 0);
+    }
+    else
+    {
+        packet.key = field(uint64_t(pass), 4, 60)
+            | field(program, 8, 52)
+            | field(texture, 16, 36)
+            | field(packet.vao, 12, 24)
+            | field(depth, 24, 0);
+    }
+    packets.push_back(packet);
+}
+
+// Least significant digit first, so each pass keeps the order of the ones before it
+void RenderQueue::sort()
+{
+    entries.resize(packets.size());
+    for (size_t i = 0; i < packets.size(); i++)
+    {
+        entries[i] = Entry{packets[i].key, uint32_t(i)};
+    }
+    scratch.resize(entries.size());
+
+    for (int shift = 0; shift < 64; shift += 8)
+    {
+        std::array<size_t, 256> counts = {};
+        for (const Entry& entry : entries)
+        {
+            counts[(entry.key >> shift) & 0xFF]++;
+        }
+        // A digit every key has in common doesn't change the order
+        if (std::find(counts.begin(), counts.end(), entries.size()) != counts.end())
+        {
+            continue;
+        }
+
+        size_t next = 0;
+        for (size_t& count : counts)
+        {
+            size_t start = next;
+            next += count;
+            count = start;
+        }
+        for (const Entry& entry : entries)
+        {
+            scratch[counts[(entry.key >> shift) & 0xFF]++] = entry;
+        }
+        entries.swap(scratch);
+    }
+}
+
+// Sorts the queued draws and draws them, only switching state a packet needs that isn't already bound
+void RenderQueue::submit()
+{
+    sort();
+
+    stats = Stats();
+    stats.packets = packets.size();
+
+    Shader* boundShader = nullptr;
+    // 0 when it isn't known which vertex array is bound (after a draw that binds its own)
+    GLuint boundVao = 0;
+    Material* boundMaterial = nullptr;
+    // -1 until the first packet sets them
+    int boundPass = -1;
+    int boundCulling = -1;
+    for (const Entry& entry : entries)
+    {
+        const Packet& packet = packets[entry.packet];
+        Pass pass = Pass(packet.key >> 60);
+        if (int(pass) != boundPass)
+        {
+            beginPass(pass, stats.depthPackets > 0);
+            boundPass = int(pass);
+        }
+        if (pass == Pass::Depth)
+        {
+            stats.depthPackets++;
+        }
+        int culling = doubleSided(packet) ? 0 : 1;
+        if (culling != boundCulling)
+        {
+            if (culling)
+            {
+                glEnable(GL_CULL_FACE);
+            }
+            else
+            {
+                glDisable(GL_CULL_FACE);
+            }
+            Debug::glErrorCheck();
+            boundCulling = culling;
+        }
+        if (packet.shader != boundShader)
+        {
+            packet.shader->Activate();
+            boundShader = packet.shader;
+            stats.programs++;
+            // Material uniforms belong to the program, so the next one has to set them again
+            boundMaterial = nullptr;
+        }
+        else
+        {
+            stats.programsAvoided++;
+        }
+        if (packet.vao != 0 && packet.vao != boundVao)
+        {
+            glBindVertexArray(packet.vao);
+            Debug::glErrorCheck();
+            stats.vaos++;
+        }
+        else if (packet.vao != 0)
+        {
+            stats.vaosAvoided++;
+        }
+        boundVao = packet.vao;
+        if (packet.material != nullptr && packet.material != boundMaterial)
+        {
+            packet.material->Bind(*packet.shader);
+            boundMaterial = packet.material;
+            stats.materials++;
+        }
+        else if (packet.material != nullptr)
+        {
+            stats.materialsAvoided++;
+        }
+
+        packet.draw(packet);
+    }
+
+    glBindVertexArray(0);
+    Debug::glErrorCheck();
+    glUseProgram(0);
+    Debug::glErrorCheck();
+    // Back to what everything drawn outside the queue expects
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    Debug::glErrorCheck();
+    glDepthFunc(GL_LESS);
+    Debug::glErrorCheck();
+    glDisable(GL_CULL_FACE);
+    Debug::glErrorCheck();
+}
+
+// The pre-pass only writes depth, and once it has, a shaded fragment is kept if it's at the depth the pre-pass left
+void RenderQueue::beginPass(Pass pass, bool afterDepth)
+{
+    GLboolean color = pass == Pass::Depth ? GL_FALSE : GL_TRUE;
+    glColorMask(color, color, color, color);
+    Debug::glErrorCheck();
+    glDepthFunc(pass == Pass::Opaque && afterDepth ? GL_LEQUAL : GL_LESS);
+    Debug::glErrorCheck();
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "utils/debug.h"
+#include "utils/shader.h"
+#include <cstdint>
+#include <vector>
+
+struct Material;
+
+// Everything drawn in a frame goes through here: draws are queued as packets with a 64-bit sort key, sorted (radix
+// sort) once everything is queued, and submitted in key order, so draws needing the same program, material and
+// vertex array end up next to each other and each of those is only switched when it actually changes
+// Key layout, most significant first: pass (4 bits), program (8), material (16), vertex array (12), distance (24)
+// The depth pre-pass (and opaque draws, when there's no pre-pass) go front to back first instead: pass (4 bits),
+// distance (24), program (8), material (16), vertex array (12)
+// The ids in the key are GL object names cut down to their bits, which can only make two states sort together that
+// shouldn't (never draw with the wrong state, since submission compares the actual state)
+class RenderQueue
+{
+public:
+    // Passes are drawn in order, and everything in one pass is sorted by state and then front to back
+    enum class Pass : uint64_t
+    {
+        // Depth only, front to back: opaque draws are queued here as well when there's a pre-pass (see depthPrepass)
+        Depth = 0,
+        Opaque = 1,
+        // Drawn behind everything else (at the far plane), so it goes once the depth buffer is filled in
+        Sky = 2,
+    };
+
+    // A queued draw: the state it needs and what draws it
+    struct Packet
+    {
+        uint64_t key = 0;
+        Shader* shader = nullptr;
+        // 0 if the draw binds its own vertex arrays
+        GLuint vao = 0;
+        // Textures and color bound through Material::Bind (nullptr if the draw doesn't use one)
+        Material* material = nullptr;
+        // Back faces are culled unless this or the material's doubleSided is set
+        bool doubleSided = false;
+        // Sets the draw's own uniforms and issues it, with the state above already set
+        // object and index are whatever the draw needs to find its data again
+        void (*draw)(const Packet& packet) = nullptr;
+        void* object = nullptr;
+        unsigned int index = 0;
+    };
+
+    // State switches made by the last submit(), and how many were avoided because a packet's state was already bound
+    // (drawing everything by itself, every packet would have switched its program, vertex array and material)
+    struct Stats
+    {
+        size_t packets = 0;
+        // Of those, the depth pre-pass's
+        size_t depthPackets = 0;
+        size_t programs = 0;
+        size_t programsAvoided = 0;
+        size_t vaos = 0;
+        size_t vaosAvoided = 0;
+        size_t materials = 0;
+        size_t materialsAvoided = 0;
+    };
+    Stats stats;
+
+    // Distances are quantized over [0, farDistance] (anything further sorts as if it were at farDistance)
+    float farDistance = 10000.0f;
+
+    // Opaque draws whose program has a depthOnly variant are drawn into the depth buffer first, front to back and
+    // with color writes off, and then shaded at GL_LEQUAL, so only the fragments that end up on screen are shaded
+    // Without it, opaque draws are sorted front to back before state, so early depth testing throws away what it can
+    bool depthPrepass = true;
+
+    // Empties the queue for the next frame
+    void clear();
+    // Queues a draw, filling in its key from the pass, its state and its distance from the camera
+    void push(Pass pass, Packet packet, float distance = 0.0f);
+    // Sorts the queued draws and draws them (leaves no program or vertex array bound, color writes on, the depth test at
+    // GL_LESS and face culling off)
+    void submit();
+
+private:
+    std::vector<Packet> packets;
+    // Keys with the index of their packet in the low bits of a second word, sorted in place of the packets
+    struct Entry
+    {
+        uint64_t key;
+        uint32_t packet;
+    };
+    std::vector<Entry> entries;
+    std::vector<Entry> scratch;
+
+    // Least significant digit first, 8 bits at a time, skipping digits every key shares
+    void sort();
+    // Sets the color writes and depth test a pass draws with (afterDepth if the pre-pass drew anything)
+    static void beginPass(Pass pass, bool afterDepth);
+};
@@ -0,0 +1,166 @@
+#include "ringbuffer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+namespace
+{
+// The frame being recorded (frames are counted from 1, so a region last used in frame 0 never was)
+uint64_t frame = 1;
+// Fence after each frame in flight, frame f's at f % regions
+GLsync fences[RingBuffer::regions] = {};
+
+const GLbitfield mapFlags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+// Blocks until the GPU is done with a fenced frame
+void waitFor(GLsync fence)
+{
+    GLenum result = GL_TIMEOUT_EXPIRED;
+    while (result == GL_TIMEOUT_EXPIRED)
+    {
+        // Flushing makes sure the fence actually gets to the GPU (otherwise this could wait forever)
+        result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+        Debug::glErrorCheck();
+    }
+}
+}
+
+// Buffer storage is core from GL 4.4
+bool RingBuffer::persistent()
+{
+    return GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage;
+}
+
+// Makes the buffer (mapping it for good when it can be)
+void RingBuffer::create(size_t regionSize, size_t alignment)
+{
+    Delete();
+
+    size = regionSize;
+    stride = (std::max<size_t>(regionSize, 1) + alignment - 1) / alignment * alignment;
+    GLsizeiptr total = stride * regions;
+
+    glGenBuffers(1, &ID);
+    Debug::glErrorCheck();
+    glBindBuffer(GL_COPY_WRITE_BUFFER, ID);
+    Debug::glErrorCheck();
+    if (persistent())
+    {
+        glBufferStorage(GL_COPY_WRITE_BUFFER, total, nullptr, mapFlags);
+        Debug::glErrorCheck();
+        mapped = static_cast<unsigned char*>(glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, total, mapFlags));
+        Debug::glErrorCheck();
+    }
+    else
+    {
+        glBufferData(GL_COPY_WRITE_BUFFER, total, nullptr, GL_STREAM_DRAW);
+        Debug::glErrorCheck();
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    Debug::glErrorCheck();
+
+    current = 0;
+    std::fill(std::begin(lastUsed), std::end(lastUsed), 0);
+}
+
+// Moves to the next region, waiting if a frame still in flight drew from it
+size_t RingBuffer::next()
+{
+    current = (current + 1) % regions;
+    uint64_t used = lastUsed[current];
+    if (used == frame)
+    {
+        // Already drawn from this frame, which isn't fenced yet (only happens when a buffer is rewritten more than
+        // regions - 1 times in a frame)
+        glFinish();
+        Debug::glErrorCheck();
+    }
+    else if (used != 0 && frame - used <= regions)
+    {
+        waitFor(fences[used % regions]);
+    }
+    // Frames further back were already waited for by endFrame
+    use();
+    return offset();
+}
+
+// Writes into the current region
+void RingBuffer::write(const void* data, size_t size, size_t offset)
+{
+    if (offset + size > this->size)
+    {
+        std::cerr << "Ring buffer write of " << size << " bytes at " << offset << " doesn't fit in " << this->size << std::endl;
+        throw std::out_of_range("Ring buffer write out of range");
+    }
+    if (mapped != nullptr)
+    {
+        // Coherent, so the GPU sees this without a flush
+        std::memcpy(mapped + this->offset() + offset, data, size);
+        return;
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, ID);
+    Debug::glErrorCheck();
+    glBufferSubData(GL_COPY_WRITE_BUFFER, this->offset() + offset, size, data);
+    Debug::glErrorCheck();
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    Debug::glErrorCheck();
+}
+
+// Marks the current region as drawn from in this frame
+void RingBuffer::use()
+{
+    lastUsed[current] = frame;
+}
+
+// Deletes the buffer
+void RingBuffer::Delete()
+{
+    if (ID != 0)
+    {
+        if (mapped != nullptr)
+        {
+            glBindBuffer(GL_COPY_WRITE_BUFFER, ID);
+            Debug::glErrorCheck();
+            glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+            Debug::glErrorCheck();
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+            Debug::glErrorCheck();
+            mapped = nullptr;
+        }
+        glDeleteBuffers(1, &ID);
+        Debug::glErrorCheck();
+        ID = 0;
+    }
+    size = stride = 0;
+}
+
+// Fences the frame, after waiting out the one that had its slot
+void RingBuffer::endFrame()
+{
+    GLsync& fence = fences[frame % regions];
+    if (fence != nullptr)
+    {
+        waitFor(fence);
+        glDeleteSync(fence);
+        Debug::glErrorCheck();
+    }
+    fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    Debug::glErrorCheck();
+    frame++;
+}
+
+// Deletes the fences still around
+void RingBuffer::deleteFences()
+{
+    for (GLsync& fence : fences)
+    {
+        if (fence != nullptr)
+        {
+            glDeleteSync(fence);
+            Debug::glErrorCheck();
+            fence = nullptr;
+        }
+    }
+}
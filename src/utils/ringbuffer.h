@@ -0,0 +1,62 @@
+#pragma once
+
+#include "utils/debug.h"
+#include <cstddef>
+#include <cstdint>
+
+// A buffer split into regions that are written in turn, for data the CPU rewrites while the GPU may still be drawing
+// with an older version of it (the frame's camera, instance matrices)
+// Each write goes to the next region, which is only waited on if a frame that drew from it is still in flight, so
+// writing never stalls on the GPU the way rewriting (or orphaning) a buffer in use can
+// With GL 4.4 (or ARB_buffer_storage) the buffer is mapped once, persistently and coherently, and written with a
+// memcpy; the 4.1 context doesn't have that, so otherwise writes go through glBufferSubData into the free region
+// Frames are fenced by endFrame(), which also keeps the CPU at most `regions` frames ahead of the GPU
+class RingBuffer
+{
+public:
+    // Regions per buffer, and how many frames can be in flight
+    static const unsigned int regions = 3;
+
+    // ID reference of the buffer (0 until create())
+    GLuint ID = 0;
+
+    // Makes a buffer with room for regionSize bytes in each region (regions start on multiples of alignment, for
+    // binding a range of them)
+    void create(size_t regionSize, size_t alignment = 1);
+    // Moves on to the next region, waiting until no frame in flight draws from it, and returns its offset
+    // The region counts as drawn from this frame
+    size_t next();
+    // Replaces size bytes at offset into the current region with data
+    void write(const void* data, size_t size, size_t offset = 0);
+    template<typename T>
+    void write(const T& value, size_t offset = 0)
+    {
+        write(&value, sizeof(T), offset);
+    }
+    // Marks the current region as drawn from this frame (for data written once and drawn with over several frames)
+    void use();
+
+    // Offset of the current region, and how much room each one has
+    size_t offset() const { return current * stride; }
+    size_t regionSize() const { return size; }
+
+    // Deletes the buffer (unmapping it first)
+    void Delete();
+
+    // True when buffers are mapped persistently rather than written with glBufferSubData
+    static bool persistent();
+    // Fences off everything submitted this frame and starts the next one, first waiting for the frame `regions`
+    // frames back (call once a frame, after its last draw)
+    static void endFrame();
+    // Deletes the fences of the frames in flight (on exit)
+    static void deleteFences();
+
+private:
+    size_t size = 0;
+    size_t stride = 0;
+    unsigned int current = 0;
+    // The frame each region was last drawn from in (0 if it never was)
+    uint64_t lastUsed[regions] = {};
+    // Where the buffer is mapped (nullptr when it's written with glBufferSubData)
+    unsigned char* mapped = nullptr;
+};
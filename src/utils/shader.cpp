@@ -1,22 +1,43 @@
 #include"shader.h"
 
+#include<algorithm>
+#include<cstring>
+#include<glm/gtc/type_ptr.hpp>
+
 // Default constructor
 Shader::Shader() {
     ID = 0;
 }
 
 // Constructor that also loads shader data
-Shader::Shader(const char* vertexFile, const char* fragmentFile) {
-    ID = ShaderLoader::createShaderProgram(vertexFile, fragmentFile);
+Shader::Shader(const char* vertexFile, const char* fragmentFile, const std::string& defines) {
+    ID = ShaderLoader::createShaderProgram(vertexFile, fragmentFile, defines);
+    reflect();
 }
 
 // Load data for shader
-void Shader::loadData(const char* vertexFile, const char* fragmentFile)
+void Shader::loadData(const char* vertexFile, const char* fragmentFile, const std::string& defines)
 {
     // Uses the shaderloader code given to us to make the shader
-    ID = ShaderLoader::createShaderProgram(vertexFile, fragmentFile);
+    ID = ShaderLoader::createShaderProgram(vertexFile, fragmentFile, defines);
+    Debug::glErrorCheck();
+    reflect();
+}
+
+// Load a transform feedback program
+void Shader::loadFeedback(const char* vertexFile, const char* geometryFile, const std::vector<const char*>& varyings, const std::string& defines)
+{
+    ID = ShaderLoader::createFeedbackProgram(vertexFile, geometryFile, varyings, defines);
     Debug::glErrorCheck();
+    reflect();
+}
 
+// Load a compute program
+void Shader::loadCompute(const char* computeFile, const std::string& defines)
+{
+    ID = ShaderLoader::createComputeProgram(computeFile, defines);
+    Debug::glErrorCheck();
+    reflect();
 }
 
 // Activates the Shader Program
@@ -38,4 +59,157 @@ void Shader::Delete()
 {
     glDeleteProgram(ID);
     Debug::glErrorCheck();
+    uniforms.clear();
+}
+
+// Asks the driver for every active uniform once, right after linking, and binds the shared uniform blocks
+void Shader::reflect()
+{
+    uniforms.clear();
+
+    GLint count = 0;
+    glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+    Debug::glErrorCheck();
+    GLint maxLength = 0;
+    glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+    Debug::glErrorCheck();
+
+    std::vector<GLchar> name(std::max(maxLength, 1));
+    for (GLint i = 0; i < count; i++)
+    {
+        Uniform uniform;
+        GLsizei length = 0;
+        glGetActiveUniform(ID, i, name.size(), &length, &uniform.size, &uniform.type, name.data());
+        Debug::glErrorCheck();
+        uniform.name.assign(name.data(), length);
+        uniform.location = glGetUniformLocation(ID, uniform.name.c_str());
+        Debug::glErrorCheck();
+
+        // Uniforms in a block are set through its buffer, so they have no location
+        if (uniform.location < 0)
+        {
+            continue;
+        }
+        // Arrays are reported as "name[0]", and are stored under the plain name
+        if (uniform.name.size() > 3 && uniform.name.compare(uniform.name.size() - 3, 3, "[0]") == 0)
+        {
+            uniform.name.resize(uniform.name.size() - 3);
+        }
+        uniforms.push_back(uniform);
+    }
+
+    std::sort(uniforms.begin(), uniforms.end(), [](const Uniform& a, const Uniform& b) { return a.name < b.name; });
+
+    // GLSL 330 can't give a block a binding in the shader, so the blocks every program shares get theirs here
+    for (const UniformBlock& block : UniformBlocks::all)
+    {
+        GLuint index = glGetUniformBlockIndex(ID, block.name);
+        Debug::glErrorCheck();
+        if (index != GL_INVALID_INDEX)
+        {
+            glUniformBlockBinding(ID, index, block.binding);
+            Debug::glErrorCheck();
+        }
+    }
+}
+
+// Index of a uniform in the table (a binary search by name), or -1
+int Shader::find(std::string_view name) const
+{
+    if (name.size() > 3 && name.substr(name.size() - 3) == "[0]")
+    {
+        name.remove_suffix(3);
+    }
+    auto it = std::lower_bound(uniforms.begin(), uniforms.end(), name, [](const Uniform& uniform, std::string_view key) {
+        return std::string_view(uniform.name) < key;
+    });
+    return it != uniforms.end() && it->name == name ? int(it - uniforms.begin()) : -1;
+}
+
+// Location of an active uniform, or -1
+GLint Shader::uniformLocation(std::string_view name) const
+{
+    int index = find(name);
+    return index < 0 ? -1 : uniforms[index].location;
+}
+
+// Finds the uniform and remembers value for it, unless it already holds that value
+Shader::Uniform* Shader::changed(std::string_view name, const void* value, size_t size)
+{
+    int index = find(name);
+    if (index < 0)
+    {
+        return nullptr;
+    }
+    Uniform& uniform = uniforms[index];
+    if (uniform.known && std::memcmp(uniform.value, value, size) == 0)
+    {
+        return nullptr;
+    }
+    std::memcpy(uniform.value, value, size);
+    uniform.known = true;
+    return &uniform;
+}
+
+void Shader::setInt(std::string_view name, GLint value)
+{
+    if (Uniform* uniform = changed(name, &value, sizeof(value)))
+    {
+        glUniform1i(uniform->location, value);
+        Debug::glErrorCheck();
+    }
+}
+
+void Shader::setFloat(std::string_view name, GLfloat value)
+{
+    if (Uniform* uniform = changed(name, &value, sizeof(value)))
+    {
+        glUniform1f(uniform->location, value);
+        Debug::glErrorCheck();
+    }
+}
+
+void Shader::setVec2(std::string_view name, const glm::vec2& value)
+{
+    if (Uniform* uniform = changed(name, glm::value_ptr(value), sizeof(value)))
+    {
+        glUniform2fv(uniform->location, 1, glm::value_ptr(value));
+        Debug::glErrorCheck();
+    }
+}
+
+void Shader::setVec3(std::string_view name, const glm::vec3& value)
+{
+    if (Uniform* uniform = changed(name, glm::value_ptr(value), sizeof(value)))
+    {
+        glUniform3fv(uniform->location, 1, glm::value_ptr(value));
+        Debug::glErrorCheck();
+    }
+}
+
+void Shader::setVec4(std::string_view name, const glm::vec4& value)
+{
+    if (Uniform* uniform = changed(name, glm::value_ptr(value), sizeof(value)))
+    {
+        glUniform4fv(uniform->location, 1, glm::value_ptr(value));
+        Debug::glErrorCheck();
+    }
+}
+
+void Shader::setMat3(std::string_view name, const glm::mat3& value)
+{
+    if (Uniform* uniform = changed(name, glm::value_ptr(value), sizeof(value)))
+    {
+        glUniformMatrix3fv(uniform->location, 1, GL_FALSE, glm::value_ptr(value));
+        Debug::glErrorCheck();
+    }
+}
+
+void Shader::setMat4(std::string_view name, const glm::mat4& value)
+{
+    if (Uniform* uniform = changed(name, glm::value_ptr(value), sizeof(value)))
+    {
+        glUniformMatrix4fv(uniform->location, 1, GL_FALSE, glm::value_ptr(value));
+        Debug::glErrorCheck();
+    }
 }
@@ -2,7 +2,11 @@
 
 #include"utils/debug.h"
 #include"utils/shaderloader.h"
+#include"utils/uniformbuffer.h"
+#include<glm/glm.hpp>
 #include<string>
+#include<string_view>
+#include<vector>
 #include<fstream>
 #include<sstream>
 #include<iostream>
@@ -13,13 +17,21 @@ class Shader
 public:
     // Reference ID of the Shader Program
     GLuint ID;
+    // The same vertex stage with a fragment stage that only leaves depth behind, which the render queue's depth
+    // pre-pass draws with (nullptr keeps the program's draws out of the pre-pass)
+    Shader* depthOnly = nullptr;
     // Default constructor
     Shader();
     // Constructor that build the Shader Program from 2 different shaders
-    Shader(const char* vertexFile, const char* fragmentFile);
+    // defines (lines like "#define MAX_LIGHTS 16\n") are added to the top of both
+    Shader(const char* vertexFile, const char* fragmentFile, const std::string& defines = "");
 
     // Loads shader data into a shader object
-    void loadData(const char* vertexFile, const char* fragmentFile);
+    void loadData(const char* vertexFile, const char* fragmentFile, const std::string& defines = "");
+    // Loads a vertex and geometry shader whose outputs (varyings) are captured by transform feedback
+    void loadFeedback(const char* vertexFile, const char* geometryFile, const std::vector<const char*>& varyings, const std::string& defines = "");
+    // Loads a compute shader (needs GL 4.3)
+    void loadCompute(const char* computeFile, const std::string& defines = "");
 
     // Activates the Shader Program
     void Activate();
@@ -27,4 +39,41 @@ public:
     void Deactivate();
     // Deletes the Shader Program
     void Delete();
+
+    // Location of an active uniform, or -1 if the program doesn't have one by that name
+    // Looked up in the table built at link time, so it never asks the driver
+    GLint uniformLocation(std::string_view name) const;
+
+    // Sets a uniform of the program (which has to be active). Arrays can be named with or without "[0]"
+    // The last value of every uniform is kept, so setting one to what it already holds doesn't reach the driver,
+    // and names the program doesn't use are ignored (like glUniform* does with location -1)
+    void setInt(std::string_view name, GLint value);
+    void setFloat(std::string_view name, GLfloat value);
+    void setVec2(std::string_view name, const glm::vec2& value);
+    void setVec3(std::string_view name, const glm::vec3& value);
+    void setVec4(std::string_view name, const glm::vec4& value);
+    void setMat3(std::string_view name, const glm::mat3& value);
+    void setMat4(std::string_view name, const glm::mat4& value);
+
+private:
+    // An active uniform as glGetActiveUniform reports it, and the value it was last set to through this class
+    struct Uniform
+    {
+        std::string name;
+        GLint location = -1;
+        GLenum type = 0;
+        GLint size = 0;
+        unsigned char value[sizeof(glm::mat4)] = {};
+        bool known = false;
+    };
+
+    // Every active uniform outside a uniform block, sorted by name
+    std::vector<Uniform> uniforms;
+
+    // Fills in uniforms from the linked program, and points its shared uniform blocks at their binding points
+    void reflect();
+    // Index of the uniform with the given name, or -1
+    int find(std::string_view name) const;
+    // The uniform to upload value to, or nullptr if there's no such uniform or it already holds value
+    Uniform* changed(std::string_view name, const void* value, size_t size);
 };
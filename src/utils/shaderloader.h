@@ -8,18 +8,64 @@
 #include <QFile>
 #include <QTextStream>
 #include <iostream>
+#include <string>
+#include <vector>
 
 class ShaderLoader{
 public:
-    static GLuint createShaderProgram(const char * vertex_file_path, const char * fragment_file_path){
+    // defines (e.g. "#define MAX_LIGHTS 16\n") goes into both shaders, right after their #version line
+    static GLuint createShaderProgram(const char * vertex_file_path, const char * fragment_file_path, const std::string &defines = ""){
         // Create and compile the shaders.
-        GLuint vertexShaderID = createShader(GL_VERTEX_SHADER, vertex_file_path);
-        GLuint fragmentShaderID = createShader(GL_FRAGMENT_SHADER, fragment_file_path);
+        GLuint vertexShaderID = createShader(GL_VERTEX_SHADER, vertex_file_path, defines);
+        GLuint fragmentShaderID = createShader(GL_FRAGMENT_SHADER, fragment_file_path, defines);
 
         // Link the shader program.
         GLuint programID = glCreateProgram();
         glAttachShader(programID, vertexShaderID);
         glAttachShader(programID, fragmentShaderID);
+        linkProgram(programID);
+
+        // Shaders no longer necessary, stored in program
+        glDeleteShader(vertexShaderID);
+        glDeleteShader(fragmentShaderID);
+
+        return programID;
+    }
+
+    // A vertex and geometry shader whose outputs (varyings, in order) are captured with transform feedback
+    // Interleaved, so "gl_NextBuffer" between varyings moves on to the next buffer binding
+    static GLuint createFeedbackProgram(const char * vertex_file_path, const char * geometry_file_path, const std::vector<const char *> &varyings, const std::string &defines = ""){
+        GLuint vertexShaderID = createShader(GL_VERTEX_SHADER, vertex_file_path, defines);
+        GLuint geometryShaderID = createShader(GL_GEOMETRY_SHADER, geometry_file_path, defines);
+
+        // Varyings have to be named before linking
+        GLuint programID = glCreateProgram();
+        glAttachShader(programID, vertexShaderID);
+        glAttachShader(programID, geometryShaderID);
+        glTransformFeedbackVaryings(programID, varyings.size(), varyings.data(), GL_INTERLEAVED_ATTRIBS);
+        linkProgram(programID);
+
+        glDeleteShader(vertexShaderID);
+        glDeleteShader(geometryShaderID);
+
+        return programID;
+    }
+
+    // A compute shader on its own (needs GL 4.3)
+    static GLuint createComputeProgram(const char * compute_file_path, const std::string &defines = ""){
+        GLuint computeShaderID = createShader(GL_COMPUTE_SHADER, compute_file_path, defines);
+
+        GLuint programID = glCreateProgram();
+        glAttachShader(programID, computeShaderID);
+        linkProgram(programID);
+
+        glDeleteShader(computeShaderID);
+
+        return programID;
+    }
+
+private:
+    static void linkProgram(GLuint programID){
         glLinkProgram(programID);
 
         // Print the info log if error
@@ -36,16 +82,9 @@ public:
             glDeleteProgram(programID);
             throw std::runtime_error(log);
         }
-
-        // Shaders no longer necessary, stored in program
-        glDeleteShader(vertexShaderID);
-        glDeleteShader(fragmentShaderID);
-
-        return programID;
     }
 
-private:
-    static GLuint createShader(GLenum shaderType, const char *filepath){
+    static GLuint createShader(GLenum shaderType, const char *filepath, const std::string &defines){
         GLuint shaderID = glCreateShader(shaderType);
 
         // Read shader file.
@@ -59,6 +98,13 @@ private:
             throw std::runtime_error(std::string("Failed to open shader: ")+filepath);
         }
 
+        // Add the defines (#version has to stay the first thing in the file)
+        if (!defines.empty()) {
+            size_t version = code.find("#version");
+            size_t line_end = version == std::string::npos ? std::string::npos : code.find('\n', version);
+            code.insert(line_end == std::string::npos ? 0 : line_end + 1, defines);
+        }
+
         // Compile shader code.
         const char *codePtr = code.c_str();
         glShaderSource(shaderID, 1, &codePtr, nullptr); // Assumes code is null terminated
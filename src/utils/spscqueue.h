@@ -0,0 +1,61 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+// Fixed-size queue for handing things from one thread to another without a lock: exactly one thread pushes and one
+// other thread pops
+// Each side only ever writes its own index (released, and acquired by the other side), so neither side waits on the
+// other; a full queue just refuses the push
+template<typename T, size_t Capacity>
+class SpscQueue
+{
+    static_assert((Capacity & (Capacity - 1)) == 0, "Capacity has to be a power of two");
+
+public:
+    // Pushing side: copies value in, or returns false (leaving the queue as it was) when it's full
+    bool push(const T& value)
+    {
+        size_t tail = this->tail.load(std::memory_order_relaxed);
+        if (tail - head.load(std::memory_order_acquire) == Capacity)
+        {
+            return false;
+        }
+        items[tail & (Capacity - 1)] = value;
+        this->tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Popping side: the oldest value, left where it is, or nullptr when there's nothing to pop
+    const T* front() const
+    {
+        size_t head = this->head.load(std::memory_order_relaxed);
+        if (tail.load(std::memory_order_acquire) == head)
+        {
+            return nullptr;
+        }
+        return &items[head & (Capacity - 1)];
+    }
+
+    // Popping side: moves the oldest value out, or returns false when there's nothing to pop
+    bool pop(T& value)
+    {
+        size_t head = this->head.load(std::memory_order_relaxed);
+        if (tail.load(std::memory_order_acquire) == head)
+        {
+            return false;
+        }
+        value = std::move(items[head & (Capacity - 1)]);
+        this->head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    std::array<T, Capacity> items;
+    // Counts of values ever popped and pushed (items are indexed by them modulo Capacity)
+    // Each on a cache line of its own, since they're written by different threads
+    alignas(64) std::atomic<size_t> head{0};
+    alignas(64) std::atomic<size_t> tail{0};
+};
@@ -0,0 +1,65 @@
+#include "threadpool.h"
+
+// Starts the workers (0 means one fewer than the number of cores, but at least one)
+ThreadPool::ThreadPool(unsigned int threads) {
+    if (threads == 0) {
+        // hardware_concurrency() is 0 when the core count isn't known, so it's checked before subtracting
+        unsigned int cores = std::thread::hardware_concurrency();
+        threads = cores > 1 ? cores - 1 : 1;
+    }
+    for (unsigned int i = 0; i < threads; i++) {
+        m_workers.emplace_back(&ThreadPool::workerLoop, this);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    shutdown();
+}
+
+// Queues a task to run on one of the workers
+void ThreadPool::enqueue(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_stopping) {
+            return;
+        }
+        m_tasks.push(std::move(task));
+    }
+    m_condition.notify_one();
+}
+
+// Drops any tasks that haven't started and waits for the running ones to finish
+void ThreadPool::shutdown() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+        m_tasks = {};
+    }
+    m_condition.notify_all();
+    for (std::thread& worker : m_workers) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+    m_workers.clear();
+}
+
+size_t ThreadPool::threadCount() const {
+    return m_workers.size();
+}
+
+void ThreadPool::workerLoop() {
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_condition.wait(lock, [this] { return m_stopping || !m_tasks.empty(); });
+            if (m_stopping) {
+                return;
+            }
+            task = std::move(m_tasks.front());
+            m_tasks.pop();
+        }
+        task();
+    }
+}
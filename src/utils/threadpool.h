@@ -0,0 +1,39 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads that run queued tasks in the order they were queued
+// Tasks must not touch OpenGL (there's no context on the workers)
+class ThreadPool
+{
+public:
+    // Starts the workers (0 means one fewer than the number of cores, but at least one)
+    explicit ThreadPool(unsigned int threads = 0);
+    // Drops any tasks that haven't started and waits for the running ones to finish
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Queues a task to run on one of the workers
+    void enqueue(std::function<void()> task);
+
+    // Same as the destructor, for when the owner needs the workers gone at a specific point
+    void shutdown();
+
+    size_t threadCount() const;
+
+private:
+    void workerLoop();
+
+    std::vector<std::thread> m_workers;
+    std::queue<std::function<void()>> m_tasks;
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    bool m_stopping = false;
+};
@@ -0,0 +1,51 @@
+#include "uniformbuffer.h"
+
+#include <iostream>
+#include <stdexcept>
+
+// Makes the buffer and binds it to the block's binding point (which holds until another buffer is bound there)
+void UniformBuffer::create(const UniformBlock& block, size_t size)
+{
+    Delete();
+
+    glGenBuffers(1, &ID);
+    Debug::glErrorCheck();
+    glBindBuffer(GL_UNIFORM_BUFFER, ID);
+    Debug::glErrorCheck();
+    glBufferData(GL_UNIFORM_BUFFER, size, nullptr, GL_DYNAMIC_DRAW);
+    Debug::glErrorCheck();
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    Debug::glErrorCheck();
+
+    glBindBufferBase(GL_UNIFORM_BUFFER, block.binding, ID);
+    Debug::glErrorCheck();
+    this->size = size;
+}
+
+// Replaces part of the buffer
+void UniformBuffer::update(const void* data, size_t size, size_t offset)
+{
+    if (offset + size > this->size)
+    {
+        std::cerr << "Uniform buffer update of " << size << " bytes at " << offset << " doesn't fit in " << this->size << std::endl;
+        throw std::out_of_range("Uniform buffer update out of range");
+    }
+    glBindBuffer(GL_UNIFORM_BUFFER, ID);
+    Debug::glErrorCheck();
+    glBufferSubData(GL_UNIFORM_BUFFER, offset, size, data);
+    Debug::glErrorCheck();
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    Debug::glErrorCheck();
+}
+
+// Deletes the buffer
+void UniformBuffer::Delete()
+{
+    if (ID != 0)
+    {
+        glDeleteBuffers(1, &ID);
+        Debug::glErrorCheck();
+        ID = 0;
+    }
+    size = 0;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "utils/debug.h"
+#include <cstddef>
+
+// A uniform block shared by every shader, and the binding point it's read from
+// Shader points blocks with these names at their binding points when it links, so a buffer bound there reaches every
+// program that declares the block, and the data in it is uploaded once no matter how many programs read it
+struct UniformBlock
+{
+    const char* name;
+    GLuint binding;
+};
+
+namespace UniformBlocks
+{
+// Camera matrices and position, and the time (FrameBlock in realtime.h)
+inline constexpr UniformBlock frame = {"FrameData", 0};
+// The scene's lights (LightBlock in realtime.h)
+inline constexpr UniformBlock lights = {"LightData", 1};
+
+inline constexpr UniformBlock all[] = {frame, lights};
+}
+
+// A uniform buffer object bound to one of the UniformBlocks binding points
+// The contents are a std140 block, laid out by a struct on the C++ side that mirrors the GLSL declaration
+class UniformBuffer
+{
+public:
+    // ID reference of the buffer (0 until create())
+    GLuint ID = 0;
+
+    // Makes an (uninitialized) buffer of size bytes and binds it to the block's binding point
+    void create(const UniformBlock& block, size_t size);
+    // Replaces size bytes at offset with data
+    void update(const void* data, size_t size, size_t offset = 0);
+    // Replaces the start of the buffer with a whole block
+    template<typename T>
+    void update(const T& block)
+    {
+        update(&block, sizeof(T));
+    }
+
+    // Deletes the buffer
+    void Delete();
+
+private:
+    size_t size = 0;
+};
@@ -8,11 +8,11 @@ VAO::VAO()
 }
 
 // Links a VBO Attribute such as a position or color to the VAO
-void VAO::LinkAttrib(VBO& VBO, GLuint layout, GLuint numComponents, GLenum type, GLsizeiptr stride, void* offset)
+void VAO::LinkAttrib(VBO& VBO, GLuint layout, GLuint numComponents, GLenum type, GLsizeiptr stride, void* offset, GLboolean normalized)
 {
     VBO.Bind();
     Debug::glErrorCheck();
-    glVertexAttribPointer(layout, numComponents, type, GL_FALSE, stride, offset);
+    glVertexAttribPointer(layout, numComponents, type, normalized, stride, offset);
     Debug::glErrorCheck();
     glEnableVertexAttribArray(layout);
     Debug::glErrorCheck();
@@ -20,6 +20,15 @@ void VAO::LinkAttrib(VBO& VBO, GLuint layout, GLuint numComponents, GLenum type,
     Debug::glErrorCheck();
 }
 
+// Links every attribute of a vertex format
+void VAO::LinkAttribs(VBO& VBO, const VertexFormat& format)
+{
+    for (const VertexAttribute& attribute : format.attributes())
+    {
+        LinkAttrib(VBO, attribute.layout, attribute.numComponents, attribute.type, format.stride(), (void*)(uintptr_t)attribute.offset, attribute.normalized);
+    }
+}
+
 // Binds the VAO
 void VAO::Bind()
 {
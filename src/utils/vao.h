@@ -2,6 +2,7 @@
 
 #include "utils/debug.h"
 #include"VBO.h"
+#include"utils/vertexformat.h"
 
 class VAO
 {
@@ -12,7 +13,9 @@ public:
     VAO();
 
     // Links a VBO Attribute such as a position or color to the VAO
-    void LinkAttrib(VBO& VBO, GLuint layout, GLuint numComponents, GLenum type, GLsizeiptr stride, void* offset);
+    void LinkAttrib(VBO& VBO, GLuint layout, GLuint numComponents, GLenum type, GLsizeiptr stride, void* offset, GLboolean normalized = GL_FALSE);
+    // Links every attribute of a vertex format (the VBO holds vertices in that format)
+    void LinkAttribs(VBO& VBO, const VertexFormat& format);
     // Binds the VAO
     void Bind();
     // Unbinds the VAO
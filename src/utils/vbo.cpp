@@ -20,6 +20,12 @@ VBO::VBO(std::vector<glm::mat4>& mat4s)
     Debug::glErrorCheck();
 }
 
+// Wraps a buffer that already exists (e.g. one shared between meshes) without creating a new one
+VBO::VBO(GLuint existingID)
+{
+    ID = existingID;
+}
+
 // Binds the VBO
 void VBO::Bind()
 {
@@ -24,6 +24,8 @@ public:
     // Constructor that generates a Vertex Buffer Object and links it to vertices
     VBO(std::vector<Vertex>& vertices);
     VBO(std::vector<glm::mat4>& mat4s);
+    // Wraps a buffer that already exists (e.g. one shared between meshes) without creating a new one
+    explicit VBO(GLuint existingID);
 
     // Binds the VBO
     void Bind();
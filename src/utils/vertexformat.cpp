@@ -0,0 +1,137 @@
+#include "vertexformat.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <glm/gtc/packing.hpp>
+#include <utility>
+
+namespace {
+// Vertex layouts of the packed formats (all fields are 4 byte aligned, which some drivers want)
+struct CompactVertex {
+    float position[3];
+    uint32_t normal;
+    uint32_t texUV;
+};
+
+struct QuantizedVertex {
+    uint16_t position[4];
+    uint32_t normal;
+    uint32_t texUV;
+};
+
+// Normal as signed 10:10:10:2 (GL_INT_2_10_10_10_REV), which the attribute fetch turns back into floats
+uint32_t packNormal(const glm::vec3& normal) {
+    float length = glm::length(normal);
+    glm::vec3 unit = length > 0.0f ? normal / length : glm::vec3(0.0f);
+    return glm::packSnorm3x10_1x2(glm::vec4(unit, 0.0f));
+}
+}
+
+// The decoded layout: 3 floats each for position, normal and color and 2 for UVs
+const VertexFormat& VertexFormat::standard() {
+    static const VertexFormat format(Layout::Standard, sizeof(Vertex), {
+        {0, 3, GL_FLOAT, GL_FALSE, offsetof(Vertex, position)},
+        {1, 3, GL_FLOAT, GL_FALSE, offsetof(Vertex, normal)},
+        {2, 3, GL_FLOAT, GL_FALSE, offsetof(Vertex, color)},
+        {3, 2, GL_FLOAT, GL_FALSE, offsetof(Vertex, texUV)},
+    });
+    return format;
+}
+
+// Float positions, normals packed into 10:10:10:2 and half float UVs, without the color
+const VertexFormat& VertexFormat::compact() {
+    static const VertexFormat format(Layout::Compact, sizeof(CompactVertex), {
+        {0, 3, GL_FLOAT, GL_FALSE, offsetof(CompactVertex, position)},
+        {1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, offsetof(CompactVertex, normal)},
+        {3, 2, GL_HALF_FLOAT, GL_FALSE, offsetof(CompactVertex, texUV)},
+    });
+    return format;
+}
+
+// compact(), but with positions stored as 16-bit fractions of the mesh's bounds
+const VertexFormat& VertexFormat::quantized() {
+    static const VertexFormat format(Layout::Quantized, sizeof(QuantizedVertex), {
+        {0, 3, GL_UNSIGNED_SHORT, GL_TRUE, offsetof(QuantizedVertex, position)},
+        {1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, offsetof(QuantizedVertex, normal)},
+        {3, 2, GL_HALF_FLOAT, GL_FALSE, offsetof(QuantizedVertex, texUV)},
+    });
+    return format;
+}
+
+VertexFormat::VertexFormat(Layout layout, GLsizei stride, std::vector<VertexAttribute> attributes) {
+    m_layout = layout;
+    m_stride = stride;
+    m_attributes = std::move(attributes);
+}
+
+GLsizei VertexFormat::stride() const {
+    return m_stride;
+}
+
+const std::vector<VertexAttribute>& VertexFormat::attributes() const {
+    return m_attributes;
+}
+
+bool VertexFormat::quantizesPositions() const {
+    return m_layout == Layout::Quantized;
+}
+
+// Converts vertices to this format, ready for glBufferData
+std::vector<unsigned char> VertexFormat::pack(std::span<const Vertex> vertices, glm::vec3& positionScale, glm::vec3& positionOffset) const {
+    positionScale = glm::vec3(1.0f);
+    positionOffset = glm::vec3(0.0f);
+    std::vector<unsigned char> packed(vertices.size() * m_stride);
+
+    switch (m_layout) {
+    case Layout::Standard:
+        std::memcpy(packed.data(), vertices.data(), vertices.size_bytes());
+        break;
+
+    case Layout::Compact: {
+        CompactVertex* out = reinterpret_cast<CompactVertex*>(packed.data());
+        for (size_t i = 0; i < vertices.size(); i++) {
+            std::memcpy(out[i].position, &vertices[i].position[0], sizeof(out[i].position));
+            out[i].normal = packNormal(vertices[i].normal);
+            out[i].texUV = glm::packHalf2x16(vertices[i].texUV);
+        }
+        break;
+    }
+
+    case Layout::Quantized: {
+        // Positions become fractions of the bounding box, so the 16 bits are spent where the mesh actually is
+        glm::vec3 minimum(0.0f);
+        glm::vec3 maximum(0.0f);
+        if (!vertices.empty()) {
+            minimum = maximum = vertices[0].position;
+        }
+        for (const Vertex& vertex : vertices) {
+            minimum = glm::min(minimum, vertex.position);
+            maximum = glm::max(maximum, vertex.position);
+        }
+        glm::vec3 extent = maximum - minimum;
+        for (int c = 0; c < 3; c++) {
+            if (extent[c] <= 0.0f) {
+                extent[c] = 1.0f;
+            }
+        }
+        positionScale = extent;
+        positionOffset = minimum;
+
+        QuantizedVertex* out = reinterpret_cast<QuantizedVertex*>(packed.data());
+        for (size_t i = 0; i < vertices.size(); i++) {
+            glm::vec3 fraction = glm::clamp((vertices[i].position - minimum) / extent, 0.0f, 1.0f);
+            for (int c = 0; c < 3; c++) {
+                out[i].position[c] = static_cast<uint16_t>(std::lround(fraction[c] * 65535.0f));
+            }
+            out[i].position[3] = 0;
+            out[i].normal = packNormal(vertices[i].normal);
+            out[i].texUV = glm::packHalf2x16(vertices[i].texUV);
+        }
+        break;
+    }
+    }
+    return packed;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "utils/vbo.h"
+#include <span>
+#include <vector>
+
+// One vertex attribute as glVertexAttribPointer sees it
+struct VertexAttribute
+{
+    GLuint layout;
+    GLint numComponents;
+    GLenum type;
+    GLboolean normalized;
+    GLuint offset;
+};
+
+// How vertices are laid out in a vertex buffer, and how to get them there from the decoded Vertex array
+// Every format feeds the same shader inputs (aPos, aNormal, aTex), so the shaders don't need to know which one a mesh uses
+// Locations the format doesn't have (e.g. the constant aColor) fall back to the current generic attribute value
+class VertexFormat
+{
+public:
+    // The decoded layout: 3 floats each for position, normal and color and 2 for UVs (44 bytes)
+    static const VertexFormat& standard();
+    // Float positions, normals packed into 10:10:10:2 and half float UVs, without the color (20 bytes)
+    static const VertexFormat& compact();
+    // compact(), but with positions stored as 16-bit fractions of the mesh's bounds (16 bytes)
+    // The shader gets them back through position_scale and position_offset
+    static const VertexFormat& quantized();
+
+    GLsizei stride() const;
+    const std::vector<VertexAttribute>& attributes() const;
+    bool quantizesPositions() const;
+
+    // Converts vertices to this format, ready for glBufferData
+    // positionScale and positionOffset are what the shader has to apply to aPos to get back the original positions
+    std::vector<unsigned char> pack(std::span<const Vertex> vertices, glm::vec3& positionScale, glm::vec3& positionOffset) const;
+
+private:
+    enum class Layout { Standard, Compact, Quantized };
+
+    VertexFormat(Layout layout, GLsizei stride, std::vector<VertexAttribute> attributes);
+
+    Layout m_layout;
+    GLsizei m_stride;
+    std::vector<VertexAttribute> m_attributes;
+};